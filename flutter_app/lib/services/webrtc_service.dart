@@ -42,6 +42,11 @@ class WebRTCService extends ChangeNotifier {
   Completer<void>? _cleanupCompleter;
   Timer? _diagnosticsTimer;
 
+  // ICE restart on network change (e.g. Wi-Fi -> LTE); full failure only if
+  // the restart does not reconnect within this time
+  Timer? _iceRestartTimer;
+  static const Duration _iceRestartTimeout = Duration(seconds: 8);
+
   // Getters
   StreamState get connectionState => _connectionState;
   String get statusMessage => _statusMessage;
@@ -269,7 +274,11 @@ class WebRTCService extends ChangeNotifier {
           _handleJoined(data);
           break;
         case 'offer':
-          _handleOffer(data);
+          if (data['ice_restart'] == true && _peerConnection != null) {
+            _handleIceRestartOffer(data);
+          } else {
+            _handleOffer(data);
+          }
           break;
         case 'ice-candidate':
           _handleIceCandidate(data);
@@ -281,6 +290,12 @@ class WebRTCService extends ChangeNotifier {
         case 'streamer-disconnected':
           _updateState(StreamState.disconnected, 'Streamer disconnected');
           break;
+        case 'broadcaster-migrated':
+          _handleBroadcasterMigrated();
+          break;
+        case 'peer-reclaimed':
+          _updateState(StreamState.failed, 'Connection lost');
+          break;
       }
     } catch (e) {
       debugPrint('[WebRTC] Error parsing message: $e');
@@ -294,6 +309,60 @@ class WebRTCService extends ChangeNotifier {
     _updateState(StreamState.connecting, 'Waiting for stream...');
   }
 
+  // A new broadcaster process is taking over (zero-downtime upgrade).
+  // The old connection is about to die; ignore its state changes and keep
+  // the last frame until the new offer arrives.
+  void _handleBroadcasterMigrated() {
+    debugPrint('[WebRTC] Broadcaster migrated, waiting for new offer');
+    _peerConnection?.onIceConnectionState = null;
+    _peerConnection?.onConnectionState = null;
+  }
+
+  // Ask the broadcaster for an ICE restart offer, keeping the peer connection
+  void _requestIceRestart(String reason) {
+    if (_iceRestartTimer != null || _broadcasterId == null) return;
+
+    debugPrint('[WebRTC] $reason - requesting ICE restart');
+    _updateState(StreamState.connecting, 'Reconnecting...');
+    _send({
+      'type': 'ice-restart-request',
+      'to': _broadcasterId,
+    });
+
+    _iceRestartTimer = Timer(_iceRestartTimeout, () {
+      _iceRestartTimer = null;
+      debugPrint('[WebRTC] ICE restart timed out');
+      _updateState(StreamState.failed, reason);
+    });
+  }
+
+  void _cancelIceRestart() {
+    _iceRestartTimer?.cancel();
+    _iceRestartTimer = null;
+  }
+
+  // Re-offer with new ICE credentials on the existing connection
+  Future<void> _handleIceRestartOffer(Map<String, dynamic> data) async {
+    debugPrint('[WebRTC] Handling ICE restart offer');
+    try {
+      final offer = RTCSessionDescription(data['sdp'] as String, 'offer');
+      await _peerConnection!.setRemoteDescription(offer);
+      final answer = await _peerConnection!.createAnswer();
+      await _peerConnection!.setLocalDescription(answer);
+
+      _send({
+        'type': 'answer',
+        'to': _broadcasterId,
+        'sdp': answer.sdp,
+      });
+      debugPrint('[WebRTC] ICE restart answer sent');
+    } catch (e) {
+      debugPrint('[WebRTC] Failed to handle ICE restart offer: $e');
+      _cancelIceRestart();
+      _updateState(StreamState.failed, 'Reconnect failed: $e');
+    }
+  }
+
   void _handleError(Map<String, dynamic> data) {
     final message = data['message'] as String? ?? 'Unknown error';
     debugPrint('[WebRTC] Server error: $message');
@@ -490,17 +559,16 @@ class WebRTCService extends ChangeNotifier {
         case RTCIceConnectionState.RTCIceConnectionStateConnected:
         case RTCIceConnectionState.RTCIceConnectionStateCompleted:
           debugPrint('[WebRTC] *** ICE CONNECTED ***');
+          _cancelIceRestart();
           _updateState(StreamState.connected, 'Connected');
           break;
         case RTCIceConnectionState.RTCIceConnectionStateFailed:
           debugPrint('[WebRTC] *** ICE FAILED ***');
-          _updateState(StreamState.failed, 'Connection failed');
+          _requestIceRestart('Connection failed');
           break;
         case RTCIceConnectionState.RTCIceConnectionStateDisconnected:
           debugPrint('[WebRTC] *** ICE DISCONNECTED ***');
-          if (_connectionState == StreamState.connected) {
-            _updateState(StreamState.disconnected, 'Disconnected');
-          }
+          _requestIceRestart('Disconnected');
           break;
         case RTCIceConnectionState.RTCIceConnectionStateChecking:
           debugPrint('[WebRTC] *** ICE CHECKING ***');
@@ -522,7 +590,7 @@ class WebRTCService extends ChangeNotifier {
     _peerConnection!.onConnectionState = (RTCPeerConnectionState state) {
       debugPrint('[WebRTC] >>> Peer Connection State: $state');
       if (state == RTCPeerConnectionState.RTCPeerConnectionStateFailed) {
-        _updateState(StreamState.failed, 'Peer connection failed');
+        _requestIceRestart('Peer connection failed');
       }
     };
 
@@ -856,6 +924,7 @@ class WebRTCService extends ChangeNotifier {
 
     // Stop diagnostics timer
     _stopDiagnosticsTimer();
+    _cancelIceRestart();
 
     // Cancel WebSocket subscription first
     await _channelSubscription?.cancel();
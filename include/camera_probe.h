@@ -0,0 +1,94 @@
+#ifndef CAMERA_PROBE_H
+#define CAMERA_PROBE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/**
+ * CameraProbe - Capture mode discovery and selection for V4L2 and libcamera cameras
+ *
+ * Enumerates what a camera can deliver (V4L2: pixel format x size x frame
+ * rate; libcamera: sensor modes incl. binned/cropped ones) and picks the mode
+ * that needs the least conversion and scaling for the output profile.
+ *
+ * Many UVC cameras encode H.264 or MJPEG on-board. Capturing those instead of
+ * raw YUYV saves the Pi a full x264 encode (H.264) or most of the USB
+ * bandwidth (raw 720p30 doesn't fit USB 2.0).
+ *
+ * Mode lists are cached per device in a JSON file (see setCacheFile), so
+ * later starts skip the enumeration - rpicam-hello --list-cameras alone
+ * takes seconds. V4L2 entries are keyed by card name and bus, so a
+ * different camera on the same /dev/videoN is re-probed; the libcamera
+ * entry has to be deleted (or the cache disabled) after swapping CSI cameras.
+ *
+ * V4L2 ioctls run on our own file descriptor, so controls can be used while
+ * v4l2src has the device open.
+ */
+class CameraProbe {
+public:
+    struct Mode {
+        std::string format;     // V4L2 fourcc ("YUYV", "MJPG", "H264") or sensor format ("SRGGB10_CSI2P")
+        int width = 0;
+        int height = 0;
+        double max_fps = 0;
+        bool compressed = false;
+        int crop_width = 0;     // Sensor modes: area of the sensor read out (field of view)
+        int crop_height = 0;
+    };
+
+    struct Selection {
+        bool found = false;
+        Mode mode;
+        int fps = 0;            // Rate to request - the profile's, or the best the mode can do
+        bool h264 = false;      // Camera-encoded H.264
+        bool jpeg = false;      // Needs a JPEG decode
+        bool convert = false;   // Pixel format differs from what the encoder takes (I420/NV12)
+        bool scale = false;     // Size differs from the profile
+        std::string reason;     // Why this mode, for the log
+    };
+
+    // All modes of a V4L2 capture device (cached)
+    static std::vector<Mode> listModes(const std::string& device);
+
+    // Sensor modes of the first libcamera camera (cached)
+    static std::vector<Mode> listSensorModes();
+
+    // Best V4L2 mode for width x height at fps. allow_h264 = camera H.264 is
+    // usable; only_format restricts the choice to "H264", "MJPG" or "raw".
+    static Selection selectMode(const std::string& device, int width, int height, int fps, bool allow_h264,
+                                const std::string& only_format = "");
+
+    // Sensor mode libcamera should use for width x height at fps. The ISP
+    // scales to the output size for free, so this mostly decides frame rate
+    // and field of view; the result is reported, libcamera applies it.
+    static Selection selectSensorMode(int width, int height, int fps);
+
+    // GStreamer chain from v4l2src to raw video at width x height (decoding,
+    // scaling and converting only where the selected mode needs it)
+    static std::string rawSourceChain(const std::string& device, const Selection& selection,
+                                      int width, int height);
+
+    // Mode cache location; empty disables it. Default:
+    // $XDG_CACHE_HOME (or ~/.cache)/webrtc_streamer/camera_modes.json
+    static void setCacheFile(const std::string& path);
+
+    // Ask an on-board H.264 encoder for an IDR now. False if the camera has no such control.
+    static bool forceKeyframe(const std::string& device);
+
+    // Set an on-board H.264 encoder's IDR period in frames. False if unsupported.
+    static bool setKeyframeInterval(const std::string& device, int frames);
+
+private:
+    static std::string fourccName(uint32_t fourcc);
+    static double maxFps(int fd, uint32_t pixelformat, int width, int height);
+    static std::vector<Mode> enumerateV4l2(int fd);
+    static std::vector<Mode> enumerateSensor();
+    static bool setControl(const std::string& device, uint32_t id, int32_t value);
+
+    // Cache (file-backed, loaded on first use)
+    static bool cacheLookup(const std::string& key, std::vector<Mode>& modes);
+    static void cacheStore(const std::string& key, const std::vector<Mode>& modes);
+};
+
+#endif // CAMERA_PROBE_H
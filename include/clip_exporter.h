@@ -0,0 +1,90 @@
+#ifndef CLIP_EXPORTER_H
+#define CLIP_EXPORTER_H
+
+#include <gst/gst.h>
+#include <string>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include "dvr_ring.h"
+
+/**
+ * ClipExporter - Event clips (pre-roll + post-roll) from the encoded ring
+ *
+ * A trigger writes the packets from pre_seconds before the event to
+ * post_seconds after it into an MP4 file (WebM for VP8). The file starts
+ * at a keyframe at or before the pre-roll point. The packets are the ones
+ * viewers got, depayloaded and muxed, with no second encode.
+ *
+ * Every clip has its own thread and a small muxing pipeline that is
+ * separate from the live one. The thread reads the ring like a time-shifted
+ * viewer, catching up on the pre-roll as fast as the muxer allows and then
+ * following live packets until the post-roll ends. Clips can overlap. The
+ * muxer input is bounded and a slow disk only slows that clip's reader;
+ * the ring keeps taking packets from the tees regardless. A reader
+ * overtaken by eviction skips to the next keyframe.
+ *
+ * Files are written as <name>.part and renamed when complete.
+ */
+class ClipExporter {
+public:
+    struct Config {
+        std::string dir;
+        int pre_seconds = 10;
+        int post_seconds = 20;
+        int max_concurrent = 3;
+    };
+
+    // (clip name, final path or "" on failure)
+    using Done = std::function<void(const std::string&, const std::string&)>;
+
+    ClipExporter(DvrRing& ring, const Config& config);
+    ~ClipExporter();
+
+    // Start a clip around now. video_caps/audio_caps are the tees' RTP caps;
+    // video_depay the depayloader/parser chain for them (e.g.
+    // "rtph264depay ! h264parse"). Returns the clip name, or "" if too
+    // many clips are being written already.
+    std::string trigger(const std::string& reason, GstCaps* video_caps, GstCaps* audio_caps,
+                        const std::string& video_depay, bool webm, Done done);
+
+    const Config& config() const { return config_; }
+
+private:
+    struct Clip {
+        std::string name;
+        std::string path;
+        gint64 event_us = 0;
+        std::string description;    // gst_parse_launch description of the muxing pipeline
+        GstCaps* video_caps = nullptr;
+        GstCaps* audio_caps = nullptr;
+        Done done;
+        std::thread thread;
+        std::atomic<bool> finished{false};
+
+        // While muxing; the destructor sets it to NULL to unblock push-buffer
+        std::mutex pipeline_mutex;
+        GstElement* pipeline = nullptr;
+    };
+
+    void run(Clip* clip);
+    bool writeClip(Clip* clip);
+    void reapFinished();            // Caller holds mutex_
+
+    DvrRing& ring_;
+    const Config config_;
+
+    std::mutex mutex_;
+    std::list<Clip> clips_;
+    std::atomic<bool> stop_;
+
+    // Muxer input bound per stream (appsrc blocks the clip thread beyond it)
+    static constexpr guint64 APPSRC_MAX_BYTES = 2 * 1024 * 1024;
+    // How long a clip waits for live packets before giving up on the post-roll
+    static constexpr int STALL_TIMEOUT_MS = 5000;
+    static constexpr int FINALIZE_TIMEOUT_MS = 10000;
+};
+
+#endif // CLIP_EXPORTER_H
@@ -0,0 +1,163 @@
+#ifndef DVR_RING_H
+#define DVR_RING_H
+
+#include <gst/gst.h>
+#include <string>
+#include <deque>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * DvrRing - The last few minutes of encoded media, indexed by keyframe
+ *
+ * Holds the RTP packets leaving the shared payloaders (video_tee/audio_tee)
+ * in arrival order as buffer references - nothing is copied or re-encoded.
+ * Packets older than the memory window, or beyond the byte budget, are
+ * evicted a GOP at a time. With a spill directory, evicted GOPs are written
+ * to disk (one file per GOP, by a writer thread) and stay readable for the
+ * spill window.
+ *
+ * Every packet has an absolute index. Readers start at a keyframe and walk
+ * forward by index: through spilled GOPs, into memory, and on to packets
+ * that haven't arrived yet. push() runs on streaming threads and never
+ * touches the disk.
+ */
+class DvrRing {
+public:
+    struct Packet {
+        GstBuffer* buffer = nullptr;    // Reference owned by the holder
+        gint64 arrival_us = 0;          // g_get_monotonic_time() at the tee
+        bool video = false;
+        bool keyframe = false;          // First packet of a video keyframe
+    };
+
+    struct Reader {
+        int64_t next = -1;              // Index of the next packet to read
+        int64_t spill_start = -1;       // Spilled GOP loaded into spill
+        std::vector<Packet> spill;
+
+        Reader() = default;
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+        ~Reader();
+    };
+
+    enum class ReadResult {
+        Ok,         // packet filled in
+        Timeout,    // At the head - nothing new within the timeout
+        Gone        // The packet was evicted (reader fell behind the ring)
+    };
+
+    DvrRing(int memory_seconds, size_t max_bytes);
+    ~DvrRing();
+
+    // Keep evicted GOPs on disk for another seconds. Call before the first push().
+    void setSpill(const std::string& dir, int seconds);
+
+    // Append a packet (takes a new reference)
+    void push(GstBuffer* buffer, bool video, bool keyframe);
+
+    // Position reader at the latest keyframe at or before at_us, or the
+    // oldest one if at_us is older than the ring. False if there's none.
+    bool seek(Reader& reader, gint64 at_us);
+
+    // Next packet for reader; waits up to timeout_ms at the head
+    ReadResult read(Reader& reader, Packet& packet, int timeout_ms);
+
+    // Arrival time of the oldest packet still readable (0 if empty)
+    gint64 oldestUs();
+
+    // Wake readers blocked in read() (e.g. before stopping them)
+    void wake();
+
+    int memorySeconds() const { return memory_seconds_; }
+
+private:
+    struct SpillGop {
+        int64_t start = 0;              // Index of the first packet
+        int64_t count = 0;
+        gint64 first_us = 0;
+        bool keyframe = false;          // Starts with a keyframe (seekable)
+        std::string path;
+        std::vector<Packet> pending;    // Not written yet
+    };
+
+    void evictGop();                    // Caller holds mutex_
+    void spillLoop();
+    bool writeGop(const SpillGop& gop);
+    static bool loadGop(const std::string& path, std::vector<Packet>& packets);
+    static void releasePackets(std::vector<Packet>& packets);
+
+    const int memory_seconds_;
+    const size_t max_bytes_;
+
+    std::mutex mutex_;
+    std::condition_variable arrived_;
+    std::deque<Packet> packets_;
+    int64_t base_index_;                // Index of packets_.front()
+    size_t bytes_;
+    std::map<int64_t, gint64> keyframes_;   // In-memory keyframe index -> arrival
+
+    // Spill (guarded by mutex_)
+    std::string spill_dir_;
+    int spill_seconds_;
+    std::map<int64_t, SpillGop> spilled_;   // start index -> GOP (written or pending)
+    std::deque<int64_t> spill_queue_;       // Pending GOPs, oldest first
+    std::condition_variable spill_cv_;
+    std::thread spill_thread_;
+    bool spill_stop_;
+
+    static constexpr size_t MAX_SPILL_QUEUE = 32;   // GOPs waiting for the disk
+};
+
+/**
+ * DvrPlayback - Plays a DvrRing from a point in time on its own thread
+ *
+ * Packets are handed to deliver at their original spacing divided by
+ * speed. Audio is skipped while faster than 1x. When playback reaches the
+ * ring head it drops to 1x and follows live packets as they arrive
+ * (caughtUp() turns true). A reader overtaken by eviction jumps forward to
+ * the oldest keyframe still held.
+ */
+class DvrPlayback {
+public:
+    // Takes the buffer reference. rebase: timestamps stop being continuous
+    // with the previous packet (start, speed change or a jump).
+    using Deliver = std::function<void(GstBuffer* buffer, bool video, double speed, bool rebase)>;
+
+    DvrPlayback(DvrRing& ring, Deliver deliver);
+    ~DvrPlayback();
+
+    // Start at the keyframe at or before from_us. False if the ring is empty.
+    bool start(gint64 from_us, double speed);
+    void stop();
+
+    bool caughtUp() const { return caught_up_; }
+
+    // How far behind live the last delivered packet was
+    double behindSeconds() const { return behind_us_ / 1e6; }
+
+private:
+    void run();
+
+    DvrRing& ring_;
+    Deliver deliver_;
+    DvrRing::Reader reader_;
+    double speed_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_;
+    std::atomic<bool> caught_up_;
+    std::atomic<gint64> behind_us_;
+
+    static constexpr int FOLLOW_WAIT_MS = 100;
+};
+
+#endif // DVR_RING_H
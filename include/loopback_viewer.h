@@ -0,0 +1,92 @@
+#ifndef LOOPBACK_VIEWER_H
+#define LOOPBACK_VIEWER_H
+
+#include <gst/gst.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include "shared_media_pipeline.h"
+#include "net_impairment.h"
+
+/**
+ * LoopbackViewer - A synthetic viewer inside the streamer process
+ *
+ * Test-only. A receiving webrtcbin in its own pipeline joins the shared
+ * pipeline like a browser would: a real WebRTCPeer, with the offer, answer
+ * and candidates handed over directly instead of through the signaling
+ * server. The media crosses ICE/DTLS/SRTP on the loopback interface.
+ * When given a script, the peer's video first goes through a NetImpairment.
+ *
+ * It measures what a viewer gets:
+ *   - frame rate: frames out of its decoder
+ *   - freezes: a frame later than max(3 x the recent average frame
+ *     interval, average + 150ms), the same rule browsers use for
+ *     freezeCount/totalFreezesDuration
+ *   - latency: from the abs-capture-time stamp to the packet leaving the
+ *     receiver's jitter buffer (same host, so the clocks agree)
+ */
+class LoopbackViewer {
+public:
+    LoopbackViewer(SharedMediaPipeline& pipeline, const std::string& viewer_id,
+                   const std::vector<NetImpairment::Step>& impairment, guint32 seed);
+    ~LoopbackViewer();
+
+    // Join the shared pipeline and negotiate with our peer
+    bool start();
+
+    // Leave and log the totals for the whole run
+    void stop();
+
+    // The pipeline reclaimed our peer (it is already gone)
+    void peerGone();
+
+    // Log and export what was received since the last report
+    void report();
+
+    const std::string& viewerId() const { return viewer_id_; }
+
+private:
+    struct Stats {
+        guint64 frames = 0;
+        guint64 packets = 0;
+        guint64 freezes = 0;
+        double freeze_ms = 0;
+        std::vector<double> latency_ms;
+        gint64 started_us = 0;
+    };
+
+    SharedMediaPipeline& shared_pipeline_;
+    const std::string viewer_id_;
+    const std::vector<NetImpairment::Step> impairment_;
+    const guint32 seed_;
+
+    std::mutex mutex_;              // Guards peer_
+    WebRTCPeer* peer_;              // Owned by the shared pipeline
+    GstElement* pipeline_;          // Our receiving pipeline (owned)
+    GstElement* webrtcbin_;
+
+    std::mutex stats_mutex_;
+    Stats window_;                  // Since the last report()
+    Stats total_;
+    gint64 first_frame_us_;         // 0 = none yet
+    gint64 last_frame_us_;
+    std::deque<gint64> frame_intervals_us_;     // Recent, for the freeze threshold
+
+    void onOffer(const std::string& sdp);
+    static void onAnswerCreated(GstPromise* promise, gpointer user_data);
+    static void onIceCandidate(GstElement* webrtcbin, guint mline_index, gchar* candidate, gpointer user_data);
+    static void onPadAdded(GstElement* element, GstPad* pad, gpointer user_data);
+    static void onDecodedPadAdded(GstElement* decodebin, GstPad* pad, gpointer user_data);
+    static GstPadProbeReturn packetProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data);
+    static GstPadProbeReturn frameProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data);
+
+    // Add a fakesink to our pipeline and link pad to it
+    GstElement* addSink(GstPad* pad);
+    void logStats(const char* label, Stats& stats, double seconds);
+
+    static constexpr size_t FREEZE_AVERAGE_FRAMES = 30;
+    static constexpr size_t MAX_LATENCY_SAMPLES = 100000;  // Per run
+};
+
+#endif // LOOPBACK_VIEWER_H
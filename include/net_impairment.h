@@ -0,0 +1,119 @@
+#ifndef NET_IMPAIRMENT_H
+#define NET_IMPAIRMENT_H
+
+#include <gst/gst.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <random>
+
+/**
+ * NetImpairment - A bad network between a viewer's video queue and its webrtcbin
+ *
+ * Test-only. A probe on the queue's src pad takes every RTP packet. It
+ * decides whether the packet is lost, queues it at a bottleneck of the
+ * current rate, and adds the current delay and jitter. When they are due,
+ * the survivors are chained from our own thread straight into the pad
+ * the queue feeds. Probes added to the src pad before ours see each packet
+ * once, as it leaves the queue. The sink pad's stream lock keeps our
+ * packets in order with the events the queue sends. So NACKs, FEC, the
+ * pacer and keyframe requests all see the same loss and delay a real
+ * link would give them.
+ *
+ * Settings follow a script of timed steps, e.g.
+ *
+ *     0  delay=40 jitter=10
+ *     10 loss=3 burst=4
+ *     20 rate=1500 buffer=80
+ *     30 loss=0 rate=0
+ *     40 repeat
+ *
+ * Each step is "<seconds since attach> key=value ..." and changes only the
+ * keys it names. Steps are separated by newlines or ';', and '#' starts a
+ * comment. "<seconds> repeat" starts the script over. Keys:
+ *
+ *     loss    average packet loss, percent
+ *     burst   mean length of a loss burst in packets (1 = independent losses)
+ *     delay   one-way delay, ms
+ *     jitter  delay varies by up to +-jitter ms
+ *     reorder 1 = jittered packets may overtake each other (default 0)
+ *     rate    bottleneck rate in kbit/s (0 = none)
+ *     buffer  bottleneck queue in ms at that rate; a packet that finds it
+ *             full is dropped (drop-tail, default 50)
+ *
+ * Only the media direction is impaired; RTCP from the viewer and audio
+ * are not. Loss and jitter draw from their own seeded generators, so one
+ * seed and script drop the same packets (by position in the stream) on
+ * every run.
+ */
+class NetImpairment {
+public:
+    struct Settings {
+        double loss_percent = 0;
+        double burst_packets = 1;
+        int delay_ms = 0;
+        int jitter_ms = 0;
+        bool reorder = false;
+        int rate_kbps = 0;
+        int buffer_ms = 50;
+    };
+
+    struct Step {
+        int at_ms = 0;
+        bool repeat = false;        // Start over from the first step
+        Settings settings;          // In effect from at_ms (earlier steps applied)
+    };
+
+    // Parse a script as above. On failure returns false with a message in error.
+    static bool parseScript(const std::string& text, std::vector<Step>& steps, std::string& error);
+
+    // One line describing a script, for logs and the startup banner
+    static std::string describe(const std::vector<Step>& steps);
+
+    NetImpairment(const std::vector<Step>& steps, guint32 seed);
+    ~NetImpairment();
+
+    // Impair everything leaving src_pad (which must be linked) from now on
+    void attach(GstPad* src_pad);
+
+    // Remove the probe and stop the release thread; packets still held are dropped
+    void detach();
+
+private:
+    const std::vector<Step> steps_;
+    std::mt19937 loss_random_;
+    std::mt19937 jitter_random_;
+
+    GstPad* pad_;                   // Ref held while attached
+    GstPad* peer_pad_;              // Where released packets go (ref held while attached)
+    gulong probe_id_;
+    gint64 attached_us_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::multimap<gint64, GstBuffer*> held_;    // By release time; equal times keep order
+    gint64 link_free_us_;                       // Bottleneck busy until then
+    gint64 last_release_us_;
+    bool bad_state_;                            // Burst loss: inside a burst
+    bool stop_;
+    std::thread release_thread_;
+
+    guint64 lost_;                  // Not yet flushed to StreamMetrics
+    guint64 queue_drops_;
+    guint64 delivered_;
+
+    static GstPadProbeReturn impairProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data);
+    const Settings& currentSettings(gint64 now_us) const;
+    // Caller holds mutex_; takes ownership of packet
+    void submit(GstBuffer* packet, gint64 now_us);
+    bool isLost(const Settings& settings);
+    void releaseLoop();
+    void flushMetrics();
+
+    static constexpr guint64 METRICS_FLUSH_PACKETS = 256;
+};
+
+#endif // NET_IMPAIRMENT_H
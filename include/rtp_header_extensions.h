@@ -0,0 +1,34 @@
+#ifndef RTP_HEADER_EXTENSIONS_H
+#define RTP_HEADER_EXTENSIONS_H
+
+#include <gst/gst.h>
+
+/**
+ * RTP header extensions written by the shared payloaders
+ *
+ * Added to rtph264pay/rtpopuspay with the "add-extension" action signal, so
+ * every packet is stamped once for all viewers. The payloader puts the
+ * extmap into its caps and webrtcbin copies it into each viewer's offer;
+ * browsers that don't understand an extension just drop it from the answer.
+ *
+ * Requires GStreamer 1.20 (GstRTPHeaderExtension); on older versions the
+ * factories return nullptr. The factories return a full reference - unref it
+ * after "add-extension".
+ */
+
+#define PLAYOUT_DELAY_URI "http://www.webrtc.org/experiments/rtp-hdrext/playout-delay"
+#define ABS_CAPTURE_TIME_URI "http://www.webrtc.org/experiments/rtp-hdrext/abs-capture-time"
+
+// One-byte header IDs used in our offers (1-14)
+#define PLAYOUT_DELAY_EXT_ID 5
+#define ABS_CAPTURE_TIME_EXT_ID 6
+
+// playout-delay: tells the receiver the min/max delay its jitter buffer may
+// add (10ms granularity, 0-40950ms). min=max=0 means render on arrival.
+GstElement* playout_delay_ext_new(guint min_ms, guint max_ms);
+
+// abs-capture-time: NTP wall-clock time the frame was captured, written on
+// the first packet of each frame. pipeline supplies clock and base time.
+GstElement* abs_capture_time_ext_new(GstElement* pipeline);
+
+#endif // RTP_HEADER_EXTENSIONS_H
@@ -0,0 +1,50 @@
+#ifndef RTP_HISTORY_H
+#define RTP_HISTORY_H
+
+#include <gst/gst.h>
+#include <vector>
+#include <mutex>
+
+/**
+ * RtpHistory - Recently sent video packets, shared by every viewer
+ *
+ * Every viewer gets the same RTP packets from the video tee, so one history
+ * can answer all of their NACKs. It holds a ref to each packet for window_ms
+ * (the packets themselves are the ones the tee already handed out, so
+ * nothing is copied) and numbers them with a 64-bit index that is stamped
+ * into the buffer's offset field. Each WebRTCPeer maps the sequence numbers
+ * its viewer saw (which layer dropping and time-shift may have renumbered)
+ * back to that index.
+ */
+class RtpHistory {
+public:
+    RtpHistory(int window_ms, size_t max_packets);
+    ~RtpHistory();
+
+    // Streaming thread: stamp the packet's index (>= 1) into its offset and
+    // keep a ref. The packet must be writable.
+    guint64 add(GstBuffer* packet);
+
+    // A ref to the packet with this index, or nullptr once it left the window
+    GstBuffer* get(guint64 index);
+
+    int windowMs() const { return window_ms_; }
+
+private:
+    struct Entry {
+        guint64 index = 0;
+        gint64 added_us = 0;
+        GstBuffer* packet = nullptr;
+    };
+
+    void release(Entry& entry);
+
+    const int window_ms_;
+    std::mutex mutex_;
+    std::vector<Entry> entries_;    // Ring, slot = index % size
+    guint64 next_index_;
+    guint64 oldest_index_;          // Oldest index still held
+    size_t bytes_;
+};
+
+#endif // RTP_HISTORY_H
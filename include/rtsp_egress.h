@@ -0,0 +1,99 @@
+#ifndef RTSP_EGRESS_H
+#define RTSP_EGRESS_H
+
+#include <gst/gst.h>
+#include <gst/rtsp-server/rtsp-server.h>
+#include <string>
+#include <list>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include "tee_tap.h"
+
+/**
+ * RtspEgress - RTSP server for NVRs, fed by the shared encoder
+ *
+ * Serves rtsp://<host>:<port><path> over interleaved TCP and/or UDP. The
+ * stream comes from the same tees as the WebRTC viewers, so the camera is
+ * opened and encoded once. A TeeTap on each of video_tee/audio_tee copies
+ * the outgoing RTP to every client.
+ *
+ * Each client gets its own media pipeline:
+ *   appsrc ! depay ! [parse !] pay name=pay0   (video, same codec)
+ *   appsrc ! rtpopusdepay ! rtpopuspay name=pay1
+ * The stream is re-payloaded but not re-encoded, so every client gets its
+ * own sequence numbers and RTP-Info. A slow client's packets are dropped
+ * once client_queue_bytes wait in its appsrc, so the tees never block. When
+ * it has drained it asks the shared keyframe arbiter for a keyframe and,
+ * like a new client, gets no video until one arrives.
+ */
+class RtspEgress {
+public:
+    struct Config {
+        int port = 0;                       // 0 = off
+        std::string path = "/stream";
+        bool tcp = true;                    // RTP interleaved on the RTSP connection
+        bool udp = true;
+        guint64 client_queue_bytes = 512 * 1024;
+        int max_clients = 8;
+    };
+
+    // video_chain: depayloader to payloader for the tee's codec, ending in
+    // "name=pay0" (e.g. "rtph264depay ! h264parse ! rtph264pay name=pay0 pt=96").
+    // keyframe_pts is the pipeline's last keyframe PTS.
+    RtspEgress(GstElement* pipeline, GstElement* video_tee, GstElement* audio_tee,
+               const std::string& video_chain, std::function<void(const std::string&)> force_keyframe,
+               const std::atomic<GstClockTime>* keyframe_pts, const Config& config);
+    ~RtspEgress();
+
+    // Add the taps and listen; retries the port until it is free (e.g. held
+    // by the process we are taking over from)
+    bool start();
+
+    const Config& config() const { return config_; }
+
+private:
+    struct Client {
+        GstRTSPMedia* media;
+        GstElement* vsrc;
+        GstElement* asrc;
+        bool dropping = false;      // Over the queue limit - waiting to drain
+        bool wait_keyframe = true;  // No video until the next keyframe starts
+        guint64 dropped = 0;
+    };
+
+    bool attach();
+    void deliver(GstBuffer* buffer, bool video);
+
+    static void onMediaConfigure(GstRTSPMediaFactory* factory, GstRTSPMedia* media, gpointer user_data);
+    static void onMediaUnprepared(GstRTSPMedia* media, gpointer user_data);
+    static gboolean onRetryAttach(gpointer user_data);
+    static void onClientConnected(GstRTSPServer* server, GstRTSPClient* client, gpointer user_data);
+    static void onClientClosed(GstRTSPClient* client, gpointer user_data);
+    static GstRTSPStatusCode onPreDescribe(GstRTSPClient* client, GstRTSPContext* ctx, gpointer user_data);
+    static GstRTSPFilterResult removeClient(GstRTSPServer* server, GstRTSPClient* client, gpointer user_data);
+
+    GstElement* pipeline_;
+    GstElement* video_tee_;
+    GstElement* audio_tee_;
+    std::function<void(const std::string&)> force_keyframe_;
+    const std::atomic<GstClockTime>* keyframe_pts_;
+    const Config config_;
+
+    GstRTSPServer* server_;
+    GstRTSPMediaFactory* factory_;
+    guint server_source_id_;
+    guint retry_source_id_;
+    std::unique_ptr<TeeTap> video_tap_;
+    std::unique_ptr<TeeTap> audio_tap_;
+
+    std::mutex mutex_;
+    std::list<Client> clients_;     // Media being fed
+    GstClockTime last_video_pts_;   // Finds the first packet of each frame
+    int connections_;               // RTSP connections, for max_clients
+
+    static constexpr int ATTACH_RETRY_MS = 1000;
+};
+
+#endif // RTSP_EGRESS_H
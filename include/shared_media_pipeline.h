@@ -2,12 +2,27 @@
 #define SHARED_MEDIA_PIPELINE_H
 
 #include <gst/gst.h>
+#include <gst/sdp/sdp.h>
 #include <string>
 #include <map>
 #include <mutex>
 #include <functional>
 #include <vector>
 #include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <set>
+#include <memory>
+#include "turn_selector.h"
+#include "dvr_ring.h"
+#include "clip_exporter.h"
+#include "rtsp_egress.h"
+#include "srt_output.h"
+#include "shm_stream_writer.h"
+#include "snapshot_service.h"
+#include "rtp_history.h"
+#include "net_impairment.h"
 
 // Forward declaration
 class WebRTCPeer;
@@ -20,6 +35,21 @@ public:
         USB     // USB Webcam - uses v4l2src
     };
 
+    // What to capture from a USB (V4L2) camera
+    enum class UsbFormat {
+        Auto,   // Camera H.264 if usable, else MJPEG, else raw
+        H264,   // Camera-encoded H.264, passed through without re-encoding
+        MJPEG,  // MJPEG, decoded on the Pi (hardware decoder if present)
+        Raw     // Uncompressed (YUYV etc.) - the old behaviour
+    };
+
+    // Video codecs the shared pipeline can encode
+    enum class VideoCodec {
+        H264,   // x264, single layer
+        VP8,    // vp8enc, three temporal layers (L1T3) - slow viewers can drop layers
+        H265    // x265
+    };
+
     SharedMediaPipeline();
     ~SharedMediaPipeline();
 
@@ -35,10 +65,131 @@ public:
     void stop();
 
     // Add a new viewer - returns a WebRTCPeer that handles the WebRTC connection
-    WebRTCPeer* addViewer(const std::string& viewer_id);
+    // With resume=true a peer parked by the same client_id is reused; *reused is
+    // then set and the caller must renegotiate with restartIce(), not createOffer()
+    // network is the viewer's network key, used to rank TURN relays
+    WebRTCPeer* addViewer(const std::string& viewer_id,
+                          const std::string& client_id = "",
+                          const std::string& network = "",
+                          bool resume = false,
+                          bool* reused = nullptr);
 
     // Remove a viewer
-    void removeViewer(const std::string& viewer_id);
+    // With allow_park=true a healthy peer is parked in the warm cache instead
+    // of being torn down, so the same client can rejoin without a rebuild
+    void removeViewer(const std::string& viewer_id, bool allow_park = false);
+
+    // Warm cache limits (call before start(); max_peers = 0 disables the cache)
+    static void setWarmCache(int ttl_seconds, size_t max_peers);
+
+    // Ask receivers to keep their video jitter buffer between min_ms and max_ms
+    // via the playout-delay header extension (call before initialize())
+    static void setPlayoutDelay(int min_ms, int max_ms);
+
+    // Periodic intra refresh: a column of intra blocks sweeps the picture over
+    // keyframe_interval frames instead of a full IDR every keyframe_interval
+    // frames. Keeps frame sizes flat; x264 marks each sweep with a
+    // recovery-point SEI (call before initialize())
+    static void setVideoEncoding(bool intra_refresh, int keyframe_interval);
+
+    // Low-latency slices: x264 splits each frame into slices that each fit one
+    // RTP packet for the given path MTU, encoded in parallel (sliced threads),
+    // and the payloader MTU is set to match (call before initialize())
+    static void setSliceEncoding(bool enabled, int path_mtu);
+
+    // USB camera capture format (call before initialize()). With H.264
+    // pass-through x264 is skipped entirely and keyframe requests go to the
+    // camera's V4L2 controls; it needs VIDEO_CODEC=h264 and no intra
+    // refresh or slices.
+    static void setUsbCaptureFormat(UsbFormat format);
+
+    // Capture stall watchdog (call before initialize()). When no video has
+    // reached the tee for stall_ms, only the camera source is restarted (with
+    // backoff) while a black slate is encoded in its place; the encoder, tees
+    // and viewers keep running. 0 disables it.
+    static void setStallWatchdog(int stall_ms);
+
+    // Output size and frame rate (call before initialize(), default 1280x720@30).
+    // The camera mode is chosen to need the least conversion and scaling for it.
+    static void setOutputProfile(int width, int height, int fps);
+
+    // DVR ring (call before initialize(); memory_seconds = 0 disables it).
+    // Keeps the last memory_seconds (at most max_mb) of the primary codec and
+    // audio as sent, for time-shifted viewing. With a spill_dir, another
+    // spill_seconds go to disk instead of being dropped.
+    static void setDvr(int memory_seconds, int max_mb, const std::string& spill_dir, int spill_seconds);
+
+    // Event clips (call before initialize(); empty dir disables them): each
+    // trigger writes pre_seconds before to post_seconds after the event from
+    // the encoded ring, at most max_concurrent at a time. The ring is kept
+    // for the pre-roll even without a DVR.
+    static void setClipExport(const std::string& dir, int pre_seconds, int post_seconds, int max_concurrent);
+
+    // RTSP egress for NVRs (call before initialize(); port 0 disables it):
+    // serves the tees' stream at rtsp://host:port/path without re-encoding
+    static void setRtspServer(int port, const std::string& path, bool tcp, bool udp,
+                              int client_queue_kb, int max_clients);
+
+    // SRT contribution output (call before initialize(); empty uri disables
+    // it): MPEG-TS of the tees' stream to one SRT endpoint, H.264/H.265 only
+    static void setSrtOutput(const std::string& uri, int latency_ms, const std::string& passphrase,
+                             int buffer_kb);
+
+    // Shared-memory output for local consumers (call before initialize();
+    // empty name disables it): every encoded video access unit and Opus
+    // packet goes into a ring of size_mb at /dev/shm<name> (see shm_stream.h)
+    static void setShmOutput(const std::string& name, int size_mb);
+
+    // NACK retransmission (call before initialize(); 0 disables it): the
+    // primary codec's packets are kept for history_ms in one history shared
+    // by every viewer, which each peer answers its viewer's NACKs from
+    static void setRetransmission(int history_ms);
+
+    // JPEG snapshots (call before initialize()): quality 1-100; a request
+    // whose keyframe is older than max_age_ms also forces a new one
+    static void setSnapshots(int quality, int max_age_ms);
+
+    // Video codecs offered to viewers, most preferred first (call before
+    // initialize()). The first one is encoded from startup. With more than one,
+    // raw video is teed and the others get an encoder branch the first time a
+    // viewer's answer picks them; idle branches are torn down again.
+    // VP8 is encoded with temporal layers 0-2 (7.5/15/30 fps) and each
+    // WebRTCPeer forwards only the layers its viewer keeps up with. x264-only
+    // options (intra refresh, slices) only apply to H.264.
+    static void setVideoCodecs(const std::vector<VideoCodec>& codecs);
+    static const std::vector<VideoCodec>& videoCodecs() { return video_codecs_; }
+    static VideoCodec videoCodec() { return video_codecs_.front(); }  // Primary
+    static const char* videoCodecName(VideoCodec codec);
+    static int videoPayloadType(VideoCodec codec);
+    static int videoBitrateKbps(VideoCodec codec);      // Encoder target
+
+    // Caps listing every offered codec, for the video transceiver's codec-preferences
+    static GstCaps* videoCodecPreferences();
+
+    // Encoded video tee for a codec, building its encoder branch on first use.
+    // Returns nullptr if the codec isn't offered or its encoder can't be built.
+    GstElement* acquireVideoTee(VideoCodec codec);
+
+    // Play a viewer's stream from seconds_ago at speed (>= 1; audio is muted
+    // while faster than live), or back to live with seconds_ago = 0. A viewer
+    // that catches up is returned to live by the reclaim thread. False without
+    // a DVR, for unknown viewers and for viewers on a secondary codec (only
+    // the primary one is recorded).
+    bool timeshiftViewer(const std::string& viewer_id, double seconds_ago, double speed = 1.0);
+
+    // Called when a viewer's time-shift changes, with how far behind live it now is (0 = live)
+    void setOnTimeshiftChanged(std::function<void(const std::string&, double)> callback);
+
+    // Start an event clip; done(name, path) is called from the clip's thread
+    // when it is written (path "" on failure). Returns the clip name, or ""
+    // if clips are off or too many are being written.
+    std::string triggerClip(const std::string& reason,
+                            std::function<void(const std::string&, const std::string&)> done);
+
+    // JPEG of the latest keyframe scaled to width (0 = encoded size), cached
+    // until the next keyframe. done(ok, jpeg, keyframe age in ms) runs on the
+    // caller's thread for cache hits, otherwise on the snapshot worker.
+    void requestSnapshot(int width, SnapshotService::Done done);
 
     // Get pipeline for debugging
     GstElement* getPipeline() const { return pipeline_; }
@@ -47,7 +198,36 @@ public:
     bool isRunning() const { return is_running_; }
 
     // Force a keyframe (called when new viewer joins)
-    void forceKeyframe();
+    // Requests are coalesced: at most one forced keyframe per
+    // KEYFRAME_MIN_INTERVAL_MS serves every join and PLI in that window.
+    // codec selects a secondary encoder branch, which has its own window.
+    void forceKeyframe(const std::string& reason = "join", VideoCodec codec = videoCodec());
+
+    // Handoff: drop the capture bin to NULL right away so the camera is free
+    // for the incoming process. Everything else keeps running, so viewers stay
+    // connected (on a frozen picture) until the handoff completes or is aborted.
+    void releaseCapture();
+
+    // Handoff aborted: open the camera again and go back to live video
+    void resumeCapture();
+
+    // Block until new video buffers reach the tee (or timeout)
+    bool waitForVideoFlow(int timeout_ms);
+
+    // Same without blocking: callback(flowing) runs on the default main
+    // context once new video reaches the tee, or with false after timeout_ms
+    void whenVideoFlows(int timeout_ms, std::function<void(bool)> callback);
+
+    // Called (from the reclaim thread) when a dead peer must be torn down.
+    // The handler is responsible for calling removeViewer(). If no handler is
+    // set the pipeline removes the viewer itself.
+    void setOnViewerReclaimed(std::function<void(const std::string&, const std::string&)> callback);
+
+    // Called (from the reclaim thread) when a peer lost connectivity and should
+    // try an ICE restart before it is reclaimed. The handler is expected to call
+    // WebRTCPeer::restartIce() and forward the offer. If no handler is set,
+    // disconnected peers are reclaimed without a restart attempt.
+    void setOnIceRestartNeeded(std::function<void(const std::string&)> callback);
 
 private:
     GstElement* pipeline_;
@@ -59,6 +239,230 @@ private:
 
     std::map<std::string, WebRTCPeer*> viewers_;
 
+    // Warm cache: peers of recently departed viewers, keyed by client id.
+    // Parked peers keep their webrtcbin (ICE/DTLS state) but get no media.
+    struct WarmPeer {
+        WebRTCPeer* peer;
+        gint64 parked_at_us;
+    };
+    std::map<std::string, WarmPeer> warm_peers_;
+
+    static int warm_cache_ttl_seconds_;
+    static size_t warm_cache_max_peers_;
+
+    // Video encoder mode
+    static bool intra_refresh_;
+    static int keyframe_interval_;
+
+    static std::vector<VideoCodec> video_codecs_;
+    static UsbFormat usb_format_;
+
+    // Output profile: size and rate encoded (and asked of the camera)
+    static int capture_width_;
+    static int capture_height_;
+    static int capture_fps_;
+
+    // USB camera: true when the camera's own H.264 feeds the payloader
+    std::string video_device_;
+    bool camera_h264_passthrough_;
+
+    // Capture bin: the camera source chain, linked into the video_select
+    // input-selector so it can be restarted on its own. While it is being
+    // restarted a slate (black videotestsrc) feeds the selector instead.
+    static int stall_timeout_ms_;
+    GstElement* capture_bin_;       // Owned by the pipeline
+    GstElement* video_selector_;
+    GstPad* capture_pad_;           // Selector sink pads (refs held)
+    GstElement* slate_bin_;         // Only while stalled; owned by the pipeline
+    GstPad* slate_pad_;
+    std::atomic<gint64> last_capture_us_;   // Last buffer out of the capture bin
+
+    std::thread watchdog_thread_;
+    std::mutex watchdog_mutex_;
+    std::condition_variable watchdog_cv_;
+    bool watchdog_stop_;
+
+    static constexpr int WATCHDOG_INTERVAL_MS = 200;
+    static constexpr int STARTUP_GRACE_MS = 5000;       // Until the first frame
+    static constexpr int RESTART_BACKOFF_MAX_MS = 10000;
+    static constexpr guint VIDEO_FLOW_POLL_MS = 5;
+
+    bool createCaptureBin(const std::string& video_source);
+    static GstPadProbeReturn captureOutputProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data);
+    bool attachSlate();
+    void detachSlate();
+    bool restartCapture();
+    void watchdogLoop();
+    void stopWatchdogThread();
+
+    // v4l2src -> caps (-> decoder/scale/convert) chain for a USB camera;
+    // selects the capture mode and sets camera_h264_passthrough_
+    std::string usbCaptureChain(const std::string& device);
+    static std::string h264PassthroughChain();
+
+    // Encoder -> payloader -> caps chain for a codec. prefix keeps element
+    // names (video_encoder, video_pay) unique across branches.
+    static std::string encodeChain(VideoCodec codec, const std::string& prefix);
+    static std::string h264EncodeChain(const std::string& prefix);
+    static std::string vp8EncodeChain(const std::string& prefix);
+    static std::string h265EncodeChain(const std::string& prefix);
+
+    // Encoder property holding the keyframe interval (key-int-max fallback)
+    static const char* keyframeIntervalProperty() {
+        return videoCodec() == VideoCodec::VP8 ? "keyframe-max-dist" : "key-int-max";
+    }
+
+    // Secondary encoder branches: raw_video_tee_ -> queue -> encoder -> pay -> tee.
+    // Each has its own keyframe arbiter; the frame metrics only cover the
+    // primary encoder.
+    struct VideoBranch {
+        GstElement* bin;            // Owned by the pipeline
+        GstElement* tee;            // Inside bin
+        GstPad* raw_pad;            // Our request pad on raw_video_tee_ (ref held)
+        gint64 last_used_us;
+    };
+    GstElement* raw_video_tee_;     // nullptr when only one codec is offered
+    std::mutex branches_mutex_;
+    std::map<VideoCodec, VideoBranch> video_branches_;
+    guint branch_serial_;           // Keeps bin names unique while an old branch is torn down
+
+    // A branch with no viewers is torn down after this long
+    static constexpr int VIDEO_BRANCH_IDLE_MS = 10000;
+
+    // Caller holds branches_mutex_ to create; a branch is destroyed once it
+    // is out of video_branches_
+    bool createVideoBranch(VideoCodec codec);
+    void destroyVideoBranch(VideoBranch& branch);
+    void removeKeyframeArbiter(VideoCodec codec);
+
+    // Called by the reclaim thread
+    void reapIdleVideoBranches();
+
+    // Slice mode
+    static bool slice_encoding_;
+    static int path_mtu_;
+
+    // Largest RTP packet that fits the path MTU after IPv6/UDP/SRTP/TURN overhead
+    static int rtpMtu() { return path_mtu_ - PACKET_OVERHEAD_BYTES; }
+
+    // IPv6 (40) + UDP (8) + SRTP auth tag (10) + TURN ChannelData (4)
+    static constexpr int PACKET_OVERHEAD_BYTES = 62;
+    // RTP header (12) + header extensions (~24) + FU/STAP slack (4)
+    static constexpr int RTP_PAYLOAD_OVERHEAD_BYTES = 40;
+
+    // First-packet-out latency: raw frame into x264 -> first RTP packet of that frame out
+    std::mutex frame_timing_mutex_;
+    std::map<GstClockTime, gint64> frame_entered_us_;  // By PTS
+    GstClockTime last_packetized_pts_;
+    static constexpr size_t FRAME_TIMING_WINDOW = 64;
+
+    static GstPadProbeReturn rawFrameProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data);
+    static GstPadProbeReturn firstPacketProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data);
+
+    // Keyframe arbiter, one per encoder: joins and viewer PLIs all end up here
+    struct KeyframeArbiter {
+        GstElement* encoder = nullptr;  // Encoder branches (ref held); the primary uses video_encoder_
+        gint64 last_forced_us = 0;      // 0 = never
+        gint64 pending_since_us = 0;    // 0 = no deferred request
+        guint timer_id = 0;
+    };
+    // Probe and timer data: the arbiter a request goes to
+    struct KeyframeTarget {
+        SharedMediaPipeline* self;
+        VideoCodec codec;
+    };
+    std::mutex keyframe_mutex_;
+    std::map<VideoCodec, KeyframeArbiter> keyframe_arbiters_;
+    std::atomic<gint64> last_keyframe_us_;  // Last keyframe out of the primary encoder (forced or periodic)
+
+    static constexpr int KEYFRAME_MIN_INTERVAL_MS = 1000;
+    // x264 VBV buffer in intra refresh mode - bounds any single frame to ~3 frames' worth of bits
+    static constexpr int INTRA_REFRESH_VBV_MS = 100;
+
+    // Send force-key-unit to the codec's encoder (no coalescing). Caller holds keyframe_mutex_.
+    void sendForceKeyUnit(VideoCodec codec, const KeyframeArbiter& arbiter);
+    static gboolean onKeyframeTimer(gpointer user_data);
+
+    // Upstream force-key-unit from webrtcbin (viewer PLI/FIR) -> arbiter.
+    // On each tee's sink pad, with a KeyframeTarget.
+    static GstPadProbeReturn keyframeRequestProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data);
+    static void freeKeyframeTarget(gpointer data);
+
+    // Encoded frame sizes and keyframe tracking
+    static GstPadProbeReturn encodedFrameProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data);
+
+    // DVR ring, fed from the tee sink pads
+    static int dvr_seconds_;
+    static int dvr_max_mb_;
+    static std::string dvr_spill_dir_;
+    static int dvr_spill_seconds_;
+    std::unique_ptr<DvrRing> dvr_;
+    std::atomic<GstClockTime> last_keyframe_pts_;   // Seek points: packets with this PTS start a keyframe
+    GstClockTime dvr_video_pts_;                    // Last video PTS recorded (streaming thread only)
+    std::function<void(const std::string&, double)> on_timeshift_changed_;
+
+    // Event clips, read from dvr_
+    static ClipExporter::Config clip_config_;
+    std::unique_ptr<ClipExporter> clip_exporter_;
+    // RTSP clients, tapping the tees
+    static RtspEgress::Config rtsp_config_;
+    std::unique_ptr<RtspEgress> rtsp_egress_;
+
+    // SRT contribution feed, tapping the tees
+    static SrtOutput::Config srt_config_;
+    std::unique_ptr<SrtOutput> srt_output_;
+
+    // Local consumers, fed from the payloaders' sink pads
+    static std::string shm_name_;
+    static int shm_size_mb_;
+    std::unique_ptr<ShmStreamWriter> shm_writer_;
+    static constexpr uint32_t SHM_SLOTS = 4096;     // ~50s of video + audio units
+
+    // Sent video packets for NACKs, fed from the video tee's sink pad
+    static int rtx_history_ms_;
+    std::shared_ptr<RtpHistory> rtx_history_;
+    static constexpr size_t RTX_HISTORY_PACKETS = 4096;    // Cap at high bitrates
+
+    // Snapshots, fed keyframes from the video payloader's sink pad
+    static int snapshot_quality_;
+    static int snapshot_max_age_ms_;
+    std::unique_ptr<SnapshotService> snapshots_;
+
+    // Ring time kept beyond the pre-roll, so its GOP can start earlier
+    static constexpr int CLIP_RING_SLACK_SECONDS = 5;
+
+    static GstPadProbeReturn dvrProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data);
+    static GstPadProbeReturn shmProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data);
+    static GstPadProbeReturn rtxHistoryProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data);
+    static GstPadProbeReturn snapshotProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data);
+
+    // playout-delay bounds; min < 0 = extension not offered
+    static int playout_delay_min_ms_;
+    static int playout_delay_max_ms_;
+
+    // Stamp playout-delay/abs-capture-time on the shared payloaders
+    void addHeaderExtensions();
+    void addVideoHeaderExtensions(GstElement* video_pay);
+
+    // Take expired parked peers out of the cache, then the oldest ones until at
+    // most keep_at_most remain. Caller holds mutex_ and deletes the result.
+    std::vector<WebRTCPeer*> takeWarmPeersToEvict(gint64 now_us, size_t keep_at_most);
+
+    // Dead-peer reclamation: a worker thread periodically checks peer liveness
+    // and tears down peers that failed, stayed disconnected or went silent
+    std::thread reclaim_thread_;
+    std::mutex reclaim_mutex_;
+    std::condition_variable reclaim_cv_;
+    bool reclaim_stop_;
+    std::atomic<bool> reclaim_enabled_;
+    std::function<void(const std::string&, const std::string&)> on_viewer_reclaimed_;
+    std::function<void(const std::string&)> on_ice_restart_needed_;
+
+    static constexpr int LIVENESS_CHECK_INTERVAL_MS = 1000;
+
+    void reclaimLoop();
+    void stopReclaimThread();
+
     // Create the shared capture/encode pipeline
     bool createPipeline(const std::string& video_device,
                        const std::string& audio_device,
@@ -68,6 +472,18 @@ private:
 // WebRTC peer connection for a single viewer
 class WebRTCPeer {
 public:
+    // Why a peer was reclaimed (exported as peers.reclaimed.<name>)
+    enum class ReclaimReason {
+        None,
+        IceFailed,          // ICE connection state reached "failed"
+        ConnectionFailed,   // Peer connection state reached "failed"
+        DisconnectTimeout,  // "disconnected" for longer than the grace period
+        ConsentTimeout,     // Connected, but no RTCP from the viewer for too long
+        RemoteBye           // Viewer sent RTCP BYE
+    };
+
+    static const char* reclaimReasonName(ReclaimReason reason);
+
     // TURN server configuration
     struct TurnConfig {
         std::string uri;        // e.g., "turn:turn.example.com:3478"
@@ -75,6 +491,28 @@ public:
         std::string password;
     };
 
+    // ICE candidate gathering policy (shared by all peers)
+    struct IcePolicy {
+        enum class IpFamily {
+            Any,
+            IPv4,
+            IPv6
+        };
+        enum class StunMode {
+            Always,     // Every peer does its own STUN binding (default)
+            Cached,     // Reuse the public address learned by an earlier peer
+                        // once the NAT is known to preserve ports
+            Off         // No STUN at all - host and relay candidates only
+        };
+
+        std::vector<std::string> interface_allow;   // Glob patterns (e.g. "eth*"); empty = all
+        std::vector<std::string> interface_deny;    // Glob patterns (e.g. "docker*", "tun*")
+        IpFamily ip_family = IpFamily::Any;
+        bool relay_only = false;                    // Only gather/use TURN relay candidates
+        bool tcp_candidates = true;                 // ICE-TCP host candidates
+        StunMode stun_mode = StunMode::Always;
+    };
+
     WebRTCPeer(const std::string& viewer_id, GstElement* pipeline,
                GstElement* video_tee, GstElement* audio_tee);
     ~WebRTCPeer();
@@ -82,18 +520,59 @@ public:
     // Initialize the webrtcbin
     bool initialize();
 
+    // Several codecs offered: the video branch is attached once the answer
+    // picks a codec, using the tee this returns (set before initialize()).
+    // Without a provider the peer is linked to video_tee in initialize().
+    void setVideoTeeProvider(std::function<GstElement*(SharedMediaPipeline::VideoCodec)> provider) {
+        video_tee_provider_ = provider;
+    }
+
+    // Asks a secondary codec's encoder for the join keyframe (set with the provider)
+    void setKeyframeRequester(std::function<void(SharedMediaPipeline::VideoCodec)> requester) {
+        keyframe_requester_ = requester;
+    }
+
+    // Codec this viewer receives
+    SharedMediaPipeline::VideoCodec getVideoCodec() const { return video_codec_; }
+
+    // Answer this viewer's NACKs from the pipeline's shared packet history
+    // (set before initialize(); null = no retransmission)
+    void setRtxHistory(std::shared_ptr<RtpHistory> history) { rtx_history_ = history; }
+
+    // Test only: run this viewer's video through a simulated bad network
+    // between its queue and webrtcbin (after initialize()). The pacer and
+    // NACK history probes on the queue see each packet once, before it is
+    // impaired; FEC and RTCP see what the viewer gets. Removed in cleanup().
+    void setImpairment(std::unique_ptr<NetImpairment> impairment);
+
     // Set TURN server (must be called before initialize())
     static void setTurnServer(const TurnConfig& config);
 
+    // Add another TURN server alongside Cloudflare and any already added.
+    // All relays are offered to every peer so ICE races them.
+    static void addTurnServer(const TurnConfig& config);
+
     // Enable Cloudflare TURN (dynamic credentials)
     static void enableCloudflareTurn();
 
     // Check if using Cloudflare TURN
     static bool isUsingCloudflareTurn();
 
+    // Set ICE gathering policy (must be called before initialize())
+    static void setIcePolicy(const IcePolicy& policy);
+
     // Create offer for WebRTC negotiation
     void createOffer(std::function<void(const std::string&)> callback);
 
+    // Create an ICE restart offer on the existing webrtcbin. The branch, DTLS
+    // and SRTP state are kept; only the ICE credentials and candidates change.
+    // Returns false if the peer was never negotiated or a restart is already
+    // in flight.
+    bool restartIce(std::function<void(const std::string&)> callback);
+
+    // True while an ICE restart offer is outstanding or still reconnecting
+    bool isIceRestartPending() const { return ice_restart_pending_.load(); }
+
     // Handle remote answer
     void setRemoteAnswer(const std::string& sdp);
 
@@ -112,6 +591,73 @@ public:
     // Cleanup - unlink from tees (safe to call multiple times)
     void cleanup();
 
+    // Viewer network key from the signaling server (used to rank TURN relays)
+    void setNetworkKey(const std::string& network) { network_key_ = network; }
+
+    // Client identity supplied at join (used as the warm cache key)
+    void setClientId(const std::string& client_id) { client_id_ = client_id; }
+    const std::string& getClientId() const { return client_id_; }
+
+    // Warm cache: drop media at our tee pads without tearing anything down
+    void park();
+
+    // Warm cache: receive media again and forget the previous outage
+    void unpark();
+
+    // Connected and never failed - worth parking for a later rejoin
+    bool isReusable() const;
+
+    // Liveness check used by the reclaim thread (now_us = g_get_monotonic_time())
+    // With allow_ice_restart, failures are not reported until a restart was tried
+    ReclaimReason checkLiveness(gint64 now_us, bool allow_ice_restart) const;
+
+    // True if the peer lost connectivity and no automatic restart was tried yet
+    bool needsIceRestart(gint64 now_us) const;
+
+    // VP8 temporal layers: step this viewer down a layer while its video queue
+    // overflows, back up once it has kept up for a while. Called by the reclaim
+    // thread about once a second; no-op for H.264.
+    void adaptTemporalLayer();
+
+    // Highest temporal layer currently forwarded (0-2)
+    int getTemporalLayer() const { return max_temporal_layer_.load(); }
+
+    // ULPFEC/RED on the video m-line (call before any peer is created). Each
+    // viewer's protection level follows the loss in its receiver reports,
+    // up to max_percentage.
+    static void setFec(bool enabled, int max_percentage);
+
+    // Move this viewer to the FEC level for its current loss. Called by the
+    // reclaim thread about once a second; no-op without FEC.
+    void adaptFec();
+
+    // FEC overhead currently applied (percent of media packets, 0 = none)
+    int getFecPercentage() const { return fec_percentage_.load(); }
+
+    // Egress pacing (call before any peer is created; multiplier 0 disables
+    // it): video leaves each viewer's queue at no more than multiplier x the
+    // encoder's target bitrate, so a keyframe reaches the viewer's bottleneck
+    // spread out instead of as one burst. No packet waits longer than
+    // max_delay_ms for the pacer; queue_kb bounds the queue meanwhile.
+    static void setPacing(double multiplier, int max_delay_ms, int queue_kb);
+
+    // DVR time-shift: take the peer off the live tees and play the ring from
+    // the keyframe at or before from_us, at speed (>= 1). Calling it again
+    // seeks. Once playback reaches live it follows the ring head.
+    bool startTimeshift(DvrRing* ring, gint64 from_us, double speed);
+
+    // Back on the live tees from the next keyframe (requested via force_keyframe).
+    // keyframe_pts is the pipeline's last keyframe PTS.
+    void goLive(const std::atomic<GstClockTime>* keyframe_pts, std::function<void()> force_keyframe);
+
+    bool isTimeshifted() const { return timeshifted_.load(); }
+    bool timeshiftCaughtUp() const;
+    double timeshiftBehindSeconds() const;
+
+    // Track sequence numbers and timestamps on the live path, so a later
+    // time-shift can continue them (set before any peer is created)
+    static void setRtpRewrite(bool enabled) { rtp_rewrite_enabled_ = enabled; }
+
 private:
     std::string viewer_id_;
     GstElement* pipeline_;          // Parent pipeline (not owned)
@@ -131,6 +677,160 @@ private:
     GstElement* audio_resample_;    // Audio resampling
     GstElement* audio_sink_;        // Audio output (alsasink)
 
+    std::string client_id_;
+    std::string network_key_;
+
+    // TURN relays offered to this peer, in preference order
+    std::vector<TurnSelector::Relay> relays_;
+    bool relays_narrowed_;          // Only a learned winner and fallback were offered
+
+    // Drop probes on the tee pads while parked in the warm cache
+    gulong video_park_probe_id_;
+    gulong audio_park_probe_id_;
+    static GstPadProbeReturn parkDropProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data);
+
+    // Multi-codec attachment
+    std::function<GstElement*(SharedMediaPipeline::VideoCodec)> video_tee_provider_;
+    std::function<void(SharedMediaPipeline::VideoCodec)> keyframe_requester_;
+    SharedMediaPipeline::VideoCodec video_codec_;
+
+    // Request a pad on video_tee_ and link it to video_queue_
+    bool linkVideoTee();
+    bool attachVideo(SharedMediaPipeline::VideoCodec codec);
+
+    // First offered codec the answer accepts on its video m-line
+    static bool answerVideoCodec(const GstSDPMessage* answer, SharedMediaPipeline::VideoCodec* codec);
+
+    // Temporal layer forwarding (VP8 L1T3). Frames above forwarding_layer_ are
+    // dropped at our tee pad and later sequence numbers shifted down, so the
+    // viewer sees a gapless 15 or 7.5 fps stream (no NACKs, no PLIs).
+    gulong svc_probe_id_;
+    std::atomic<int> max_temporal_layer_;   // Target, set by adaptTemporalLayer()
+    int forwarding_layer_;                  // Applied at TL0/key frame starts (streaming thread only)
+    bool forwarding_frame_;                 // Decision for the frame in progress
+    guint16 seq_offset_;                    // Packets dropped so far, mod 2^16
+    std::atomic<guint64> svc_packets_dropped_;  // Not yet flushed to StreamMetrics
+    std::atomic<int> video_overruns_;       // Since the last adaptTemporalLayer()
+    int calm_checks_;                       // Consecutive quiet adaptTemporalLayer() calls
+
+    static GstPadProbeReturn temporalLayerProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data);
+    // false = drop; *buffer may be replaced by a writable copy with a new seqnum
+    bool filterTemporalLayer(GstBuffer** buffer);
+
+    static constexpr int MAX_TEMPORAL_LAYER = 2;
+    // Queue level (buffers) that counts as falling behind / as keeping up
+    static constexpr guint SVC_QUEUE_HIGH_BUFFERS = 20;
+    static constexpr guint SVC_QUEUE_LOW_BUFFERS = 5;
+    // Quiet checks (~1s each) before trying the next layer up
+    static constexpr int SVC_CALM_CHECKS_TO_STEP_UP = 5;
+
+    // Loss-adaptive FEC, generated by webrtcbin's ULPFEC encoder for this
+    // viewer. That encoder shifts later sequence numbers past each FEC packet
+    // and keeps the shift after FEC is turned off. While FEC is on, loss is
+    // left to FEC and PLIs. Once it has been off for a history window, every
+    // packet in the history went out with the same shift, measured across
+    // the encoder, and NACKs are mapped back through it.
+    static bool fec_enabled_;
+    static int fec_max_percentage_;
+    std::atomic<int> fec_percentage_;
+    std::atomic<gint64> fec_off_since_us_;  // When FEC last went back to 0%, 0 = never on
+    std::atomic<int> fec_seq_offset_;       // Encoder output minus input sequence number
+    std::atomic<guint32> rtx_ssrc_;         // Our video SSRC, 0 = nothing sent yet
+    guint16 fec_in_seq_;                    // Next video packet expected out of the encoder (its streaming thread only)
+    guint8 fec_in_pt_;
+    double fec_loss_;                       // Smoothed loss in percent, -1 = no report yet (reclaim thread only)
+    int fec_calm_checks_;                   // Consecutive adaptFec() calls wanting a lower level
+
+    // Highest fraction lost reported for our senders, in percent (-1 = none yet)
+    double reportedLoss() const;
+    void applyFecPercentage(int percentage);
+    static GstPadProbeReturn fecInputProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data);
+    static GstPadProbeReturn fecOutputProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data);
+
+    static constexpr int FEC_CALM_CHECKS_TO_STEP_DOWN = 5;
+
+    // Egress pacer: a token bucket on the video queue's src pad, so packets
+    // wait in the queue (queue thread only)
+    static double pacing_multiplier_;
+    static int pacing_max_delay_ms_;
+    static int pacing_queue_kb_;
+    gulong pacer_probe_id_;
+    double pacer_tokens_;           // Bytes that may go out right now
+    gint64 pacer_last_us_;
+    gint64 pacer_backlog_us_;       // Wait added since the queue was last drained
+
+    static GstPadProbeReturn pacerProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data);
+    void pace(gsize bytes);
+
+    static constexpr double PACER_BURST_BYTES = 4 * 1200;   // Sent back to back before pacing starts
+
+    // NACK retransmission. rtx_map_ remembers, per sequence number this
+    // viewer was sent, which history packet it was and the timestamp it had
+    // (layer dropping and time-shift renumber and re-time packets per viewer).
+    // Retransmissions reuse the original sequence number on the media SSRC.
+    struct RtxMapEntry {
+        guint64 index = 0;      // RtpHistory index, 0 = nothing sent
+        guint32 timestamp = 0;
+        guint16 seq = 0;
+    };
+    std::shared_ptr<RtpHistory> rtx_history_;
+    std::vector<RtxMapEntry> rtx_map_;      // Indexed by seq % RTX_MAP_SIZE
+    std::mutex rtx_mutex_;
+    gulong rtx_record_probe_id_;
+    gulong rtx_request_probe_id_;
+
+    static GstPadProbeReturn rtxRecordProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data);
+    static GstPadProbeReturn rtxRequestProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data);
+    static void onDeepElementAdded(GstBin* bin, GstBin* sub_bin, GstElement* element, gpointer user_data);
+    void recordSent(GstBuffer* buffer);
+    void retransmit(guint16 seq);
+
+    static constexpr size_t RTX_MAP_SIZE = 2048;    // Power of two; about 2s of packets at 8 Mbit/s
+
+    // Test-only network impairment on the video queue's src pad
+    std::unique_ptr<NetImpairment> impairment_;
+
+    // DVR time-shift. Ring packets are fed through our own appsrcs into the
+    // queues; both paths go through RtpRewrite, which renumbers and re-times
+    // packets so the viewer sees one continuous stream across every switch.
+    struct RtpRewrite {
+        bool active = false;            // false = only track the live stream
+        bool rebase = false;            // Next packet starts a new timestamp origin
+        bool wait_keyframe = false;     // Back to live: drop video until a keyframe
+        const std::atomic<GstClockTime>* keyframe_pts = nullptr;
+        GstClockTime last_pts = GST_CLOCK_TIME_NONE;
+        guint16 next_seq = 0;
+        guint32 last_ts = 0;
+        guint32 origin_in = 0;
+        guint32 origin_out = 0;
+        guint32 ts_step = 0;            // Gap left at a rebase (about one frame)
+        double speed = 1.0;
+    };
+    static bool rtp_rewrite_enabled_;
+    RtpRewrite video_rewrite_;
+    RtpRewrite audio_rewrite_;
+    gulong video_rewrite_probe_id_;
+    gulong audio_rewrite_probe_id_;
+    GstElement* dvr_video_src_;     // appsrcs, only while time-shifted (owned by the pipeline)
+    GstElement* dvr_audio_src_;
+    std::unique_ptr<DvrPlayback> dvr_playback_;
+    std::atomic<bool> timeshifted_;
+    mutable std::mutex timeshift_mutex_;
+
+    static GstPadProbeReturn rtpRewriteProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data);
+    // false = drop; *buffer may be replaced by a writable copy
+    static bool rewriteRtp(RtpRewrite& state, GstBuffer** buffer);
+
+    // Move a queue's input between its tee pad and an appsrc while the tee pad is idle
+    bool switchQueueInput(GstPad* tee_pad, GstElement* queue, GstElement* src,
+                          RtpRewrite* rewrite, gulong* rewrite_probe_id);
+    GstElement* createDvrSource(GstPad* tee_pad, const std::string& name);
+    void removeDvrSource(GstElement*& src, GstElement* queue);
+    void deliverDvrPacket(GstBuffer* buffer, bool video, double speed, bool rebase);
+    // Caller holds timeshift_mutex_. keyframe_pts = nullptr resumes video right away.
+    void returnToLive(const std::atomic<GstClockTime>* keyframe_pts);
+    void stopTimeshift();
+
     // Probe IDs for cleanup
     gulong video_tee_probe_id_;
     gulong video_queue_sink_probe_id_;
@@ -165,11 +865,74 @@ private:
     std::function<void(const std::string&, int)> ice_candidate_callback_;
     std::function<void(const std::string&)> offer_callback_;
 
-    // Static TURN server config (shared by all peers)
-    static TurnConfig turn_config_;
+    // Liveness tracking for dead-peer reclamation (all monotonic microseconds)
+    GstElement* rtpbin_;                        // webrtcbin's internal rtpbin (ref held)
+    std::atomic<int> failure_reason_;           // ReclaimReason set by state callbacks
+    std::atomic<gint64> disconnected_since_us_; // 0 = not disconnected
+    std::atomic<gint64> last_rtcp_us_;          // 0 = no RTCP received yet
+    std::atomic<bool> media_connected_;
+
+    // ICE restart state
+    std::atomic<bool> ice_restart_pending_;
+    std::atomic<gint64> ice_restart_started_us_;
+    std::atomic<int> ice_restart_attempts_;     // Since the last successful connect
+
+    // Grace period before a "disconnected" peer is reclaimed
+    static constexpr int DISCONNECT_GRACE_MS = 5000;
+    // Browsers send RTCP roughly every second; silence this long means the viewer is gone
+    static constexpr int CONSENT_TIMEOUT_MS = 10000;
+    // How long a peer may stay disconnected before an automatic ICE restart
+    static constexpr int ICE_RESTART_DELAY_MS = 1500;
+    // Extra grace before reclaiming a peer whose ICE restart is in progress
+    static constexpr int ICE_RESTART_TIMEOUT_MS = 8000;
+    // Automatic restarts per outage (viewer-requested restarts are not limited)
+    static constexpr int MAX_AUTO_ICE_RESTARTS = 1;
+
+    // Static TURN server configs (shared by all peers)
+    static std::vector<TurnConfig> turn_configs_;
     static bool turn_configured_;
     static bool use_cloudflare_turn_;
 
+    // Static ICE gathering policy (shared by all peers)
+    static IcePolicy ice_policy_;
+    static bool ice_policy_configured_;
+
+    // Server-reflexive address learned by an earlier peer (StunMode::Cached)
+    static std::mutex srflx_cache_mutex_;
+    static std::string srflx_public_ip_;
+    static bool srflx_port_preserving_;
+    static gint64 srflx_learned_us_;
+    static constexpr int SRFLX_CACHE_TTL_SECONDS = 300;
+
+    // Per-peer gathering state
+    std::set<std::string> allowed_local_ips_;   // Empty = no interface filtering
+    std::string synthesized_srflx_ip_;          // Non-empty = peer skipped STUN
+    std::atomic<int> local_candidates_;
+    std::atomic<int> remote_candidates_;
+    std::atomic<gint64> gather_started_us_;
+    std::atomic<gint64> connect_started_us_;
+
+    // Hand every configured relay to webrtcbin, best first for this network
+    void addTurnRelays();
+
+    // After the first connect, find which relay (if any) won the race
+    void recordSelectedRelay(double connect_ms);
+    static void onSelectedPairStats(GstPromise* promise, gpointer user_data);
+
+    // Apply ice_policy_ to the freshly created webrtcbin
+    void applyIcePolicy();
+
+    // Local addresses that pass the interface/family filters
+    static std::set<std::string> selectLocalAddresses(const IcePolicy& policy);
+
+    // Policy checks for candidates we send and candidates we receive
+    bool acceptLocalCandidate(const std::string& candidate) const;
+    bool acceptRemoteCandidate(const std::string& candidate) const;
+
+    // StunMode::Cached: remember (or advertise) the public address
+    static void learnSrflx(const std::string& candidate);
+    std::string synthesizeSrflx(const std::string& host_candidate) const;
+
     // Global mutex for ICE operations to prevent libnice race conditions
     // libnice has internal state that can crash when multiple peers
     // process ICE candidates simultaneously
@@ -190,6 +953,10 @@ private:
     static void onIceConnectionStateChange(GstElement* webrtc, GParamSpec* pspec, gpointer user_data);
     static void onConnectionStateChange(GstElement* webrtc, GParamSpec* pspec, gpointer user_data);
     static void onIceGatheringStateChange(GstElement* webrtc, GParamSpec* pspec, gpointer user_data);
+    static void onSsrcActive(GstElement* rtpbin, guint session, guint ssrc, gpointer user_data);
+    static void onByeSsrc(GstElement* rtpbin, guint session, guint ssrc, gpointer user_data);
+
+    void markDisconnected(bool disconnected);
 
     // Callback for incoming media pads (viewer's audio)
     static void onPadAdded(GstElement* webrtc, GstPad* pad, gpointer user_data);
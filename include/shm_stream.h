@@ -0,0 +1,132 @@
+#ifndef SHM_STREAM_H
+#define SHM_STREAM_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+/**
+ * Shared-memory stream of encoded access units - layout and client library
+ *
+ * webrtc_streamer (SHM_STREAM_NAME) publishes every encoded video access
+ * unit (H.264/H.265 Annex B, or VP8 frames) and every Opus packet into a
+ * POSIX shared-memory ring. Local consumers map it read-only and read the
+ * units in place, with no copy and no effect on the writer: it never waits
+ * for readers, and a reader that falls a full ring behind gets Overrun and
+ * continues at the newest keyframe.
+ *
+ * Layout: Header, then slot_count Slots (one per unit, indexed by unit
+ * number % slot_count), then data_size bytes of payload. Payload positions
+ * are absolute byte counts; a unit's bytes are at data_offset +
+ * (data_pos % data_size) and never wrap. Each slot is a seqlock: seq is odd
+ * while the writer fills it and index * 2 + 2 once unit `index` is in it.
+ *
+ * This header has no GStreamer dependency; link libshm_stream_client.
+ *
+ *   ShmStreamReader reader("/webrtc_mystream");
+ *   if (reader.open()) {
+ *       ShmStreamReader::Unit unit;
+ *       while (reader.next(unit, 1000) != ShmStreamReader::Result::Closed) {
+ *           ... use unit.data / unit.size ...
+ *           if (!reader.stillValid(unit)) { the writer lapped us - discard }
+ *       }
+ *   }
+ */
+namespace shm_stream {
+
+constexpr uint32_t MAGIC = 0x314d4853;      // "SHM1"
+constexpr uint32_t VERSION = 1;
+
+enum UnitFlags : uint32_t {
+    FLAG_KEYFRAME = 1u << 0,    // Video unit a decoder can start at (with parameter sets)
+    FLAG_AUDIO = 1u << 1        // Opus packet (otherwise video)
+};
+
+struct Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t reserved;
+    uint64_t slots_offset;
+    uint64_t data_offset;
+    uint64_t data_size;
+    char video_codec[8];                    // "H264", "H265", "VP8"
+    char audio_codec[8];                    // "OPUS"
+    int32_t writer_pid;
+    uint32_t reserved2;
+
+    std::atomic<uint64_t> write_index;      // Units published so far
+    std::atomic<uint64_t> data_head;        // Payload bytes claimed so far
+    std::atomic<int64_t> heartbeat_us;      // CLOCK_MONOTONIC of the last write
+    std::atomic<uint32_t> futex;            // Bumped per unit; readers FUTEX_WAIT on it
+    uint32_t reserved3;
+};
+
+struct Slot {
+    std::atomic<uint64_t> seq;
+    uint64_t data_pos;
+    uint32_t size;
+    uint32_t flags;
+    int64_t pts_ns;                         // Encoder timestamp (pipeline running time)
+    int64_t capture_us;                     // CLOCK_MONOTONIC when written
+};
+
+}  // namespace shm_stream
+
+class ShmStreamReader {
+public:
+    struct Unit {
+        const uint8_t* data = nullptr;      // Points into the shared ring
+        uint32_t size = 0;
+        uint32_t flags = 0;
+        int64_t pts_ns = 0;
+        int64_t capture_us = 0;
+        uint64_t index = 0;
+        uint64_t data_pos = 0;
+
+        bool keyframe() const { return flags & shm_stream::FLAG_KEYFRAME; }
+        bool audio() const { return flags & shm_stream::FLAG_AUDIO; }
+    };
+
+    enum class Result {
+        Ok,
+        Timeout,
+        Overrun,    // Fell a full ring behind - next() continues at the newest keyframe
+        Closed      // Writer gone (no heartbeat) - reopen to follow a restarted streamer
+    };
+
+    explicit ShmStreamReader(const std::string& name);
+    ~ShmStreamReader();
+
+    ShmStreamReader(const ShmStreamReader&) = delete;
+    ShmStreamReader& operator=(const ShmStreamReader&) = delete;
+
+    // Map the ring and position at the newest keyframe
+    bool open();
+    void close();
+
+    Result next(Unit& unit, int timeout_ms);
+
+    // Whether unit's bytes are still intact - check after using them
+    bool stillValid(const Unit& unit) const;
+
+    std::string videoCodec() const;
+    bool writerAlive() const;
+
+private:
+    uint64_t newestKeyframe() const;
+
+    std::string name_;
+    int fd_;
+    void* map_;
+    size_t map_size_;
+    const shm_stream::Header* header_;
+    const shm_stream::Slot* slots_;
+    const uint8_t* data_;
+    uint64_t next_;
+
+    static constexpr int64_t WRITER_TIMEOUT_US = 3000000;
+};
+
+#endif // SHM_STREAM_H
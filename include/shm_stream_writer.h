@@ -0,0 +1,45 @@
+#ifndef SHM_STREAM_WRITER_H
+#define SHM_STREAM_WRITER_H
+
+#include <string>
+#include <mutex>
+#include <cstdint>
+#include "shm_stream.h"
+
+/**
+ * ShmStreamWriter - Publishes encoded units into the shared-memory ring
+ *
+ * The writer side of shm_stream.h. Called from the shared pipeline's
+ * streaming threads. A write is a memcpy into the ring plus a futex wake.
+ * It never waits for or even knows about readers.
+ */
+class ShmStreamWriter {
+public:
+    // name: POSIX shm name ("/webrtc_<stream>"), replaced if it exists
+    ShmStreamWriter(const std::string& name, size_t data_bytes, uint32_t slot_count,
+                    const std::string& video_codec);
+    ~ShmStreamWriter();     // Unlinks the ring; mapped readers see the writer go quiet
+
+    bool open();
+
+    void write(const uint8_t* data, size_t size, uint32_t flags, int64_t pts_ns);
+
+    const std::string& name() const { return name_; }
+
+private:
+    const std::string name_;
+    const size_t data_bytes_;
+    const uint32_t slot_count_;
+    const std::string video_codec_;
+
+    std::mutex mutex_;          // Video and audio arrive on different threads
+    void* map_;
+    size_t map_size_;
+    shm_stream::Header* header_;
+    shm_stream::Slot* slots_;
+    uint8_t* data_;
+    uint64_t index_;
+    uint64_t data_head_;
+};
+
+#endif // SHM_STREAM_WRITER_H
@@ -29,20 +29,68 @@ public:
     void disconnect();
 
     // Register as a broadcaster
-    bool registerBroadcaster(const std::string& stream_id);
+    // With handoff=true the server keeps the current broadcaster (if any)
+    // serving until it releases the camera, then migrates its viewers to us
+    bool registerBroadcaster(const std::string& stream_id, bool handoff = false);
+
+    // Handoff: tell the server we released the camera (outgoing process)
+    void sendHandoffRelease();
+
+    // Handoff: tell the server our pipeline is producing media (incoming process)
+    void sendHandoffReady();
+
+    // Handoff: tell the server we could not get video going (incoming process);
+    // the outgoing process takes the camera back
+    void sendHandoffFailed(const std::string& reason);
+
+    // Tell the server we tore down a dead peer on our own
+    void sendViewerReclaimed(const std::string& viewer_id, const std::string& reason);
+
+    // Publish a metrics snapshot (served by the signaling server at /metrics)
+    void sendMetrics(const Json::Value& metrics);
 
     // Send SDP offer to viewer
-    void sendOffer(const std::string& viewer_id, const std::string& sdp);
+    // ice_restart=true tells the viewer to renegotiate on its existing peer connection
+    void sendOffer(const std::string& viewer_id, const std::string& sdp, bool ice_restart = false);
+
+    // Tell a viewer how far behind live it is playing (0 = live)
+    void sendTimeshiftState(const std::string& viewer_id, double behind_seconds);
+
+    // Tell a viewer about a clip it triggered (status: started | written | failed)
+    void sendClipStatus(const std::string& viewer_id, const std::string& clip, const std::string& status);
+
+    // Answer a snapshot-request from the server (jpeg is sent base64; empty = failed)
+    void sendSnapshot(const std::string& request_id, int width, const std::string& jpeg, int age_ms);
 
     // Send ICE candidate
     void sendIceCandidate(const std::string& peer_id,
                          const std::string& candidate, int sdp_mline_index);
 
     // Set callbacks
-    void setOnViewerJoined(std::function<void(const std::string&)> callback);
+    // Viewer joined: (viewer_id, client_id, network, resume) - client_id is the
+    // resume key the server issued the viewer (stable across its rejoins),
+    // network its IP prefix as seen by the server, resume means it kept its
+    // peer connection and proved it held that key
+    void setOnViewerJoined(std::function<void(const std::string&, const std::string&,
+                                              const std::string&, bool)> callback);
     void setOnAnswer(std::function<void(const std::string&, const std::string&)> callback);
     void setOnIceCandidate(std::function<void(const std::string&, const std::string&, int)> callback);
     void setOnViewerLeft(std::function<void(const std::string&)> callback);
+    void setOnHandoffRequest(std::function<void()> callback);
+    void setOnHandoffGo(std::function<void()> callback);
+    // Outgoing process: the new one has video (exit now), or it failed (take the camera back)
+    void setOnHandoffComplete(std::function<void()> callback);
+    void setOnHandoffAbort(std::function<void(const std::string&)> callback);
+    void setOnIceRestartRequest(std::function<void(const std::string&)> callback);
+    // Viewer latency report: (viewer_id, e2e_ms, jitter_buffer_ms, playout_delay)
+    // Values are -1 when the viewer's browser could not measure them
+    void setOnViewerStats(std::function<void(const std::string&, double, double, bool)> callback);
+    // Viewer time-shift request: (viewer_id, seconds_ago, speed) - seconds_ago 0 = back to live
+    void setOnTimeshift(std::function<void(const std::string&, double, double)> callback);
+    // Motion/alarm event: (viewer_id or "" for non-viewer sources, event name)
+    void setOnEvent(std::function<void(const std::string&, const std::string&)> callback);
+    // Snapshot wanted for the server's HTTP endpoint: (request_id, width)
+    void setOnSnapshotRequest(std::function<void(const std::string&, int)> callback);
 
 private:
     std::string server_url_;
@@ -56,10 +104,19 @@ private:
     std::thread io_thread_;
     std::atomic<bool> connected_;
 
-    std::function<void(const std::string&)> on_viewer_joined_;
+    std::function<void(const std::string&, const std::string&, const std::string&, bool)> on_viewer_joined_;
     std::function<void(const std::string&, const std::string&)> on_answer_;
     std::function<void(const std::string&, const std::string&, int)> on_ice_candidate_;
     std::function<void(const std::string&)> on_viewer_left_;
+    std::function<void()> on_handoff_request_;
+    std::function<void()> on_handoff_go_;
+    std::function<void()> on_handoff_complete_;
+    std::function<void(const std::string&)> on_handoff_abort_;
+    std::function<void(const std::string&)> on_ice_restart_request_;
+    std::function<void(const std::string&, double, double, bool)> on_viewer_stats_;
+    std::function<void(const std::string&, double, double)> on_timeshift_;
+    std::function<void(const std::string&, const std::string&)> on_event_;
+    std::function<void(const std::string&, int)> on_snapshot_request_;
 
     // WebSocket callbacks
     void onOpen(ConnectionHdl hdl);
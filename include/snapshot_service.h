@@ -0,0 +1,76 @@
+#ifndef SNAPSHOT_SERVICE_H
+#define SNAPSHOT_SERVICE_H
+
+#include <gst/gst.h>
+#include <string>
+#include <map>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+
+/**
+ * SnapshotService - JPEG snapshots decoded from the latest keyframe
+ *
+ * The shared pipeline hands over every keyframe it encodes, which costs one
+ * buffer ref. Nothing is decoded until a snapshot is asked for. Then a
+ * worker thread decodes that single keyframe in a throwaway pipeline,
+ * scales it to the requested width and JPEG-encodes it. The result is
+ * cached per width until the next keyframe, so any number of dashboards
+ * polling the same size cost one decode per GOP. Requests that arrive
+ * while that decode runs wait for it instead of starting their own.
+ *
+ * With intra refresh (or a camera GOP longer than max_age_ms) keyframes
+ * are rare. A request for an older one is still answered from it, and
+ * also asks the shared keyframe arbiter for a fresh keyframe.
+ */
+class SnapshotService {
+public:
+    // (ok, jpeg, age of the keyframe it shows in ms)
+    using Done = std::function<void(bool, const std::string&, int)>;
+
+    // decode_chain: parser/decoder for the encoded caps, e.g. "h264parse ! avdec_h264"
+    SnapshotService(const std::string& decode_chain, int quality, int max_age_ms,
+                    std::function<void(const std::string&)> force_keyframe);
+    ~SnapshotService();
+
+    // From the streaming thread; takes its own refs
+    void onKeyframe(GstBuffer* buffer, GstCaps* caps);
+
+    // width 0 = encoded size. done may run before this returns (cache hit)
+    // or on the worker thread.
+    void request(int width, Done done);
+
+private:
+    struct Cached {
+        guint64 keyframe_seq = 0;
+        std::string jpeg;
+    };
+
+    void workerLoop();
+    bool encode(GstBuffer* buffer, GstCaps* caps, int width, std::string& jpeg);
+
+    const std::string decode_chain_;
+    const int quality_;
+    const int max_age_ms_;
+    std::function<void(const std::string&)> force_keyframe_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    GstBuffer* keyframe_;
+    GstCaps* keyframe_caps_;
+    guint64 keyframe_seq_;
+    gint64 keyframe_us_;
+    std::map<int, Cached> cache_;                   // By width
+    std::map<int, std::vector<Done>> waiting_;      // Width being decoded -> requests for it
+    std::deque<int> queue_;
+    bool stop_;
+    std::thread worker_;
+
+    static constexpr size_t MAX_CACHED_WIDTHS = 8;
+    static constexpr int DECODE_TIMEOUT_MS = 2000;
+};
+
+#endif // SNAPSHOT_SERVICE_H
@@ -0,0 +1,91 @@
+#ifndef SRT_OUTPUT_H
+#define SRT_OUTPUT_H
+
+#include <gst/gst.h>
+#include <string>
+#include <mutex>
+#include <memory>
+#include <functional>
+#include "tee_tap.h"
+
+/**
+ * SrtOutput - MPEG-TS over SRT contribution feed from the shared encoder
+ *
+ * Sends the tees' stream to one SRT endpoint (a studio ingest), unlike the
+ * WebRTC viewers, which each get their own browser-style congestion control.
+ * SRT recovers loss with ARQ inside a fixed latency window and keeps the
+ * send rate constant:
+ *   TeeTap ! appsrc ! depay ! parse ! mpegtsmux ! srtsink
+ *   TeeTap ! appsrc ! rtpopusdepay ! opusparse ! mux.
+ * Nothing is re-encoded. The output runs its own pipeline, so a dead link
+ * or an SRT error only restarts this output (with backoff) and never
+ * touches the viewers.
+ *
+ * At most buffer_bytes wait for the link. Beyond that video is dropped
+ * until it drains, then resumes at a keyframe from the shared arbiter.
+ * Link stats (RTT, bandwidth, retransmits, loss, drops) are logged and put
+ * in StreamMetrics under "srt.".
+ */
+class SrtOutput {
+public:
+    struct Config {
+        std::string uri;                // e.g. srt://studio.example.com:9000?mode=caller
+        int latency_ms = 500;           // ARQ window - about 4x the link RTT
+        std::string passphrase;         // Empty = unencrypted
+        guint64 buffer_bytes = 2 * 1024 * 1024;
+        int stats_interval_ms = 5000;
+    };
+
+    // video_chain: depayloader and parser for the tee's codec, producing
+    // something mpegtsmux accepts (e.g. "rtph264depay ! h264parse config-interval=-1")
+    SrtOutput(GstElement* shared_pipeline, GstElement* video_tee, GstElement* audio_tee,
+              const std::string& video_chain, std::function<void(const std::string&)> force_keyframe,
+              const Config& config);
+    // Call with the shared pipeline stopped
+    ~SrtOutput();
+
+    bool start();
+
+private:
+    bool buildPipeline();
+    void teardownPipeline();
+    void deliver(GstBuffer* buffer, bool video);
+    void logStats();
+
+    static gboolean onBusMessage(GstBus* bus, GstMessage* msg, gpointer user_data);
+    static gboolean onRestart(gpointer user_data);
+    static gboolean onStatsTimer(gpointer user_data);
+
+    GstElement* shared_pipeline_;
+    GstElement* video_tee_;
+    GstElement* audio_tee_;
+    const std::string video_chain_;
+    std::function<void(const std::string&)> force_keyframe_;
+    const Config config_;
+
+    std::unique_ptr<TeeTap> video_tap_;
+    std::unique_ptr<TeeTap> audio_tap_;
+
+    // Output pipeline; mutex_ guards it against the taps' streaming threads
+    std::mutex mutex_;
+    GstElement* pipeline_;
+    GstElement* vsrc_;
+    GstElement* asrc_;
+    GstElement* sink_;
+    bool dropping_;
+
+    guint bus_watch_id_;
+    guint restart_source_id_;
+    guint stats_source_id_;
+    int restart_backoff_ms_;
+
+    // Cumulative SRT counters at the last stats poll (reset with the socket)
+    gint64 last_retransmitted_;
+    gint64 last_lost_;
+    gint64 last_dropped_;
+
+    static constexpr int RESTART_BACKOFF_MIN_MS = 1000;
+    static constexpr int RESTART_BACKOFF_MAX_MS = 30000;
+};
+
+#endif // SRT_OUTPUT_H
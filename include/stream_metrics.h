@@ -0,0 +1,110 @@
+#ifndef STREAM_METRICS_H
+#define STREAM_METRICS_H
+
+#include <string>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+#include <chrono>
+#include <json/json.h>
+
+/**
+ * StreamMetrics - Process-wide counters, gauges and latency samples
+ *
+ * Components record into the singleton; StreamManager periodically logs a
+ * summary and forwards a JSON snapshot to the signaling server, which serves
+ * it from its /metrics endpoint.
+ *
+ * Names are dotted paths, e.g. "peers.reclaimed.ice-failed".
+ */
+class StreamMetrics {
+public:
+    // Singleton instance
+    static StreamMetrics& instance();
+
+    // Add to a monotonically increasing counter
+    void increment(const std::string& name, uint64_t by = 1);
+
+    // Set a point-in-time value
+    void setGauge(const std::string& name, double value);
+
+    // Record one latency/duration sample in milliseconds
+    void recordLatency(const std::string& name, double ms);
+
+    // Record one sample of a unitless distribution (e.g. frame sizes in bytes)
+    void recordValue(const std::string& name, double value);
+
+    // Current and peak resident memory of this process from /proc/self/status,
+    // as the gauges process.rss_kb and process.peak_rss_kb
+    void recordMemory();
+
+    // Snapshot of everything recorded so far
+    // Latencies and values are reported as count/avg/max/p50/p95/p99 over a sample window
+    Json::Value toJson();
+
+    // Print a one-line-per-metric summary to stdout
+    void logSummary();
+
+private:
+    StreamMetrics() = default;
+    ~StreamMetrics() = default;
+    StreamMetrics(const StreamMetrics&) = delete;
+    StreamMetrics& operator=(const StreamMetrics&) = delete;
+
+    struct LatencyStats {
+        uint64_t count = 0;
+        double sum = 0;
+        double max = 0;
+        std::vector<double> samples;    // Ring of the most recent samples
+        size_t next = 0;
+    };
+
+    static double percentile(std::vector<double> samples, double p);
+    static void addSample(LatencyStats& stats, double sample);
+    static Json::Value summarize(const LatencyStats& stats, const std::string& suffix);
+
+    std::mutex mutex_;
+    std::map<std::string, uint64_t> counters_;
+    std::map<std::string, double> gauges_;
+    std::map<std::string, LatencyStats> latencies_;
+    std::map<std::string, LatencyStats> values_;
+
+    // Percentiles are computed over this many recent samples per metric
+    static constexpr size_t LATENCY_SAMPLE_WINDOW = 1024;
+};
+
+/**
+ * ScopedLatency - Records the time until it goes out of scope as a latency
+ * sample, for handlers with several return paths
+ */
+class ScopedLatency {
+public:
+    explicit ScopedLatency(const std::string& name);
+    ~ScopedLatency();
+
+private:
+    std::string name_;
+    std::chrono::steady_clock::time_point started_;
+};
+
+/**
+ * TimedLockGuard - lock_guard that records how long the lock was waited for
+ * and held, as lock.<name>.wait_ms and lock.<name>.hold_ms. For control-plane
+ * locks (viewer joins, the reclaim thread), not per-packet paths.
+ */
+class TimedLockGuard {
+public:
+    TimedLockGuard(std::mutex& mutex, const char* name);
+    ~TimedLockGuard();
+
+    TimedLockGuard(const TimedLockGuard&) = delete;
+    TimedLockGuard& operator=(const TimedLockGuard&) = delete;
+
+private:
+    std::mutex& mutex_;
+    const char* name_;
+    std::chrono::steady_clock::time_point locked_;
+};
+
+#endif // STREAM_METRICS_H
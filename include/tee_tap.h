@@ -0,0 +1,46 @@
+#ifndef TEE_TAP_H
+#define TEE_TAP_H
+
+#include <gst/gst.h>
+#include <string>
+#include <functional>
+
+/**
+ * TeeTap - Copies what a shared tee sends out to application code
+ *
+ * Adds tee -> leaky queue -> appsink to the shared pipeline and hands each
+ * buffer to a callback on the streaming thread. The queue drops the oldest
+ * buffers and the appsink never blocks, so a slow consumer cannot stall the
+ * tee or the viewers behind it. Used by outputs that run their own
+ * pipelines (RTSP, SRT), so their errors and state changes stay there.
+ */
+class TeeTap {
+public:
+    using Handler = std::function<void(GstBuffer*)>;
+
+    TeeTap(GstElement* pipeline, GstElement* tee, const std::string& name, Handler handler);
+    // Call with the shared pipeline stopped - the elements go with it
+    ~TeeTap();
+
+    bool attach();
+
+    // The tee's current caps (caller unrefs), nullptr before the first buffer
+    GstCaps* caps() const;
+
+private:
+    static GstFlowReturn onNewSample(GstElement* sink, gpointer user_data);
+
+    GstElement* pipeline_;
+    GstElement* tee_;
+    std::string name_;
+    Handler handler_;
+
+    GstPad* tee_pad_;
+    GstElement* queue_;
+    GstElement* sink_;
+
+    // Only a moment of RTP is held while the appsink copies it out
+    static constexpr guint QUEUE_BUFFERS = 200;
+};
+
+#endif // TEE_TAP_H
@@ -0,0 +1,96 @@
+#!/bin/bash
+#
+# Compare per-frame sizes of IDR vs periodic intra refresh encoding, and the
+# packets a capped uplink would drop for each.
+#
+# Encodes the same test pattern with the streamer's x264 settings, then feeds
+# the frame sizes through a drop-tail link model (rate + buffer) - the same
+# thing a congested uplink or a viewer's leaky queue does to a keyframe burst.
+#
+# Usage: ./scripts/bench_intra_refresh.sh [uplink_kbps] [buffer_ms] [seconds]
+#        (defaults: 2500 kbps, 50 ms, 20 s)
+#
+
+UPLINK_KBPS="${1:-2500}"
+BUFFER_MS="${2:-50}"
+SECONDS_TO_RUN="${3:-20}"
+FPS=30
+MTU=1200
+FRAMES=$((SECONDS_TO_RUN * FPS))
+
+if ! command -v gst-launch-1.0 >/dev/null 2>&1; then
+    echo "gst-launch-1.0 not found - install gstreamer1.0-tools"
+    exit 1
+fi
+
+# Print "<bytes> <key|delta>" per encoded frame
+encode() {
+    local mode="$1"
+    gst-launch-1.0 -v \
+        videotestsrc num-buffers=$FRAMES pattern=ball is-live=false ! \
+        video/x-raw,width=1280,height=720,framerate=$FPS/1 ! \
+        x264enc tune=zerolatency speed-preset=ultrafast bitrate=2000 key-int-max=30 bframes=0 $mode ! \
+        video/x-h264,profile=constrained-baseline ! \
+        identity silent=false ! fakesink 2>/dev/null |
+    grep 'identity0:sink) (' |
+    awk '{ s = $0; sub(/.*identity0:sink\) \(/, "", s); split(s, a, " ");
+           print a[1], (index($0, "delta-unit") ? "delta" : "key") }'
+}
+
+# Frame sizes in, distribution and link-model drops out (plain awk - no gawk on the Pi)
+analyze() {
+    local frames
+    frames="$(mktemp)"
+    cat > "$frames"
+
+    if [ ! -s "$frames" ]; then
+        echo "  no frames captured"
+        rm -f "$frames"
+        return
+    fi
+
+    local n p50 p99
+    n=$(wc -l < "$frames")
+    p50=$(cut -d' ' -f1 "$frames" | sort -n | sed -n "$(( (n + 1) / 2 ))p")
+    p99=$(cut -d' ' -f1 "$frames" | sort -n | sed -n "$(( (n * 99 + 99) / 100 ))p")
+
+    awk -v rate_kbps="$UPLINK_KBPS" -v buffer_ms="$BUFFER_MS" -v fps="$FPS" -v mtu="$MTU" \
+        -v p50="$p50" -v p99="$p99" '
+    BEGIN {
+        # Drop-tail link: drains rate_kbps, holds buffer_ms worth of bytes
+        drain_per_frame = rate_kbps * 1000 / 8 / fps
+        capacity = rate_kbps * 1000 / 8 * buffer_ms / 1000
+    }
+    {
+        n++; total += $1
+        if ($2 == "key") keys++
+        if ($1 > max) max = $1
+
+        packets = int(($1 + mtu - 1) / mtu)
+        damaged_frame = 0
+        for (p = 0; p < packets; p++) {
+            bytes = (p < packets - 1) ? mtu : $1 - (packets - 1) * mtu
+            sent++
+            if (backlog + bytes > capacity) { dropped++; damaged_frame = 1 }
+            else backlog += bytes
+        }
+        damaged += damaged_frame
+        backlog = (backlog > drain_per_frame) ? backlog - drain_per_frame : 0
+    }
+    END {
+        printf "  frames=%d keyframes=%d avg=%.0fB p50=%dB p99=%dB max=%dB peak/avg=%.1fx\n",
+            n, keys, total / n, p50, p99, max, max / (total / n)
+        printf "  link %dkbps/%dms: %d of %d packets dropped (%.2f%%), %d frames damaged\n",
+            rate_kbps, buffer_ms, dropped, sent, 100.0 * dropped / sent, damaged
+    }' "$frames"
+
+    rm -f "$frames"
+}
+
+echo "Encoding ${SECONDS_TO_RUN}s at 720p${FPS}, uplink model ${UPLINK_KBPS}kbps with ${BUFFER_MS}ms buffer"
+echo
+echo "IDR every 30 frames:"
+encode "" | analyze
+echo
+echo "Periodic intra refresh over 30 frames (VIDEO_INTRA_REFRESH=1):"
+encode "intra-refresh=true vbv-buf-capacity=100" | analyze
@@ -0,0 +1,68 @@
+#!/bin/bash
+#
+# Run the streamer with synthetic loopback viewers behind a simulated
+# network, and print what they received: frame rate, freezes and latency.
+#
+# The same script, seed and settings give the same loss pattern on every
+# run, so two builds or two settings can be compared on one machine:
+#
+#   ./scripts/bench_netsim.sh "0 loss=3 burst=4 delay=40 jitter=10" 60
+#   PACING_MULTIPLIER=2.5 ./scripts/bench_netsim.sh "0 rate=2500 buffer=40" 60
+#   FEC_MODE=ulpfec ./scripts/bench_netsim.sh scripts/netsim/cellular.txt 120 2
+#
+# Script syntax is described in include/net_impairment.h. Every other
+# streamer setting (VIDEO_CODEC, RTX_HISTORY_MS, CAMERA args...) is taken
+# from the environment as usual. Starts a local signaling server if none
+# is listening on port 8080.
+#
+# Usage: ./scripts/bench_netsim.sh <script or script file> [seconds] [viewers] [camera args...]
+#        (defaults: 60 s, 1 viewer; camera args as for webrtc_streamer after the stream id)
+#
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+REPO_DIR="$(dirname "$SCRIPT_DIR")"
+STREAMER_BIN="$REPO_DIR/build/webrtc_streamer"
+
+NETSIM="$1"
+SECONDS_TO_RUN="${2:-60}"
+VIEWERS="${3:-1}"
+shift 3 2>/dev/null || shift $#
+
+if [ -z "$NETSIM" ]; then
+    sed -n '2,20p' "$0" | sed 's/^# \{0,1\}//'
+    exit 1
+fi
+
+if [ ! -x "$STREAMER_BIN" ]; then
+    echo "$STREAMER_BIN not found - run ./scripts/build.sh first"
+    exit 1
+fi
+
+SIGNALING_PID=""
+if ! (exec 3<>/dev/tcp/127.0.0.1/8080) 2>/dev/null; then
+    echo "Starting signaling server..."
+    (cd "$REPO_DIR/signaling" && node server.js >/tmp/bench_netsim_signaling.log 2>&1) &
+    SIGNALING_PID=$!
+    sleep 2
+fi
+
+LOG="$(mktemp /tmp/bench_netsim.XXXXXX.log)"
+echo "Running ${SECONDS_TO_RUN}s with ${VIEWERS} loopback viewer(s), netsim: $NETSIM"
+echo "Full log: $LOG"
+
+LOOPBACK_VIEWERS="$VIEWERS" NETSIM_SCRIPT="$NETSIM" \
+    timeout -s INT --kill-after=15 "$SECONDS_TO_RUN" \
+    "$STREAMER_BIN" ws://localhost:8080 netsim-bench "$@" >"$LOG" 2>&1
+
+if [ -n "$SIGNALING_PID" ]; then
+    kill "$SIGNALING_PID" 2>/dev/null
+fi
+
+echo
+grep -E '^(Loopback|NACK|FEC|Pacing|Encoder):' "$LOG"
+echo
+grep -E '^\[LOOPBACK\] .* (total|first frame)' "$LOG"
+echo
+# Last metrics summary before shutdown
+grep -E '^\[METRICS\] (netsim|rtx|fec|pacer|keyframes|video\.queue_overruns|loopback)' "$LOG" |
+    awk '{ last[$2] = $0 } END { for (name in last) print last[name] }' | sort
@@ -0,0 +1,46 @@
+#!/bin/bash
+#
+# Zero-downtime upgrade: start a new streamer that takes over from the
+# running one. The running process releases the camera and keeps its viewers
+# until the new one has video, then exits on its own; the signaling server
+# migrates its viewers to the new process in batches. If the new process gets
+# no video, the running one takes the camera back and keeps serving.
+#
+# Usage: ./scripts/handoff_upgrade.sh <signaling_server_url> [streamer args...]
+#
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+STREAMER_BIN="$SCRIPT_DIR/../build/webrtc_streamer"
+LOG_FILE="/tmp/webrtc_streamer_handoff.log"
+
+if [ -z "$1" ]; then
+    echo "Usage: $0 <signaling_server_url> [stream_id] [video_device] [audio_device] [csi|usb]"
+    exit 1
+fi
+
+if [ ! -f "$STREAMER_BIN" ]; then
+    echo "Streamer binary not found at $STREAMER_BIN"
+    exit 1
+fi
+
+echo "Starting new streamer in handoff mode..."
+WEBRTC_HANDOFF=1 nohup "$STREAMER_BIN" "$@" > "$LOG_FILE" 2>&1 &
+NEW_PID=$!
+echo "New streamer PID: $NEW_PID (log: $LOG_FILE)"
+
+# Wait for the new process to report it is serving
+for i in $(seq 1 100); do
+    if ! kill -0 "$NEW_PID" 2>/dev/null; then
+        echo "New streamer exited during handoff - see $LOG_FILE"
+        exit 1
+    fi
+    if grep -q "\[HANDOFF\] Ready for viewers" "$LOG_FILE"; then
+        grep "\[HANDOFF\]" "$LOG_FILE"
+        echo "Handoff complete"
+        exit 0
+    fi
+    sleep 0.1
+done
+
+echo "Handoff did not complete within 10s - see $LOG_FILE"
+exit 1
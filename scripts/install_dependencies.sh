@@ -26,6 +26,7 @@ sudo apt install -y \
     libgstreamer1.0-dev \
     libgstreamer-plugins-base1.0-dev \
     libgstreamer-plugins-bad1.0-dev \
+    libgstrtspserver-1.0-dev \
     libnice-dev \
     libsrtp2-dev
 
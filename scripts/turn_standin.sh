@@ -0,0 +1,53 @@
+#!/bin/bash
+#
+# Local TURN stand-in for testing relay racing: runs coturn with UDP and TCP
+# on 3478 and TLS on 5349 (self-signed certificate).
+#
+# Usage: ./scripts/turn_standin.sh [--no-udp] [external_ip]
+#
+#   --no-udp     Refuse TURN over UDP, like a UDP-blocking firewall would
+#   external_ip  Address advertised in relay candidates (default: first local IP)
+#
+# Then start the streamer with:
+#   TURN_SERVER=turn:<ip>:3478,turns:<ip>:5349 TURN_USERNAME=test TURN_PASSWORD=test
+#
+
+WORK_DIR="/tmp/turn_standin"
+NO_UDP=""
+
+if [ "$1" == "--no-udp" ]; then
+    NO_UDP="--no-udp"
+    shift
+fi
+
+EXTERNAL_IP="${1:-$(hostname -I | awk '{print $1}')}"
+
+if ! command -v turnserver >/dev/null 2>&1; then
+    echo "turnserver not found - install coturn (sudo apt install coturn)"
+    exit 1
+fi
+
+mkdir -p "$WORK_DIR"
+if [ ! -f "$WORK_DIR/cert.pem" ]; then
+    openssl req -x509 -newkey rsa:2048 -nodes -days 30 \
+        -subj "/CN=$EXTERNAL_IP" \
+        -keyout "$WORK_DIR/key.pem" -out "$WORK_DIR/cert.pem" 2>/dev/null
+fi
+
+echo "TURN stand-in on $EXTERNAL_IP (udp+tcp 3478, tls 5349)${NO_UDP:+ - UDP disabled}"
+echo "Credentials: test / test"
+
+exec turnserver \
+    --listening-port 3478 \
+    --tls-listening-port 5349 \
+    --external-ip "$EXTERNAL_IP" \
+    --realm streamer.local \
+    --user test:test \
+    --lt-cred-mech \
+    --fingerprint \
+    --cert "$WORK_DIR/cert.pem" \
+    --pkey "$WORK_DIR/key.pem" \
+    --no-cli \
+    --no-dtls \
+    --log-file stdout \
+    $NO_UDP
@@ -0,0 +1,421 @@
+// Control-plane simulator
+//
+// Stands in for the signaling server and drives a real broadcaster through
+// thousands of viewer joins, leaves, ICE bursts, ICE restarts and resumed
+// reconnects - no browsers, no media. Virtual viewers answer offers with a
+// synthetic SDP and send host candidates on an unroutable address, so each
+// join builds and tears down a real webrtcbin while ICE never connects.
+//
+// Start it, then point the broadcaster at it:
+//
+//   node control_plane_sim.js --viewers 2000 --rate 20
+//   ./build/webrtc_streamer ws://localhost:8090 sim-stream ...
+//
+// Once the trace has played out it waits for the broadcaster's next metrics
+// report and prints control-plane latency percentiles (measured here and by
+// the broadcaster), lock wait/hold times and peak memory, then exits.
+//
+// Options:
+//   --port N            Listen port (8090)
+//   --trace FILE        Replay a trace instead of generating one
+//   --write-trace FILE  Save the generated trace for replay
+//   --viewers N         Viewer sessions to generate (1000)
+//   --rate N            Joins per second (20)
+//   --dwell MS          Mean time a viewer stays (5000)
+//   --ice N             Candidates per viewer, sent as one burst (8)
+//   --reconnect P       Fraction of viewers that drop and rejoin with resume (0.2)
+//   --restart P         Fraction that ask for an ICE restart mid-session (0.1)
+//   --answer-delay MS   Time a viewer takes to answer an offer (20)
+//   --settle MS         Wait after the last event before reporting (5000)
+//   --seed N            Seed for the generated trace (1)
+//
+// A trace is one JSON event per line, in time order:
+//   {"t": 0, "op": "join", "viewer": "sim-0", "client": "client-0"}
+//   {"t": 0, "op": "join", "viewer": "sim-0-r", "client": "client-0", "resume": true}
+//   {"t": 50, "op": "ice", "viewer": "sim-0", "count": 8}
+//   {"t": 2500, "op": "restart", "viewer": "sim-0"}
+//   {"t": 5000, "op": "leave", "viewer": "sim-0"}
+// Viewers answer every offer they get on their own.
+
+const WebSocket = require('ws');
+const fs = require('fs');
+
+const OPTIONS = {
+    port: 8090,
+    trace: null,
+    writeTrace: null,
+    viewers: 1000,
+    rate: 20,
+    dwell: 5000,
+    ice: 8,
+    reconnect: 0.2,
+    restart: 0.1,
+    answerDelay: 20,
+    settle: 5000,
+    seed: 1,
+};
+
+// Longest wait for the broadcaster's metrics report (it sends one every 10s)
+const METRICS_WAIT_MS = 15000;
+
+function parseArgs(argv) {
+    for (let i = 0; i < argv.length; i += 2) {
+        const key = argv[i].replace(/^--/, '').replace(/-([a-z])/g, (m, c) => c.toUpperCase());
+        if (!(key in OPTIONS) || argv[i + 1] === undefined) {
+            console.error(`Unknown or incomplete option: ${argv[i]}`);
+            process.exit(1);
+        }
+        OPTIONS[key] = typeof OPTIONS[key] === 'number' ? Number(argv[i + 1]) : argv[i + 1];
+    }
+}
+
+// Small seeded PRNG (mulberry32), so a seed always generates the same trace
+function makeRandom(seed) {
+    let state = seed >>> 0;
+    return () => {
+        state = (state + 0x6D2B79F5) >>> 0;
+        let t = state;
+        t = Math.imul(t ^ (t >>> 15), t | 1);
+        t ^= t + Math.imul(t ^ (t >>> 7), t | 61);
+        return ((t ^ (t >>> 14)) >>> 0) / 4294967296;
+    };
+}
+
+function generateTrace() {
+    const random = makeRandom(OPTIONS.seed);
+    const events = [];
+    const interval = 1000 / OPTIONS.rate;
+
+    for (let i = 0; i < OPTIONS.viewers; i++) {
+        const viewer = `sim-${i}`;
+        const client = `client-${i}`;
+        const join = Math.round(i * interval);
+        const dwell = Math.round(OPTIONS.dwell * (0.5 + random()));
+
+        events.push({ t: join, op: 'join', viewer, client });
+        events.push({ t: join + 50, op: 'ice', viewer, count: OPTIONS.ice });
+
+        if (random() < OPTIONS.restart) {
+            events.push({ t: join + Math.round(dwell / 2), op: 'restart', viewer });
+        }
+
+        if (random() < OPTIONS.reconnect) {
+            // Network drop: the old socket goes away, the same client comes
+            // back on a new one and asks to resume
+            const drop = join + Math.round(dwell * 0.6);
+            const rejoined = `${viewer}-r`;
+            events.push({ t: drop, op: 'leave', viewer });
+            events.push({ t: drop + 300, op: 'join', viewer: rejoined, client, resume: true });
+            events.push({ t: drop + 350, op: 'ice', viewer: rejoined, count: OPTIONS.ice });
+            events.push({ t: join + dwell + 300, op: 'leave', viewer: rejoined });
+        } else {
+            events.push({ t: join + dwell, op: 'leave', viewer });
+        }
+    }
+
+    events.sort((a, b) => a.t - b.t);
+    return events;
+}
+
+function loadTrace(file) {
+    return fs.readFileSync(file, 'utf8')
+        .split('\n')
+        .filter(line => line.trim() !== '')
+        .map(line => JSON.parse(line))
+        .sort((a, b) => a.t - b.t);
+}
+
+function randomToken(length) {
+    const chars = 'abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789';
+    let token = '';
+    for (let i = 0; i < length; i++) {
+        token += chars[Math.floor(Math.random() * chars.length)];
+    }
+    return token;
+}
+
+// A syntactically valid answer accepting the first codec of each m-line,
+// with fresh ICE credentials and a made-up DTLS fingerprint
+function fakeAnswer(offer) {
+    const sections = [];
+    for (const line of offer.split(/\r?\n/)) {
+        if (line.startsWith('m=')) {
+            sections.push([line]);
+        } else if (sections.length > 0 && line !== '') {
+            sections[sections.length - 1].push(line);
+        }
+    }
+
+    const fingerprint = Array.from({ length: 32 }, () =>
+        Math.floor(Math.random() * 256).toString(16).padStart(2, '0').toUpperCase()).join(':');
+    const transport = [
+        `a=ice-ufrag:${randomToken(8)}`,
+        `a=ice-pwd:${randomToken(24)}`,
+        `a=fingerprint:sha-256 ${fingerprint}`,
+        'a=setup:active',
+    ];
+
+    const mids = [];
+    const body = [];
+    sections.forEach((section, index) => {
+        const [kind, , proto, ...formats] = section[0].split(' ');
+        const media = kind.slice('m='.length);
+        const midLine = section.find(line => line.startsWith('a=mid:'));
+        const mid = midLine ? midLine.slice('a=mid:'.length) : String(index);
+        mids.push(mid);
+
+        if (media === 'application') {
+            body.push(`m=application 9 ${proto} ${formats[0]}`, 'c=IN IP4 0.0.0.0', ...transport,
+                `a=mid:${mid}`, ...section.filter(line => line.startsWith('a=sctp-port:')));
+            return;
+        }
+
+        const pt = formats[0];
+        body.push(`m=${media} 9 ${proto} ${pt}`, 'c=IN IP4 0.0.0.0', 'a=rtcp:9 IN IP4 0.0.0.0',
+            ...transport, `a=mid:${mid}`, 'a=recvonly', 'a=rtcp-mux',
+            ...section.filter(line => line.startsWith(`a=rtpmap:${pt} `) ||
+                                      line.startsWith(`a=fmtp:${pt} `) ||
+                                      line.startsWith(`a=rtcp-fb:${pt} `)));
+    });
+
+    return ['v=0', `o=- ${Date.now()} 2 IN IP4 127.0.0.1`, 's=-', 't=0 0',
+        `a=group:BUNDLE ${mids.join(' ')}`, 'a=msid-semantic: WMS', ...body].join('\r\n') + '\r\n';
+}
+
+// Host candidates on TEST-NET-1 (192.0.2.0/24): valid, never reachable
+function fakeCandidate(n) {
+    return `candidate:${n} 1 udp ${2122260223 - n} 192.0.2.${1 + (n % 250)} ${40000 + n} typ host`;
+}
+
+function summarize(samples) {
+    if (samples.length === 0) {
+        return 'count=0';
+    }
+    const sorted = [...samples].sort((a, b) => a - b);
+    const at = p => sorted[Math.min(sorted.length - 1, Math.floor(p * sorted.length))].toFixed(1);
+    return `count=${sorted.length} p50=${at(0.5)}ms p95=${at(0.95)}ms p99=${at(0.99)}ms ` +
+           `max=${sorted[sorted.length - 1].toFixed(1)}ms`;
+}
+
+class Simulation {
+    constructor(events) {
+        this.events = events;
+        this.broadcaster = null;
+        this.viewers = new Map();       // viewer id -> { present, pendingSince, pendingKind }
+        this.latencies = { join: [], resume: [], restart: [] };
+        this.counts = { joins: 0, leaves: 0, candidatesSent: 0, candidatesReceived: 0,
+                        answers: 0, offersAfterLeave: 0, reclaimed: 0 };
+        this.onMetrics = null;
+    }
+
+    attach(ws) {
+        this.broadcaster = ws;
+        ws.on('message', raw => {
+            let data;
+            try {
+                data = JSON.parse(raw);
+            } catch (e) {
+                return;
+            }
+            this.handleMessage(data);
+        });
+        ws.on('close', () => {
+            console.log('[SIM] Broadcaster disconnected');
+            this.broadcaster = null;
+        });
+    }
+
+    send(message) {
+        if (this.broadcaster && this.broadcaster.readyState === WebSocket.OPEN) {
+            this.broadcaster.send(JSON.stringify(message));
+        }
+    }
+
+    handleMessage(data) {
+        switch (data.type) {
+            case 'register':
+                console.log(`[SIM] Broadcaster registered: ${data.stream_id}`);
+                this.run();
+                break;
+            case 'offer':
+                this.handleOffer(data);
+                break;
+            case 'ice-candidate':
+                this.counts.candidatesReceived++;
+                break;
+            case 'viewer-reclaimed':
+                this.counts.reclaimed++;
+                break;
+            case 'metrics':
+                if (this.onMetrics) {
+                    this.onMetrics(data.metrics);
+                }
+                break;
+        }
+    }
+
+    handleOffer(data) {
+        const viewer = this.viewers.get(data.to);
+        if (!viewer || !viewer.present) {
+            this.counts.offersAfterLeave++;
+            return;
+        }
+        if (viewer.pendingSince !== null) {
+            const elapsed = Number(process.hrtime.bigint() - viewer.pendingSince) / 1e6;
+            this.latencies[viewer.pendingKind].push(elapsed);
+            viewer.pendingSince = null;
+        }
+
+        setTimeout(() => {
+            if (viewer.present) {
+                this.counts.answers++;
+                this.send({ type: 'answer', from: data.to, sdp: fakeAnswer(data.sdp) });
+            }
+        }, OPTIONS.answerDelay);
+    }
+
+    apply(event) {
+        switch (event.op) {
+            case 'join':
+                this.counts.joins++;
+                this.viewers.set(event.viewer, {
+                    present: true,
+                    pendingSince: process.hrtime.bigint(),
+                    pendingKind: event.resume ? 'resume' : 'join',
+                });
+                this.send({ type: 'viewer-joined', viewer_id: event.viewer, client_id: event.client || '',
+                            network: 'sim', resume: event.resume === true });
+                break;
+            case 'ice':
+                for (let i = 0; i < (event.count || 1); i++) {
+                    this.counts.candidatesSent++;
+                    this.send({ type: 'ice-candidate', from: event.viewer,
+                                candidate: fakeCandidate(this.counts.candidatesSent), sdpMLineIndex: 0 });
+                }
+                break;
+            case 'restart': {
+                const viewer = this.viewers.get(event.viewer);
+                if (viewer && viewer.present) {
+                    viewer.pendingSince = process.hrtime.bigint();
+                    viewer.pendingKind = 'restart';
+                    this.send({ type: 'ice-restart-request', from: event.viewer });
+                }
+                break;
+            }
+            case 'leave': {
+                this.counts.leaves++;
+                const viewer = this.viewers.get(event.viewer);
+                if (viewer) {
+                    viewer.present = false;
+                }
+                this.send({ type: 'viewer-left', viewer_id: event.viewer });
+                break;
+            }
+            default:
+                console.log(`[SIM] Unknown trace op: ${event.op}`);
+        }
+    }
+
+    run() {
+        const start = Date.now();
+        let next = 0;
+        const duration = this.events.length ? this.events[this.events.length - 1].t : 0;
+        console.log(`[SIM] Playing ${this.events.length} events over ${(duration / 1000).toFixed(1)}s`);
+
+        const progress = setInterval(() => {
+            const active = [...this.viewers.values()].filter(v => v.present).length;
+            console.log(`[SIM] ${((Date.now() - start) / 1000).toFixed(0)}s: ${this.counts.joins} joins, ` +
+                        `${this.counts.leaves} leaves, ${active} present, ` +
+                        `join->offer ${summarize(this.latencies.join)}`);
+        }, 5000);
+
+        const tick = () => {
+            const now = Date.now() - start;
+            while (next < this.events.length && this.events[next].t <= now) {
+                this.apply(this.events[next++]);
+            }
+            if (next < this.events.length) {
+                setTimeout(tick, Math.max(0, this.events[next].t - (Date.now() - start)));
+                return;
+            }
+            clearInterval(progress);
+            console.log(`[SIM] Trace done - settling for ${OPTIONS.settle}ms`);
+            setTimeout(() => this.finish(), OPTIONS.settle);
+        };
+        tick();
+    }
+
+    finish() {
+        let reported = false;
+        const report = metrics => {
+            if (reported) {
+                return;
+            }
+            reported = true;
+            this.report(metrics);
+            process.exit(0);
+        };
+        this.onMetrics = report;
+        setTimeout(() => report(null), METRICS_WAIT_MS);
+    }
+
+    report(metrics) {
+        const unanswered = [...this.viewers.values()].filter(v => v.pendingSince !== null).length;
+
+        console.log('\n========================================');
+        console.log('   CONTROL-PLANE SIMULATION');
+        console.log('========================================');
+        console.log(`Joins ${this.counts.joins}, leaves ${this.counts.leaves}, ` +
+                    `answers ${this.counts.answers}, candidates sent ${this.counts.candidatesSent} / ` +
+                    `received ${this.counts.candidatesReceived}`);
+        console.log(`Never offered: ${unanswered}, offers after leave: ${this.counts.offersAfterLeave}, ` +
+                    `reclaimed: ${this.counts.reclaimed}`);
+        console.log('\nMeasured here (request sent -> offer received):');
+        console.log(`  join -> offer           ${summarize(this.latencies.join)}`);
+        console.log(`  resume join -> offer    ${summarize(this.latencies.resume)}`);
+        console.log(`  ice restart -> offer    ${summarize(this.latencies.restart)}`);
+
+        if (!metrics) {
+            console.log('\nNo metrics report from the broadcaster');
+            return;
+        }
+
+        console.log('\nBroadcaster (handler time incl. lock wait, lock wait/hold):');
+        const latencies = metrics.latencies || {};
+        for (const name of Object.keys(latencies).sort()) {
+            if (/^(control|pipeline\.(add|remove)_viewer|lock)\./.test(name)) {
+                const entry = latencies[name];
+                console.log(`  ${name.padEnd(28)} count=${entry.count} p50=${entry.p50_ms.toFixed(1)}ms ` +
+                            `p95=${entry.p95_ms.toFixed(1)}ms p99=${entry.p99_ms.toFixed(1)}ms ` +
+                            `max=${entry.max_ms.toFixed(1)}ms`);
+            }
+        }
+
+        const gauges = metrics.gauges || {};
+        const kb = name => gauges[name] !== undefined ? `${(gauges[name] / 1024).toFixed(1)} MB` : 'n/a';
+        console.log(`\nMemory: peak ${kb('process.peak_rss_kb')}, now ${kb('process.rss_kb')}, ` +
+                    `viewers still active ${gauges['viewers.active'] !== undefined ? gauges['viewers.active'] : 'n/a'}`);
+        console.log('========================================\n');
+    }
+}
+
+parseArgs(process.argv.slice(2));
+
+const events = OPTIONS.trace ? loadTrace(OPTIONS.trace) : generateTrace();
+if (OPTIONS.writeTrace) {
+    fs.writeFileSync(OPTIONS.writeTrace, events.map(event => JSON.stringify(event)).join('\n') + '\n');
+    console.log(`[SIM] Trace written to ${OPTIONS.writeTrace}`);
+}
+
+const simulation = new Simulation(events);
+const wss = new WebSocket.Server({ port: OPTIONS.port });
+console.log(`[SIM] Waiting for the broadcaster on ws://localhost:${OPTIONS.port}`);
+
+wss.on('connection', ws => {
+    if (simulation.broadcaster) {
+        console.log('[SIM] Second connection ignored - one broadcaster per run');
+        ws.close();
+        return;
+    }
+    simulation.attach(ws);
+});
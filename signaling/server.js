@@ -18,8 +18,22 @@ const CONFIG = {
     CLEANUP_DELAY_MS: 100,        // Small delay after cleanup before allowing new joins
     PING_INTERVAL_MS: 30000,      // WebSocket ping interval
     MAX_VIEWERS_PER_STREAM: 50,   // Max viewers per broadcaster
+    HANDOFF_TIMEOUT_MS: 5000,     // Max wait for old broadcaster to release the camera
+    HANDOFF_READY_TIMEOUT_MS: 8000, // Max wait for the new broadcaster's first video after handoff-go
+    HANDOFF_BATCH_SIZE: 4,        // Viewers migrated to the new broadcaster per batch
+    HANDOFF_BATCH_INTERVAL_MS: 250, // Delay between migration batches (avoids a join storm)
+    HANDOFF_DRAIN_TIMEOUT_MS: 15000, // Max time the old broadcaster keeps serving viewers not yet offered
+    SNAPSHOT_CACHE_MS: 1000,      // Serve a snapshot this long before asking the broadcaster again
+    SNAPSHOT_TIMEOUT_MS: 5000,    // Give up on a broadcaster's snapshot after this
+    SNAPSHOT_MAX_WIDTH: 1920,
+    EVENT_COOLDOWN_MS: 2000,      // Events for a stream closer together than this are dropped
+    RESUME_KEY_TTL_MS: 60000,     // A viewer's resume key stays valid this long after it left
 };
 
+// Shared secret for sensor bridges raising events without joining a stream;
+// events that don't come from a joined viewer are refused when unset
+const EVENT_TOKEN = process.env.EVENT_TOKEN || '';
+
 // Generate Cloudflare TURN credentials
 function generateTurnCredentials() {
     const expiryTime = Math.floor(Date.now() / 1000) + 86400; // 24 hours
@@ -82,9 +96,14 @@ const broadcasters = new Map();  // streamId -> { ws, viewers: Set, cleanupQueue
 const viewers = new Map();       // viewerId -> { ws, streamId, broadcasterId, joinedAt, offerSequence }
 const connections = new Map();   // ws -> { clientId, clientRole, createdAt }
 const pendingOffers = new Map(); // viewerId -> { sequence, timestamp, timeout }
+const handoffs = new Map();      // streamId -> { ws, timeout, released } (incoming broadcaster)
+const retiring = new Map();      // streamId -> { ws, pending: Set, timeout } (outgoing broadcaster)
+const snapshots = new Map();     // `${streamId}:${width}` -> { jpeg, ageMs, at, requestId, waiters, timeout }
+const resumeKeys = new Map();    // resumeKey -> { streamId, viewerId, releasedAt } (0 = viewer connected)
 
 let nextViewerId = 1;
 let offerSequence = 1;
+let snapshotSequence = 1;
 
 // ============================================================================
 // UTILITY FUNCTIONS
@@ -142,6 +161,29 @@ function getBroadcasterSafe(streamId) {
     return broadcaster;
 }
 
+// Network a client connects from, used by the broadcaster to remember which
+// TURN relay works best there: the IPv4 /24 or the first three IPv6 hextets
+function networkKey(ip) {
+    if (typeof ip !== 'string' || ip === '') return '';
+    ip = ip.split(',')[0].trim();   // First hop of x-forwarded-for
+    if (ip.startsWith('::ffff:')) ip = ip.slice(7);
+
+    if (ip.includes('.')) {
+        return ip.split('.').slice(0, 3).join('.');
+    }
+    return ip.split(':').slice(0, 3).join(':');
+}
+
+// Drop resume keys whose viewer left more than RESUME_KEY_TTL_MS ago
+function pruneResumeKeys() {
+    const now = Date.now();
+    for (const [key, entry] of resumeKeys) {
+        if (entry.releasedAt && now - entry.releasedAt > CONFIG.RESUME_KEY_TTL_MS) {
+            resumeKeys.delete(key);
+        }
+    }
+}
+
 // Clean up pending offer for a viewer
 function cleanupPendingOffer(viewerId) {
     const pending = pendingOffers.get(viewerId);
@@ -180,8 +222,13 @@ function removeViewerAtomic(viewerId, notifyBroadcaster = true) {
         }
     }
 
-    // 5. Remove from viewers map
+    // 5. Remove from viewers map; its resume key stays usable for a while
     viewers.delete(viewerId);
+    const resumeEntry = viewer.resumeKey ? resumeKeys.get(viewer.resumeKey) : null;
+    if (resumeEntry && resumeEntry.viewerId === viewerId) {
+        resumeEntry.releasedAt = Date.now();
+    }
+    viewerMigrated(viewer.broadcasterId, viewerId);
 
     console.log(`[CLEANUP] Viewer ${viewerId} removed successfully`);
     return true;
@@ -199,6 +246,7 @@ wss.on('connection', (ws, req) => {
     connections.set(ws, {
         clientId: null,
         clientRole: null,
+        network: networkKey(clientIp),
         createdAt: Date.now()
     });
 
@@ -229,9 +277,45 @@ wss.on('connection', (ws, req) => {
                 case 'ping':
                     safeSend(ws, { type: 'pong' }, 'pong');
                     break;
+                case 'ice-restart-request':
+                    handleIceRestartRequest(ws, data);
+                    break;
+                case 'viewer-stats':
+                    handleViewerStats(ws, data);
+                    break;
+                case 'timeshift':
+                    handleTimeshift(ws, data);
+                    break;
+                case 'timeshift-state':
+                    handleTimeshiftState(ws, data);
+                    break;
+                case 'event':
+                    handleEvent(ws, data);
+                    break;
+                case 'clip-status':
+                    handleClipStatus(ws, data);
+                    break;
+                case 'snapshot':
+                    handleSnapshot(ws, data);
+                    break;
                 case 'cleanup-ack':
                     handleCleanupAck(ws, data);
                     break;
+                case 'viewer-reclaimed':
+                    handleViewerReclaimed(ws, data);
+                    break;
+                case 'metrics':
+                    handleMetrics(ws, data);
+                    break;
+                case 'handoff-release':
+                    handleHandoffRelease(ws, data);
+                    break;
+                case 'handoff-ready':
+                    handleHandoffReady(ws, data);
+                    break;
+                case 'handoff-failed':
+                    handleHandoffFailed(ws, data);
+                    break;
                 default:
                     console.log(`[WARN] Unknown message type: ${data.type}`);
             }
@@ -293,6 +377,12 @@ function handleRegister(ws, data) {
         connInfo.clientRole = 'broadcaster';
     }
 
+    // Handoff: a new process takes over without dropping the existing viewers
+    if (data.handoff) {
+        beginHandoff(ws, streamId);
+        return;
+    }
+
     // Check if broadcaster already exists
     const existing = broadcasters.get(streamId);
     if (existing) {
@@ -327,6 +417,203 @@ function handleRegister(ws, data) {
     }, 'registered');
 }
 
+// ============================================================================
+// BROADCASTER HANDOFF (zero-downtime upgrade)
+// ============================================================================
+//
+// 1. New process registers with handoff=true and waits ('handoff-pending')
+// 2. Old process gets 'handoff-request', releases the camera, replies 'handoff-release'
+//    (it keeps its viewers connected, their picture frozen)
+// 3. New process gets 'handoff-go', starts capture and replies 'handoff-ready'
+//    once video flows, or 'handoff-failed'
+// 4. Ready: viewers are moved to the new process in small batches: each
+//    viewer gets 'broadcaster-migrated' and the new process gets a
+//    'viewer-joined' for it. The old process keeps serving (the slate) until
+//    the new one has sent an offer to every viewer, then gets
+//    'handoff-complete' and exits
+// 5. Failed, timed out or new process gone: the old process gets
+//    'handoff-abort', takes the camera back and keeps serving
+
+function beginHandoff(ws, streamId) {
+    const existing = getBroadcasterSafe(streamId);
+
+    if (!existing || existing.ws === ws) {
+        // Nothing to take over - behave like a normal registration
+        console.log(`[HANDOFF] No running broadcaster for ${streamId}, starting immediately`);
+        broadcasters.set(streamId, { ws: ws, viewers: new Set(), cleanupQueue: [] });
+        safeSend(ws, { type: 'registered', stream_id: streamId }, 'registered');
+        safeSend(ws, { type: 'handoff-go' }, 'handoff-go');
+        return;
+    }
+
+    const timeout = setTimeout(() => {
+        const handoff = handoffs.get(streamId);
+        if (!handoff || handoff.released) return;
+        console.log(`[HANDOFF] Old broadcaster for ${streamId} did not release in ${CONFIG.HANDOFF_TIMEOUT_MS}ms, forcing`);
+        releaseOldBroadcaster(streamId);
+    }, CONFIG.HANDOFF_TIMEOUT_MS);
+
+    handoffs.set(streamId, { ws: ws, timeout: timeout, released: false });
+
+    console.log(`[HANDOFF] Starting handoff for ${streamId} (${existing.viewers.size} viewers)`);
+    safeSend(ws, { type: 'handoff-pending', stream_id: streamId }, 'handoff-pending');
+    safeSend(existing.ws, { type: 'handoff-request', stream_id: streamId }, 'handoff-request');
+}
+
+function handleHandoffRelease(ws, data) {
+    const connInfo = connections.get(ws);
+    if (!connInfo || connInfo.clientRole !== 'broadcaster') return;
+
+    const handoff = handoffs.get(connInfo.clientId);
+    if (!handoff || handoff.ws === ws) return;
+
+    console.log(`[HANDOFF] Old broadcaster released camera for ${connInfo.clientId}`);
+    releaseOldBroadcaster(connInfo.clientId);
+}
+
+// Detach the old broadcaster connection so its close does not end the stream
+function releaseOldBroadcaster(streamId) {
+    const handoff = handoffs.get(streamId);
+    if (!handoff || handoff.released) return;
+
+    handoff.released = true;
+    clearTimeout(handoff.timeout);
+
+    const old = broadcasters.get(streamId);
+    if (old) {
+        const oldConn = connections.get(old.ws);
+        if (oldConn) oldConn.clientRole = 'retired-broadcaster';
+    }
+
+    handoff.timeout = setTimeout(() => {
+        console.log(`[HANDOFF] New broadcaster for ${streamId} not ready in ${CONFIG.HANDOFF_READY_TIMEOUT_MS}ms`);
+        abortHandoff(streamId, 'not ready in time');
+    }, CONFIG.HANDOFF_READY_TIMEOUT_MS);
+
+    safeSend(handoff.ws, { type: 'handoff-go', stream_id: streamId }, 'handoff-go');
+}
+
+// Give the stream back to the old broadcaster (if it released the camera)
+// and drop the incoming one
+function abortHandoff(streamId, reason) {
+    const handoff = handoffs.get(streamId);
+    if (!handoff) return;
+
+    clearTimeout(handoff.timeout);
+    handoffs.delete(streamId);
+
+    const old = broadcasters.get(streamId);
+    if (handoff.released && old && old.ws !== handoff.ws) {
+        const oldConn = connections.get(old.ws);
+        if (oldConn) oldConn.clientRole = 'broadcaster';
+        safeSend(old.ws, { type: 'handoff-abort', reason: reason }, 'handoff-abort');
+    }
+
+    console.log(`[HANDOFF] Handoff for ${streamId} aborted (${reason}), old broadcaster keeps serving`);
+    if (handoff.ws.readyState === WebSocket.OPEN) {
+        handoff.ws.close(1000, 'Handoff aborted');
+    }
+}
+
+function handleHandoffFailed(ws, data) {
+    const connInfo = connections.get(ws);
+    if (!connInfo || connInfo.clientRole !== 'broadcaster') return;
+
+    const handoff = handoffs.get(connInfo.clientId);
+    if (!handoff || handoff.ws !== ws) return;
+
+    abortHandoff(connInfo.clientId, data.reason || 'new broadcaster failed');
+}
+
+function handleHandoffReady(ws, data) {
+    const connInfo = connections.get(ws);
+    if (!connInfo) return;
+
+    const streamId = connInfo.clientId;
+    const handoff = handoffs.get(streamId);
+    if (!handoff || handoff.ws !== ws) {
+        // Handoff without predecessor - already registered in beginHandoff
+        console.log(`[HANDOFF] ${streamId} ready (no viewers to migrate)`);
+        return;
+    }
+    clearTimeout(handoff.timeout);
+    handoffs.delete(streamId);
+
+    const old = broadcasters.get(streamId);
+    const viewerIds = old ? Array.from(old.viewers) : [];
+
+    broadcasters.set(streamId, { ws: ws, viewers: new Set(viewerIds), cleanupQueue: [] });
+    safeSend(ws, { type: 'registered', stream_id: streamId }, 'registered');
+
+    if (old && old.ws !== ws && old.ws.readyState === WebSocket.OPEN) {
+        // Viewers not yet offered by the new process still watch the old one
+        const timeout = setTimeout(() => {
+            console.log(`[HANDOFF] ${streamId}: not every viewer offered in ${CONFIG.HANDOFF_DRAIN_TIMEOUT_MS}ms, retiring old broadcaster`);
+            retireOldBroadcaster(streamId);
+        }, CONFIG.HANDOFF_DRAIN_TIMEOUT_MS);
+        retiring.set(streamId, { ws: old.ws, pending: new Set(viewerIds), timeout: timeout });
+        if (viewerIds.length === 0) retireOldBroadcaster(streamId);
+    }
+
+    console.log(`[HANDOFF] ${streamId} taken over, migrating ${viewerIds.length} viewers`);
+    migrateViewers(streamId, ws, viewerIds);
+    logStatus();
+}
+
+// A migrated viewer got its offer from the new process (or is gone); the old
+// process exits once none are left
+function viewerMigrated(streamId, viewerId) {
+    const entry = retiring.get(streamId);
+    if (!entry || !entry.pending.delete(viewerId)) return;
+    if (entry.pending.size === 0) {
+        retireOldBroadcaster(streamId);
+    }
+}
+
+function retireOldBroadcaster(streamId) {
+    const entry = retiring.get(streamId);
+    if (!entry) return;
+
+    clearTimeout(entry.timeout);
+    retiring.delete(streamId);
+
+    console.log(`[HANDOFF] ${streamId}: migration complete, old broadcaster exits`);
+    if (entry.ws.readyState === WebSocket.OPEN) {
+        safeSend(entry.ws, { type: 'handoff-complete' }, 'handoff-complete');
+        entry.ws.close(1000, 'Handoff complete');
+    }
+}
+
+// Re-announce existing viewers to the new broadcaster on a schedule
+function migrateViewers(streamId, ws, viewerIds) {
+    for (let i = 0; i < viewerIds.length; i += CONFIG.HANDOFF_BATCH_SIZE) {
+        const batch = viewerIds.slice(i, i + CONFIG.HANDOFF_BATCH_SIZE);
+        const delay = (i / CONFIG.HANDOFF_BATCH_SIZE) * CONFIG.HANDOFF_BATCH_INTERVAL_MS;
+
+        setTimeout(() => {
+            const broadcaster = broadcasters.get(streamId);
+            if (!broadcaster || broadcaster.ws !== ws) return;
+
+            batch.forEach(viewerId => {
+                const viewer = getViewerSafe(viewerId);
+                if (!viewer) {
+                    broadcaster.viewers.delete(viewerId);
+                    viewerMigrated(streamId, viewerId);
+                    return;
+                }
+                cleanupPendingOffer(viewerId);
+                safeSend(viewer.ws, { type: 'broadcaster-migrated' }, `broadcaster-migrated ${viewerId}`);
+                const connInfo = connections.get(viewer.ws);
+                safeSend(ws, {
+                    type: 'viewer-joined',
+                    viewer_id: viewerId,
+                    network: connInfo ? connInfo.network : ''
+                }, `viewer-joined ${viewerId}`);
+            });
+        }, delay);
+    }
+}
+
 function handleJoin(ws, data) {
     const streamId = data.stream_id;
     if (!streamId) {
@@ -383,6 +670,26 @@ function handleJoin(ws, data) {
     connInfo.clientId = viewerId;
     connInfo.clientRole = 'viewer';
 
+    // Resume key: the broadcaster parks a leaving viewer's peer under it. We
+    // issue it, so only the client that held the connection can revive that
+    // peer; on resume it moves to the new connection and the old one is retired.
+    pruneResumeKeys();
+    let resumeKey = typeof data.resume_key === 'string' ? data.resume_key : '';
+    const previous = resumeKey ? resumeKeys.get(resumeKey) : null;
+    const resume = data.resume === true && !!previous && previous.streamId === streamId;
+    if (resume) {
+        const holder = viewers.get(previous.viewerId);
+        if (holder) {
+            // Old connection not noticed dead yet - let the broadcaster park its peer first
+            console.log(`[JOIN] ${viewerId} resumes ${previous.viewerId}, retiring its old connection`);
+            removeViewerAtomic(previous.viewerId, true);
+            if (holder.ws.readyState === WebSocket.OPEN) holder.ws.close(1000, 'Resumed on a new connection');
+        }
+    } else {
+        resumeKey = crypto.randomBytes(16).toString('hex');
+    }
+    resumeKeys.set(resumeKey, { streamId: streamId, viewerId: viewerId, releasedAt: 0 });
+
     // Add viewer to data structures
     broadcaster.viewers.add(viewerId);
     viewers.set(viewerId, {
@@ -390,7 +697,8 @@ function handleJoin(ws, data) {
         streamId: streamId,
         broadcasterId: streamId,
         joinedAt: Date.now(),
-        offerSequence: null
+        offerSequence: null,
+        resumeKey: resumeKey
     });
 
     console.log(`[JOIN] Viewer ${viewerId} joined stream: ${streamId} (total viewers: ${broadcaster.viewers.size})`);
@@ -400,14 +708,18 @@ function handleJoin(ws, data) {
     safeSend(ws, {
         type: 'joined',
         viewer_id: viewerId,
-        stream_id: streamId
+        stream_id: streamId,
+        resume_key: resumeKey
     }, 'joined');
 
     // Notify broadcaster - no arbitrary delay, just send immediately
     // The broadcaster (Pi) should handle queuing internally if needed
     safeSend(broadcaster.ws, {
         type: 'viewer-joined',
-        viewer_id: viewerId
+        viewer_id: viewerId,
+        client_id: resumeKey,
+        network: connInfo.network,
+        resume: resume
     }, `viewer-joined ${viewerId}`);
 }
 
@@ -462,7 +774,8 @@ function handleOffer(ws, data) {
         type: 'offer',
         from: viewer.broadcasterId,
         sdp: data.sdp,
-        sequence: sequence
+        sequence: sequence,
+        ice_restart: data.ice_restart === true
     }, `offer to ${viewerId}`);
 
     if (!sent) {
@@ -470,6 +783,11 @@ function handleOffer(ws, data) {
         cleanupPendingOffer(viewerId);
         console.log(`[OFFER] Failed to send offer to ${viewerId}, viewer may have disconnected`);
     }
+
+    const broadcaster = broadcasters.get(viewer.broadcasterId);
+    if (broadcaster && broadcaster.ws === ws) {
+        viewerMigrated(viewer.broadcasterId, viewerId);
+    }
 }
 
 function handleAnswer(ws, data) {
@@ -542,6 +860,188 @@ function handleIceCandidate(ws, data) {
     }
 }
 
+function handleIceRestartRequest(ws, data) {
+    // Viewer changed networks - ask its broadcaster for an ICE restart offer
+    const connInfo = connections.get(ws);
+    const viewerId = connInfo ? connInfo.clientId : null;
+    const viewer = viewerId ? getViewerSafe(viewerId) : null;
+    if (!viewer) {
+        console.log(`[ICE-RESTART] Request from unknown viewer`);
+        return;
+    }
+
+    const broadcaster = getBroadcasterSafe(viewer.broadcasterId);
+    if (!broadcaster) {
+        console.log(`[ICE-RESTART] Broadcaster not found for ${viewerId}`);
+        return;
+    }
+
+    console.log(`[ICE-RESTART] Forwarding restart request from ${viewerId}`);
+    safeSend(broadcaster.ws, {
+        type: 'ice-restart-request',
+        from: viewerId
+    }, `ice-restart-request from ${viewerId}`);
+}
+
+function handleViewerStats(ws, data) {
+    // Viewer-measured latency - the broadcaster aggregates it into its metrics
+    const connInfo = connections.get(ws);
+    const viewerId = connInfo ? connInfo.clientId : null;
+    const viewer = viewerId ? getViewerSafe(viewerId) : null;
+    if (!viewer) return;
+
+    const broadcaster = getBroadcasterSafe(viewer.broadcasterId);
+    if (!broadcaster) return;
+
+    const ms = (value) => (Number.isFinite(value) && value >= 0 && value < 60000) ? value : -1;
+    safeSend(broadcaster.ws, {
+        type: 'viewer-stats',
+        from: viewerId,
+        e2e_ms: ms(data.e2e_ms),
+        jitter_buffer_ms: ms(data.jitter_buffer_ms),
+        playout_delay: data.playout_delay === true
+    }, `viewer-stats from ${viewerId}`);
+}
+
+function handleTimeshift(ws, data) {
+    // Viewer wants to watch from the broadcaster's DVR (offset_s 0 = live)
+    const connInfo = connections.get(ws);
+    const viewerId = connInfo ? connInfo.clientId : null;
+    const viewer = viewerId ? getViewerSafe(viewerId) : null;
+    if (!viewer) return;
+
+    const broadcaster = getBroadcasterSafe(viewer.broadcasterId);
+    if (!broadcaster) return;
+
+    const offset = Number.isFinite(data.offset_s) && data.offset_s > 0 ? Math.min(data.offset_s, 86400) : 0;
+    const speed = Number.isFinite(data.speed) && data.speed >= 1 ? Math.min(data.speed, 8) : 1;
+    console.log(`[DVR] ${viewerId} requests ${offset ? offset + 's back at ' + speed + 'x' : 'live'}`);
+    safeSend(broadcaster.ws, {
+        type: 'timeshift',
+        from: viewerId,
+        offset_s: offset,
+        speed: speed
+    }, `timeshift from ${viewerId}`);
+}
+
+function handleTimeshiftState(ws, data) {
+    // Broadcaster reports where a viewer's playback ended up
+    const connInfo = connections.get(ws);
+    if (!connInfo || connInfo.clientRole !== 'broadcaster') return;
+
+    const viewer = data.to ? getViewerSafe(data.to) : null;
+    if (!viewer || viewer.broadcasterId !== connInfo.clientId) return;
+
+    safeSend(viewer.ws, {
+        type: 'timeshift-state',
+        behind_s: Number.isFinite(data.behind_s) ? data.behind_s : 0,
+        live: data.live === true
+    }, `timeshift-state to ${data.to}`);
+}
+
+function handleEvent(ws, data) {
+    // Motion/alarm event: the broadcaster exports a clip around it. Viewers
+    // address the broadcaster they joined; sensor bridges name the stream,
+    // must present EVENT_TOKEN and get no clip-status back.
+    const connInfo = connections.get(ws);
+    const viewerId = connInfo && connInfo.clientRole === 'viewer' ? connInfo.clientId : null;
+    const viewer = viewerId ? getViewerSafe(viewerId) : null;
+
+    let streamId = null;
+    if (viewer) {
+        streamId = viewer.broadcasterId;
+    } else if (isSensorToken(data.token)) {
+        streamId = data.stream_id;
+    } else {
+        console.log(`[EVENT] Refused event from unjoined client without a valid token`);
+        return;
+    }
+
+    const broadcaster = streamId ? getBroadcasterSafe(streamId) : null;
+    if (!broadcaster) {
+        console.log(`[EVENT] No broadcaster for event from ${viewerId || 'sensor'}`);
+        return;
+    }
+
+    const now = Date.now();
+    if (broadcaster.lastEventAt && now - broadcaster.lastEventAt < CONFIG.EVENT_COOLDOWN_MS) {
+        console.log(`[EVENT] Dropped event for ${streamId} (cooldown)`);
+        if (viewerId) {
+            safeSend(ws, { type: 'clip-status', clip: 'Clip', status: 'dropped (too soon after the last event)' },
+                     `clip-status to ${viewerId}`);
+        }
+        return;
+    }
+    broadcaster.lastEventAt = now;
+
+    const event = typeof data.event === 'string' && data.event ? data.event.slice(0, 64) : 'event';
+    console.log(`[EVENT] '${event}' for ${streamId} from ${viewerId || 'sensor'}`);
+    safeSend(broadcaster.ws, {
+        type: 'event',
+        from: viewerId,
+        event: event
+    }, `event to ${streamId}`);
+}
+
+function isSensorToken(token) {
+    if (!EVENT_TOKEN || typeof token !== 'string') return false;
+    const expected = Buffer.from(EVENT_TOKEN);
+    const given = Buffer.from(token);
+    return given.length === expected.length && crypto.timingSafeEqual(given, expected);
+}
+
+function handleClipStatus(ws, data) {
+    // Broadcaster reports a clip started/written/failed to the viewer that asked
+    const connInfo = connections.get(ws);
+    if (!connInfo || connInfo.clientRole !== 'broadcaster') return;
+
+    const viewer = data.to ? getViewerSafe(data.to) : null;
+    if (!viewer || viewer.broadcasterId !== connInfo.clientId) return;
+
+    safeSend(viewer.ws, {
+        type: 'clip-status',
+        clip: data.clip,
+        status: data.status
+    }, `clip-status to ${data.to}`);
+}
+
+function handleSnapshot(ws, data) {
+    // Broadcaster answers a snapshot-request: hand the JPEG to every HTTP
+    // request waiting on it and keep it for SNAPSHOT_CACHE_MS
+    const connInfo = connections.get(ws);
+    if (!connInfo || connInfo.clientRole !== 'broadcaster') return;
+
+    const entry = snapshots.get(`${connInfo.clientId}:${data.width}`);
+    if (!entry || entry.requestId !== data.request_id) return;
+
+    clearTimeout(entry.timeout);
+    entry.requestId = null;
+    const jpeg = typeof data.jpeg === 'string' && data.jpeg ? Buffer.from(data.jpeg, 'base64') : null;
+    if (jpeg) {
+        entry.jpeg = jpeg;
+        entry.ageMs = Number.isFinite(data.age_ms) ? data.age_ms : 0;
+        entry.at = Date.now();
+    }
+
+    const waiters = entry.waiters;
+    entry.waiters = [];
+    waiters.forEach(res => sendSnapshot(res, jpeg ? entry : null, 502));
+}
+
+function sendSnapshot(res, entry, failureStatus) {
+    if (!entry) {
+        res.status(failureStatus).json({ error: failureStatus === 504 ? 'Snapshot timed out' : 'No snapshot available' });
+        return;
+    }
+    res.set({
+        'Content-Type': 'image/jpeg',
+        'Cache-Control': 'no-cache',
+        // How old the keyframe in the picture was when it was served
+        'X-Keyframe-Age-Ms': String(entry.ageMs + (Date.now() - entry.at))
+    });
+    res.send(entry.jpeg);
+}
+
 function handleCleanupAck(ws, data) {
     // Broadcaster acknowledges cleanup of a viewer
     const viewerId = data.viewer_id;
@@ -551,6 +1051,37 @@ function handleCleanupAck(ws, data) {
     // For now, just log it
 }
 
+function handleViewerReclaimed(ws, data) {
+    // Broadcaster tore down a dead peer on its own (ICE failed, silent viewer, ...)
+    const connInfo = connections.get(ws);
+    if (!connInfo || connInfo.clientRole !== 'broadcaster') return;
+
+    const viewerId = data.viewer_id;
+    const viewer = viewers.get(viewerId);
+    if (!viewer || viewer.broadcasterId !== connInfo.clientId) {
+        console.log(`[RECLAIM] Ignoring reclaim of ${viewerId} from ${connInfo.clientId} (not its viewer)`);
+        return;
+    }
+    console.log(`[RECLAIM] Broadcaster reclaimed ${viewerId} (reason: ${data.reason})`);
+
+    // If the viewer is actually still around, let it rejoin right away
+    safeSend(viewer.ws, { type: 'peer-reclaimed', reason: data.reason }, `peer-reclaimed ${viewerId}`);
+
+    // Broadcaster already cleaned up - don't send viewer-left back
+    removeViewerAtomic(viewerId, false);
+}
+
+function handleMetrics(ws, data) {
+    const connInfo = connections.get(ws);
+    if (!connInfo || connInfo.clientRole !== 'broadcaster') return;
+
+    const broadcaster = broadcasters.get(connInfo.clientId);
+    if (broadcaster && broadcaster.ws === ws) {
+        broadcaster.metrics = data.metrics;
+        broadcaster.metricsUpdatedAt = Date.now();
+    }
+}
+
 function handleDisconnect(ws) {
     const connInfo = connections.get(ws);
 
@@ -562,9 +1093,31 @@ function handleDisconnect(ws) {
 
     const { clientId, clientRole } = connInfo;
 
+    // Incoming broadcaster died mid-handoff - the old one keeps serving
+    const pendingHandoff = clientId ? handoffs.get(clientId) : null;
+    if (pendingHandoff && pendingHandoff.ws === ws) {
+        console.log(`[HANDOFF] Incoming broadcaster for ${clientId} disconnected`);
+        abortHandoff(clientId, 'new broadcaster disconnected');
+        connections.delete(ws);
+        return;
+    }
+
+    // Outgoing broadcaster gone while viewers were being migrated
+    const retired = clientId ? retiring.get(clientId) : null;
+    if (retired && retired.ws === ws) {
+        console.log(`[HANDOFF] Old broadcaster for ${clientId} exited during migration`);
+        clearTimeout(retired.timeout);
+        retiring.delete(clientId);
+    }
+
     if (clientRole === 'broadcaster' && clientId) {
         const broadcaster = broadcasters.get(clientId);
-        if (broadcaster && broadcaster.ws === ws) {
+        if (broadcaster && broadcaster.ws === ws && handoffs.has(clientId)) {
+            // Old broadcaster exited before confirming release - hand over now,
+            // its viewers are migrated once the new process is ready
+            console.log(`[HANDOFF] Old broadcaster for ${clientId} disconnected during handoff`);
+            releaseOldBroadcaster(clientId);
+        } else if (broadcaster && broadcaster.ws === ws) {
             console.log(`[DISCONNECT] Broadcaster disconnected: ${clientId}, notifying ${broadcaster.viewers.size} viewers`);
 
             // Notify all viewers and clean them up
@@ -578,6 +1131,12 @@ function handleDisconnect(ws) {
             });
 
             broadcasters.delete(clientId);
+            retireOldBroadcaster(clientId);
+
+            // Cached pictures go with it; pending ones still time out
+            for (const key of snapshots.keys()) {
+                if (key.startsWith(`${clientId}:`)) snapshots.delete(key);
+            }
         }
     } else if (clientRole === 'viewer' && clientId) {
         console.log(`[DISCONNECT] Viewer disconnected: ${clientId}`);
@@ -636,11 +1195,59 @@ app.get('/metrics', (req, res) => {
         pendingOffers: pendingOffers.size,
         memoryUsage: process.memoryUsage(),
         uptime: process.uptime(),
-        timestamp: Date.now()
+        timestamp: Date.now(),
+        // Latest snapshot published by each broadcaster process
+        streams: Object.fromEntries(Array.from(broadcasters.entries()).map(([id, b]) => [id, {
+            updatedAt: b.metricsUpdatedAt || null,
+            metrics: b.metrics || null
+        }]))
     };
     res.json(metrics);
 });
 
+// JPEG of a stream's latest keyframe: /snapshot/<stream>.jpg?width=320
+// Requests within SNAPSHOT_CACHE_MS share one picture and concurrent misses
+// share one round trip to the broadcaster, which itself decodes once per GOP.
+app.get('/snapshot/:stream', (req, res) => {
+    const streamId = req.params.stream.replace(/\.jpe?g$/, '');
+    const requested = parseInt(req.query.width, 10);
+    const width = Number.isFinite(requested) ? Math.min(Math.max(requested, 0), CONFIG.SNAPSHOT_MAX_WIDTH) : 320;
+
+    const broadcaster = getBroadcasterSafe(streamId);
+    if (!broadcaster) {
+        res.status(404).json({ error: 'Stream not found' });
+        return;
+    }
+
+    const key = `${streamId}:${width}`;
+    let entry = snapshots.get(key);
+    if (!entry) {
+        entry = { jpeg: null, ageMs: 0, at: 0, requestId: null, waiters: [], timeout: null };
+        snapshots.set(key, entry);
+    }
+    if (entry.jpeg && Date.now() - entry.at < CONFIG.SNAPSHOT_CACHE_MS) {
+        sendSnapshot(res, entry);
+        return;
+    }
+
+    entry.waiters.push(res);
+    if (entry.requestId) return;
+
+    entry.requestId = `snap-${snapshotSequence++}`;
+    entry.timeout = setTimeout(() => {
+        console.log(`[SNAPSHOT] ${streamId} did not answer within ${CONFIG.SNAPSHOT_TIMEOUT_MS}ms`);
+        entry.requestId = null;
+        const waiters = entry.waiters;
+        entry.waiters = [];
+        waiters.forEach(waiter => sendSnapshot(waiter, null, 504));
+    }, CONFIG.SNAPSHOT_TIMEOUT_MS);
+    safeSend(broadcaster.ws, {
+        type: 'snapshot-request',
+        request_id: entry.requestId,
+        width: width
+    }, `snapshot-request to ${streamId}`);
+});
+
 // TURN credentials endpoint
 app.get('/turn-credentials', (req, res) => {
     const creds = generateTurnCredentials();
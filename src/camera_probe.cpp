@@ -0,0 +1,548 @@
+#include "camera_probe.h"
+#include <gst/gst.h>
+#include <json/json.h>
+#include <iostream>
+#include <chrono>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <mutex>
+#include <cmath>
+#include <ctime>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/videodev2.h>
+
+// ==================== DEBUG LOGGING ====================
+#define DEBUG_LOGGING 1
+
+static std::string getTimestamp() {
+    auto now = std::chrono::system_clock::now();
+    auto time = std::chrono::system_clock::to_time_t(now);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        now.time_since_epoch()) % 1000;
+    std::stringstream ss;
+    ss << std::put_time(std::localtime(&time), "%H:%M:%S")
+       << "." << std::setfill('0') << std::setw(3) << ms.count();
+    return ss.str();
+}
+
+#if DEBUG_LOGGING
+#define LOG(category, msg) \
+    std::cout << "[" << getTimestamp() << "] [" << category << "] " << msg << std::endl
+#define LOG_VAR(category, msg, var) \
+    std::cout << "[" << getTimestamp() << "] [" << category << "] " << msg << var << std::endl
+#else
+#define LOG(category, msg)
+#define LOG_VAR(category, msg, var)
+#endif
+
+// ioctl() that retries on EINTR
+static int xioctl(int fd, unsigned long request, void* arg) {
+    int ret;
+    do {
+        ret = ioctl(fd, request, arg);
+    } while (ret == -1 && errno == EINTR);
+    return ret;
+}
+
+// ============================================================================
+// Mode cache
+// ============================================================================
+
+static std::mutex cache_mutex;
+static std::string cache_file;
+static bool cache_file_set = false;
+static bool cache_loaded = false;
+static Json::Value cache_root(Json::objectValue);
+
+static std::string defaultCacheFile() {
+    const char* xdg = std::getenv("XDG_CACHE_HOME");
+    const char* home = std::getenv("HOME");
+    std::string base = xdg && xdg[0] ? xdg : (home && home[0] ? std::string(home) + "/.cache" : "/tmp");
+    return base + "/webrtc_streamer/camera_modes.json";
+}
+
+void CameraProbe::setCacheFile(const std::string& path) {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    cache_file = path;
+    cache_file_set = true;
+    cache_loaded = false;
+    cache_root = Json::Value(Json::objectValue);
+}
+
+// Caller holds cache_mutex
+static void loadCache() {
+    if (cache_loaded) {
+        return;
+    }
+    cache_loaded = true;
+    if (!cache_file_set) {
+        cache_file = defaultCacheFile();
+        cache_file_set = true;
+    }
+    if (cache_file.empty()) {
+        return;
+    }
+
+    std::ifstream in(cache_file);
+    if (!in) {
+        return;
+    }
+    Json::CharReaderBuilder builder;
+    std::string errors;
+    if (!Json::parseFromStream(builder, in, &cache_root, &errors) || !cache_root.isObject()) {
+        LOG("CAMERA-WARN", "Ignoring unreadable mode cache " << cache_file);
+        cache_root = Json::Value(Json::objectValue);
+    }
+}
+
+bool CameraProbe::cacheLookup(const std::string& key, std::vector<Mode>& modes) {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    loadCache();
+    if (cache_file.empty() || !cache_root.isMember(key)) {
+        return false;
+    }
+
+    modes.clear();
+    for (const auto& entry : cache_root[key]["modes"]) {
+        Mode mode;
+        mode.format = entry["format"].asString();
+        mode.width = entry["width"].asInt();
+        mode.height = entry["height"].asInt();
+        mode.max_fps = entry["max_fps"].asDouble();
+        mode.compressed = entry["compressed"].asBool();
+        mode.crop_width = entry["crop_width"].asInt();
+        mode.crop_height = entry["crop_height"].asInt();
+        modes.push_back(mode);
+    }
+    return !modes.empty();
+}
+
+void CameraProbe::cacheStore(const std::string& key, const std::vector<Mode>& modes) {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    loadCache();
+    if (cache_file.empty() || modes.empty()) {
+        return;
+    }
+
+    Json::Value list(Json::arrayValue);
+    for (const auto& mode : modes) {
+        Json::Value entry;
+        entry["format"] = mode.format;
+        entry["width"] = mode.width;
+        entry["height"] = mode.height;
+        entry["max_fps"] = mode.max_fps;
+        entry["compressed"] = mode.compressed;
+        entry["crop_width"] = mode.crop_width;
+        entry["crop_height"] = mode.crop_height;
+        list.append(entry);
+    }
+    cache_root[key]["modes"] = list;
+    cache_root[key]["saved"] = static_cast<Json::Int64>(time(nullptr));
+
+    // mkdir -p of the cache directory
+    std::string dir = cache_file.substr(0, cache_file.rfind('/'));
+    for (size_t pos = 1; pos != std::string::npos && !dir.empty(); ) {
+        pos = dir.find('/', pos + 1);
+        mkdir(dir.substr(0, pos).c_str(), 0755);
+    }
+
+    std::ofstream out(cache_file);
+    if (!out) {
+        LOG("CAMERA-WARN", "Cannot write mode cache " << cache_file);
+        return;
+    }
+    Json::StreamWriterBuilder writer;
+    writer["indentation"] = "  ";
+    out << Json::writeString(writer, cache_root) << std::endl;
+}
+
+// ============================================================================
+// Enumeration
+// ============================================================================
+
+std::string CameraProbe::fourccName(uint32_t fourcc) {
+    std::string name;
+    for (int i = 0; i < 4; i++) {
+        char c = static_cast<char>((fourcc >> (8 * i)) & 0xff);
+        if (c != ' ' && c != '\0') {
+            name += c;
+        }
+    }
+    return name;
+}
+
+double CameraProbe::maxFps(int fd, uint32_t pixelformat, int width, int height) {
+    double best = 0;
+
+    v4l2_frmivalenum ival;
+    memset(&ival, 0, sizeof(ival));
+    ival.pixel_format = pixelformat;
+    ival.width = width;
+    ival.height = height;
+    for (ival.index = 0; xioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &ival) == 0; ival.index++) {
+        const v4l2_fract& interval = ival.type == V4L2_FRMIVAL_TYPE_DISCRETE ? ival.discrete : ival.stepwise.min;
+        if (interval.numerator > 0) {
+            best = std::max(best, static_cast<double>(interval.denominator) / interval.numerator);
+        }
+        if (ival.type != V4L2_FRMIVAL_TYPE_DISCRETE) {
+            break;
+        }
+    }
+
+    // Some drivers don't enumerate intervals at all
+    return best > 0 ? best : 30.0;
+}
+
+std::vector<CameraProbe::Mode> CameraProbe::enumerateV4l2(int fd) {
+    std::vector<Mode> modes;
+
+    v4l2_fmtdesc fmt;
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    for (fmt.index = 0; xioctl(fd, VIDIOC_ENUM_FMT, &fmt) == 0; fmt.index++) {
+        std::vector<std::pair<int, int>> sizes;
+
+        v4l2_frmsizeenum size;
+        memset(&size, 0, sizeof(size));
+        size.pixel_format = fmt.pixelformat;
+        for (size.index = 0; xioctl(fd, VIDIOC_ENUM_FRAMESIZES, &size) == 0; size.index++) {
+            if (size.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
+                sizes.push_back({static_cast<int>(size.discrete.width), static_cast<int>(size.discrete.height)});
+                continue;
+            }
+            // Stepwise/continuous: the common sizes inside the range, plus the maximum
+            static const std::pair<int, int> common[] = {{640, 480}, {1280, 720}, {1920, 1080}};
+            for (const auto& c : common) {
+                if (c.first >= static_cast<int>(size.stepwise.min_width) &&
+                    c.first <= static_cast<int>(size.stepwise.max_width) &&
+                    c.second >= static_cast<int>(size.stepwise.min_height) &&
+                    c.second <= static_cast<int>(size.stepwise.max_height)) {
+                    sizes.push_back(c);
+                }
+            }
+            sizes.push_back({static_cast<int>(size.stepwise.max_width), static_cast<int>(size.stepwise.max_height)});
+            break;
+        }
+
+        for (const auto& wh : sizes) {
+            Mode mode;
+            mode.format = fourccName(fmt.pixelformat);
+            mode.width = wh.first;
+            mode.height = wh.second;
+            mode.max_fps = maxFps(fd, fmt.pixelformat, wh.first, wh.second);
+            mode.compressed = fmt.flags & V4L2_FMT_FLAG_COMPRESSED;
+            mode.crop_width = wh.first;
+            mode.crop_height = wh.second;
+            modes.push_back(mode);
+        }
+    }
+    return modes;
+}
+
+std::vector<CameraProbe::Mode> CameraProbe::listModes(const std::string& device) {
+    int fd = open(device.c_str(), O_RDWR | O_NONBLOCK);
+    if (fd < 0) {
+        LOG("CAMERA-ERROR", "Cannot open " << device << ": " << strerror(errno));
+        return {};
+    }
+
+    // Key by what is plugged in, not just the node name
+    v4l2_capability cap;
+    memset(&cap, 0, sizeof(cap));
+    xioctl(fd, VIDIOC_QUERYCAP, &cap);
+    std::string key = "v4l2:" + device + "|" + reinterpret_cast<const char*>(cap.card) +
+                      "|" + reinterpret_cast<const char*>(cap.bus_info);
+
+    std::vector<Mode> modes;
+    if (cacheLookup(key, modes)) {
+        close(fd);
+        LOG("CAMERA", device << ": " << modes.size() << " modes (cached)");
+        return modes;
+    }
+
+    gint64 started_us = g_get_monotonic_time();
+    modes = enumerateV4l2(fd);
+    close(fd);
+
+    LOG("CAMERA", device << " (" << cap.card << "): " << modes.size() << " modes enumerated in "
+        << (g_get_monotonic_time() - started_us) / 1000 << "ms");
+    cacheStore(key, modes);
+    return modes;
+}
+
+std::vector<CameraProbe::Mode> CameraProbe::enumerateSensor() {
+    std::vector<Mode> modes;
+
+    // rpicam-apps (Bookworm) or libcamera-apps (Bullseye)
+    FILE* pipe = popen("rpicam-hello --list-cameras 2>/dev/null || libcamera-hello --list-cameras 2>/dev/null", "r");
+    if (!pipe) {
+        return modes;
+    }
+
+    // Lines look like (the format is only on the first line of its group):
+    //   0 : imx219 [3280x2464 10-bit RGGB] (/base/soc/i2c0mux/i2c@1/imx219@10)
+    //       Modes: 'SRGGB10_CSI2P' : 640x480 [206.65 fps - (1000, 752)/1280x960 crop]
+    //                                1640x1232 [41.85 fps - (0, 0)/3280x2464 crop]
+    std::string format;
+    int cameras = 0;
+    char buf[512];
+    while (fgets(buf, sizeof(buf), pipe)) {
+        std::string line(buf);
+
+        int index;
+        if (sscanf(line.c_str(), " %d : ", &index) == 1 && line.find(" : ") != std::string::npos &&
+            line.find("Modes:") == std::string::npos && line.find('\'') == std::string::npos) {
+            // Only the first camera
+            if (++cameras > 1) break;
+            continue;
+        }
+
+        size_t quote = line.find('\'');
+        if (quote != std::string::npos) {
+            size_t end = line.find('\'', quote + 1);
+            format = line.substr(quote + 1, end - quote - 1);
+            line = line.substr(line.find(':', end) + 1);
+        }
+
+        Mode mode;
+        int crop_x, crop_y;
+        if (!format.empty() &&
+            sscanf(line.c_str(), " %dx%d [%lf fps - (%d, %d)/%dx%d crop]", &mode.width, &mode.height,
+                   &mode.max_fps, &crop_x, &crop_y, &mode.crop_width, &mode.crop_height) == 7) {
+            mode.format = format;
+            modes.push_back(mode);
+        }
+    }
+    pclose(pipe);
+    return modes;
+}
+
+std::vector<CameraProbe::Mode> CameraProbe::listSensorModes() {
+    const std::string key = "libcamera:0";
+
+    std::vector<Mode> modes;
+    if (cacheLookup(key, modes)) {
+        LOG("CAMERA", "libcamera: " << modes.size() << " sensor modes (cached)");
+        return modes;
+    }
+
+    gint64 started_us = g_get_monotonic_time();
+    modes = enumerateSensor();
+    LOG("CAMERA", "libcamera: " << modes.size() << " sensor modes enumerated in "
+        << (g_get_monotonic_time() - started_us) / 1000 << "ms");
+    cacheStore(key, modes);
+    return modes;
+}
+
+// ============================================================================
+// Selection
+// ============================================================================
+
+// Cost of turning a capture format into encoder input: 0 = none, higher = more work
+static int formatCost(const CameraProbe::Mode& mode, bool allow_h264) {
+    if (mode.format == "H264") return allow_h264 ? 0 : -1;
+    if (mode.format == "NV12" || mode.format == "YU12" || mode.format == "YV12") return 1;
+    if (mode.format == "MJPG" || mode.format == "JPEG") return 3;
+    if (mode.compressed) return -1;     // H.265, MPEG-TS etc. - not handled
+    return 2;                           // YUYV, UYVY, RGB...: pixel format conversion
+}
+
+// 0 = exact, 1 = downscale same aspect, 2 = downscale other aspect, 3 = upscale
+static int sizeCost(const CameraProbe::Mode& mode, int width, int height) {
+    if (mode.width == width && mode.height == height) return 0;
+    if (mode.width >= width && mode.height >= height) {
+        return mode.width * height == mode.height * width ? 1 : 2;
+    }
+    return 3;
+}
+
+static std::string describe(const CameraProbe::Mode& mode) {
+    std::ostringstream out;
+    out << mode.format << " " << mode.width << "x" << mode.height << "@" << std::floor(mode.max_fps);
+    return out.str();
+}
+
+CameraProbe::Selection CameraProbe::selectMode(const std::string& device, int width, int height, int fps,
+                                               bool allow_h264, const std::string& only_format) {
+    Selection selection;
+    std::vector<Mode> modes = listModes(device);
+
+    const Mode* best = nullptr;
+    auto key = [&](const Mode& m) {
+        bool fps_ok = m.max_fps + 0.5 >= fps;
+        int size = sizeCost(m, width, height);
+        int area = m.width * m.height;
+        // Too slow last; then least scaling, least conversion, then the
+        // smallest frame above the profile (or largest below it)
+        return std::make_tuple(!fps_ok, size, formatCost(m, allow_h264), size == 3 ? -area : area, -m.max_fps);
+    };
+
+    for (const auto& mode : modes) {
+        int cost = formatCost(mode, allow_h264);
+        // The camera's H.264 can't be scaled without decoding it
+        if (cost < 0 || (mode.format == "H264" && sizeCost(mode, width, height) != 0)) {
+            continue;
+        }
+        if (!only_format.empty() && (only_format == "raw" ? mode.compressed : mode.format != only_format)) {
+            continue;
+        }
+        if (!best || key(mode) < key(*best)) {
+            best = &mode;
+        }
+    }
+
+    if (!best) {
+        selection.reason = modes.empty() ? "no modes enumerated" : "no usable capture format";
+        return selection;
+    }
+
+    selection.found = true;
+    selection.mode = *best;
+    selection.fps = best->max_fps + 0.5 >= fps ? fps : std::max(1, static_cast<int>(best->max_fps));
+    selection.h264 = best->format == "H264";
+    selection.jpeg = best->format == "MJPG" || best->format == "JPEG";
+    selection.convert = formatCost(*best, allow_h264) == 2;
+    selection.scale = sizeCost(*best, width, height) != 0;
+
+    std::ostringstream reason;
+    reason << describe(*best) << " for " << width << "x" << height << "@" << fps << ": ";
+    reason << (selection.scale ? "scaled" : "exact size");
+    reason << (selection.h264 ? ", camera-encoded (no x264)" :
+               selection.jpeg ? ", JPEG decode" :
+               selection.convert ? ", pixel format conversion" : ", encoder-native format");
+    if (selection.fps < fps) {
+        reason << ", only " << selection.fps << " fps possible";
+    }
+    // Say what a cheaper format lost on
+    for (const auto& mode : modes) {
+        int cost = formatCost(mode, allow_h264);
+        if (only_format.empty() && cost >= 0 && cost < formatCost(*best, allow_h264) &&
+            sizeCost(mode, width, height) == 0 &&
+            mode.max_fps + 0.5 < fps) {
+            reason << " (" << describe(mode) << " too slow)";
+            break;
+        }
+    }
+    selection.reason = reason.str();
+    return selection;
+}
+
+CameraProbe::Selection CameraProbe::selectSensorMode(int width, int height, int fps) {
+    Selection selection;
+    std::vector<Mode> modes = listSensorModes();
+
+    const Mode* best = nullptr;
+    auto key = [&](const Mode& m) {
+        bool fps_ok = m.max_fps + 0.5 >= fps;
+        bool covers = m.width >= width && m.height >= height;
+        // Fast enough, big enough, widest field of view, then the smallest
+        // readout (binned modes beat full-resolution ones)
+        return std::make_tuple(!fps_ok, !covers, -(m.crop_width * m.crop_height), m.width * m.height);
+    };
+    for (const auto& mode : modes) {
+        if (!best || key(mode) < key(*best)) {
+            best = &mode;
+        }
+    }
+
+    if (!best) {
+        selection.reason = "no sensor modes listed (rpicam-hello missing?)";
+        return selection;
+    }
+
+    selection.found = true;
+    selection.mode = *best;
+    selection.fps = best->max_fps + 0.5 >= fps ? fps : std::max(1, static_cast<int>(best->max_fps));
+    selection.scale = best->width != width || best->height != height;
+
+    std::ostringstream reason;
+    reason << "sensor " << describe(*best) << " (" << best->crop_width << "x" << best->crop_height
+           << " readout) for " << width << "x" << height << "@" << fps;
+    if (selection.scale) {
+        reason << ", ISP scales";
+    }
+    if (selection.fps < fps) {
+        reason << ", only " << selection.fps << " fps possible";
+    }
+    selection.reason = reason.str();
+    return selection;
+}
+
+// V4L2 fourcc -> GStreamer raw format
+static const char* gstFormat(const std::string& fourcc) {
+    if (fourcc == "YUYV") return "YUY2";
+    if (fourcc == "UYVY") return "UYVY";
+    if (fourcc == "NV12") return "NV12";
+    if (fourcc == "YU12") return "I420";
+    if (fourcc == "YV12") return "YV12";
+    return nullptr;
+}
+
+std::string CameraProbe::rawSourceChain(const std::string& device, const Selection& selection,
+                                        int width, int height) {
+    const Mode& mode = selection.mode;
+    std::string rate = "framerate=" + std::to_string(selection.fps) + "/1";
+
+    std::string chain = "v4l2src device=" + device + " ! ";
+    if (!selection.found) {
+        chain += "video/x-raw,width=" + std::to_string(width) + ",height=" + std::to_string(height) +
+                 "," + rate + " ! ";
+    } else {
+        std::string size = "width=" + std::to_string(mode.width) + ",height=" + std::to_string(mode.height);
+        if (selection.jpeg) {
+            // Hardware JPEG decoder if the SoC has one, else libjpeg-turbo (SIMD)
+            GstElementFactory* hw = gst_element_factory_find("v4l2jpegdec");
+            chain += "image/jpeg," + size + "," + rate + " ! " + (hw ? "v4l2jpegdec" : "jpegdec") + " ! ";
+            if (hw) gst_object_unref(hw);
+        } else {
+            const char* format = gstFormat(mode.format);
+            chain += "video/x-raw," + (format ? "format=" + std::string(format) + "," : std::string()) +
+                     size + "," + rate + " ! ";
+        }
+        if (selection.scale) {
+            chain += "videoscale ! video/x-raw,width=" + std::to_string(width) +
+                     ",height=" + std::to_string(height) + " ! ";
+        }
+    }
+
+    // Passes through untouched when the encoder takes the format as-is
+    return chain +
+        "videoconvert ! "
+        "queue max-size-buffers=3 leaky=downstream ! ";
+}
+
+// ============================================================================
+// Controls
+// ============================================================================
+
+bool CameraProbe::setControl(const std::string& device, uint32_t id, int32_t value) {
+    int fd = open(device.c_str(), O_RDWR | O_NONBLOCK);
+    if (fd < 0) {
+        return false;
+    }
+
+    v4l2_control ctrl;
+    memset(&ctrl, 0, sizeof(ctrl));
+    ctrl.id = id;
+    ctrl.value = value;
+    bool ok = xioctl(fd, VIDIOC_S_CTRL, &ctrl) == 0;
+    close(fd);
+    return ok;
+}
+
+bool CameraProbe::forceKeyframe(const std::string& device) {
+    return setControl(device, V4L2_CID_MPEG_VIDEO_FORCE_KEY_FRAME, 1);
+}
+
+bool CameraProbe::setKeyframeInterval(const std::string& device, int frames) {
+    return setControl(device, V4L2_CID_MPEG_VIDEO_H264_I_PERIOD, frames);
+}
@@ -0,0 +1,310 @@
+#include "clip_exporter.h"
+#include "stream_metrics.h"
+#include <gst/rtp/rtp.h>
+#include <iostream>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <cstdio>
+#include <ctime>
+#include <cctype>
+#include <sys/stat.h>
+
+// ==================== DEBUG LOGGING ====================
+#define DEBUG_LOGGING 1
+
+static std::string getTimestamp() {
+    auto now = std::chrono::system_clock::now();
+    auto time = std::chrono::system_clock::to_time_t(now);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        now.time_since_epoch()) % 1000;
+    std::stringstream ss;
+    ss << std::put_time(std::localtime(&time), "%H:%M:%S")
+       << "." << std::setfill('0') << std::setw(3) << ms.count();
+    return ss.str();
+}
+
+#if DEBUG_LOGGING
+#define LOG(category, msg) \
+    std::cout << "[" << getTimestamp() << "] [" << category << "] " << msg << std::endl
+#define LOG_VAR(category, msg, var) \
+    std::cout << "[" << getTimestamp() << "] [" << category << "] " << msg << var << std::endl
+#else
+#define LOG(category, msg)
+#define LOG_VAR(category, msg, var)
+#endif
+
+// Output timestamps for one RTP stream: the RTP clock (unwrapped) from the
+// stream's first packet, offset by when that packet arrived in the clip
+struct ClipClock {
+    guint32 rate;
+    bool started = false;
+    guint32 last_ts = 0;
+    gint64 ext = 0;
+    gint64 first_ext = 0;
+    GstClockTime offset = 0;
+
+    explicit ClipClock(guint32 clock_rate) : rate(clock_rate) {}
+
+    GstClockTime pts(GstBuffer* buffer, gint64 origin_us, gint64 arrival_us) {
+        GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+        if (!gst_rtp_buffer_map(buffer, GST_MAP_READ, &rtp)) {
+            return offset;
+        }
+        guint32 ts = gst_rtp_buffer_get_timestamp(&rtp);
+        gst_rtp_buffer_unmap(&rtp);
+
+        if (!started) {
+            started = true;
+            ext = first_ext = ts;
+            offset = (arrival_us - origin_us) * GST_USECOND;
+        } else {
+            ext += static_cast<gint32>(ts - last_ts);
+        }
+        last_ts = ts;
+
+        gint64 delta = ext - first_ext;
+        return offset + (delta > 0 ? gst_util_uint64_scale(delta, GST_SECOND, rate) : 0);
+    }
+};
+
+ClipExporter::ClipExporter(DvrRing& ring, const Config& config)
+    : ring_(ring)
+    , config_(config)
+    , stop_(false) {
+    // mkdir -p
+    const std::string& dir = config.dir;
+    for (size_t pos = dir.find('/', 1); ; pos = dir.find('/', pos + 1)) {
+        mkdir(dir.substr(0, pos).c_str(), 0755);
+        if (pos == std::string::npos) break;
+    }
+    LOG("CLIP", "Clips of " << config.pre_seconds << "s + " << config.post_seconds
+        << "s to " << config.dir << " (" << config.max_concurrent << " at a time)");
+}
+
+ClipExporter::~ClipExporter() {
+    stop_ = true;
+    ring_.wake();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // A clip thread can be stuck in push-buffer on a full appsrc (e.g. the
+    // muxer waiting on the other stream); flushing is the only way out
+    for (auto& clip : clips_) {
+        std::lock_guard<std::mutex> pipeline_lock(clip.pipeline_mutex);
+        if (clip.pipeline) {
+            gst_element_set_state(clip.pipeline, GST_STATE_NULL);
+        }
+    }
+    for (auto& clip : clips_) {
+        if (clip.thread.joinable()) {
+            clip.thread.join();
+        }
+    }
+    clips_.clear();
+}
+
+void ClipExporter::reapFinished() {
+    for (auto it = clips_.begin(); it != clips_.end();) {
+        if (it->finished) {
+            it->thread.join();
+            it = clips_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+std::string ClipExporter::trigger(const std::string& reason, GstCaps* video_caps, GstCaps* audio_caps,
+                                  const std::string& video_depay, bool webm, Done done) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    reapFinished();
+
+    if ((int)clips_.size() >= config_.max_concurrent) {
+        LOG("CLIP-WARN", clips_.size() << " clips in progress - ignoring '" << reason << "'");
+        StreamMetrics::instance().increment("clips.rejected");
+        return "";
+    }
+
+    // clip_20240131-142501_motion_7
+    static std::atomic<unsigned> sequence{0};
+    char stamp[32];
+    time_t now = time(nullptr);
+    struct tm local;
+    localtime_r(&now, &local);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+    std::string label;
+    for (char c : reason.substr(0, 32)) {
+        label += std::isalnum(static_cast<unsigned char>(c)) || c == '-' ? c : '_';
+    }
+
+    clips_.emplace_back();
+    Clip& clip = clips_.back();
+    clip.name = std::string("clip_") + stamp + (label.empty() ? "" : "_" + label) + "_" +
+                std::to_string(++sequence);
+    clip.path = config_.dir + "/" + clip.name + (webm ? ".webm" : ".mp4");
+    clip.event_us = g_get_monotonic_time();
+    clip.done = done;
+
+    // Caps and the output location are set on the elements afterwards -
+    // RTP caps strings don't survive gst_parse_launch quoting
+    clip.description =
+        std::string(webm ? "webmmux" : "mp4mux faststart=true") + " name=mux ! filesink name=sink "
+        "appsrc name=vsrc ! queue ! " + video_depay + " ! mux. "
+        "appsrc name=asrc ! queue ! rtpopusdepay ! opusparse ! mux.";
+    clip.video_caps = video_caps ? gst_caps_ref(video_caps) : nullptr;
+    clip.audio_caps = audio_caps ? gst_caps_ref(audio_caps) : nullptr;
+
+    LOG("CLIP", clip.name << " started (" << reason << ")");
+    StreamMetrics::instance().increment("clips.started");
+    clip.thread = std::thread(&ClipExporter::run, this, &clip);
+    return clip.name;
+}
+
+void ClipExporter::run(Clip* clip) {
+    gint64 started_us = g_get_monotonic_time();
+    bool ok = writeClip(clip);
+    std::string part = clip->path + ".part";
+
+    if (ok && rename(part.c_str(), clip->path.c_str()) == 0) {
+        LOG("CLIP", clip->name << " written to " << clip->path);
+        StreamMetrics::instance().increment("clips.written");
+        StreamMetrics::instance().recordLatency("clips.write_ms", (g_get_monotonic_time() - started_us) / 1000.0);
+    } else {
+        LOG("CLIP-ERROR", clip->name << " failed");
+        StreamMetrics::instance().increment("clips.failed");
+        remove(part.c_str());
+        ok = false;
+    }
+
+    if (clip->video_caps) gst_caps_unref(clip->video_caps);
+    if (clip->audio_caps) gst_caps_unref(clip->audio_caps);
+    if (clip->done) {
+        clip->done(clip->name, ok ? clip->path : "");
+    }
+    clip->finished = true;
+}
+
+bool ClipExporter::writeClip(Clip* clip) {
+    GError* error = nullptr;
+    GstElement* pipeline = gst_parse_launch(clip->description.c_str(), &error);
+    if (!pipeline) {
+        LOG("CLIP-ERROR", "Cannot build muxer: " << (error ? error->message : "unknown error"));
+        g_clear_error(&error);
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(clip->pipeline_mutex);
+        clip->pipeline = pipeline;
+    }
+
+    GstElement* vsrc = gst_bin_get_by_name(GST_BIN(pipeline), "vsrc");
+    GstElement* asrc = gst_bin_get_by_name(GST_BIN(pipeline), "asrc");
+    GstElement* sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    for (GstElement* src : {vsrc, asrc}) {
+        g_object_set(src,
+                     "format", GST_FORMAT_TIME,
+                     "block", TRUE,
+                     "max-bytes", APPSRC_MAX_BYTES,
+                     nullptr);
+    }
+    if (clip->video_caps) g_object_set(vsrc, "caps", clip->video_caps, nullptr);
+    if (clip->audio_caps) g_object_set(asrc, "caps", clip->audio_caps, nullptr);
+    g_object_set(sink, "location", (clip->path + ".part").c_str(), nullptr);
+    gst_object_unref(sink);
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+    DvrRing::Reader reader;
+    bool ok = ring_.seek(reader, clip->event_us - (gint64)config_.pre_seconds * G_USEC_PER_SEC);
+    gint64 end_us = clip->event_us + (gint64)config_.post_seconds * G_USEC_PER_SEC;
+    gint64 origin_us = -1;
+    gint64 last_packet_us = g_get_monotonic_time();
+    ClipClock video_clock(90000);
+    ClipClock audio_clock(48000);
+    bool discont = false;
+    guint64 packets = 0;
+
+    while (ok && !stop_) {
+        DvrRing::Packet packet;
+        DvrRing::ReadResult result = ring_.read(reader, packet, 200);
+
+        if (result == DvrRing::ReadResult::Gone) {
+            // Fell behind eviction - the reader moved on to the next keyframe
+            StreamMetrics::instance().increment("clips.skips");
+            discont = true;
+            continue;
+        }
+        if (result == DvrRing::ReadResult::Timeout) {
+            if (g_get_monotonic_time() - last_packet_us > (gint64)STALL_TIMEOUT_MS * 1000) {
+                LOG("CLIP-WARN", clip->name << ": no media for " << STALL_TIMEOUT_MS
+                    << "ms - ending early");
+                break;
+            }
+            continue;
+        }
+        last_packet_us = g_get_monotonic_time();
+
+        if (packet.arrival_us > end_us) {
+            gst_buffer_unref(packet.buffer);
+            break;
+        }
+        if (origin_us < 0) {
+            origin_us = packet.arrival_us;
+        }
+
+        ClipClock& clock = packet.video ? video_clock : audio_clock;
+        GstClockTime pts = clock.pts(packet.buffer, origin_us, packet.arrival_us);
+        GstBuffer* buffer = gst_buffer_make_writable(packet.buffer);   // The ring keeps its own
+        GST_BUFFER_PTS(buffer) = pts;
+        GST_BUFFER_DTS(buffer) = pts;
+        if (discont) {
+            GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DISCONT);
+            discont = false;
+        }
+
+        GstFlowReturn ret = GST_FLOW_OK;
+        g_signal_emit_by_name(packet.video ? vsrc : asrc, "push-buffer", buffer, &ret);
+        gst_buffer_unref(buffer);
+        if (ret != GST_FLOW_OK) {
+            LOG("CLIP-WARN", clip->name << ": muxer refused data (" << gst_flow_get_name(ret) << ")");
+            ok = false;
+        }
+        packets++;
+    }
+    ok = ok && packets > 0 && !stop_;
+
+    // Let the muxer write its index
+    GstFlowReturn ret;
+    g_signal_emit_by_name(vsrc, "end-of-stream", &ret);
+    g_signal_emit_by_name(asrc, "end-of-stream", &ret);
+    gst_object_unref(vsrc);
+    gst_object_unref(asrc);
+
+    if (ok) {
+        GstBus* bus = gst_element_get_bus(pipeline);
+        GstMessage* msg = gst_bus_timed_pop_filtered(bus, (GstClockTime)FINALIZE_TIMEOUT_MS * GST_MSECOND,
+            static_cast<GstMessageType>(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+        if (!msg || GST_MESSAGE_TYPE(msg) == GST_MESSAGE_ERROR) {
+            if (msg) {
+                GError* err = nullptr;
+                gst_message_parse_error(msg, &err, nullptr);
+                LOG("CLIP-ERROR", clip->name << ": " << (err ? err->message : "error"));
+                g_clear_error(&err);
+            } else {
+                LOG("CLIP-WARN", clip->name << ": muxer did not finish");
+            }
+            ok = false;
+        }
+        if (msg) gst_message_unref(msg);
+        gst_object_unref(bus);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(clip->pipeline_mutex);
+        clip->pipeline = nullptr;
+    }
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+    return ok;
+}
@@ -0,0 +1,492 @@
+#include "dvr_ring.h"
+#include "stream_metrics.h"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ==================== DEBUG LOGGING ====================
+#define DEBUG_LOGGING 1
+
+static std::string getTimestamp() {
+    auto now = std::chrono::system_clock::now();
+    auto time = std::chrono::system_clock::to_time_t(now);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        now.time_since_epoch()) % 1000;
+    std::stringstream ss;
+    ss << std::put_time(std::localtime(&time), "%H:%M:%S")
+       << "." << std::setfill('0') << std::setw(3) << ms.count();
+    return ss.str();
+}
+
+#if DEBUG_LOGGING
+#define LOG(category, msg) \
+    std::cout << "[" << getTimestamp() << "] [" << category << "] " << msg << std::endl
+#define LOG_VAR(category, msg, var) \
+    std::cout << "[" << getTimestamp() << "] [" << category << "] " << msg << var << std::endl
+#else
+#define LOG(category, msg)
+#define LOG_VAR(category, msg, var)
+#endif
+
+DvrRing::Reader::~Reader() {
+    for (auto& packet : spill) {
+        gst_buffer_unref(packet.buffer);
+    }
+}
+
+DvrRing::DvrRing(int memory_seconds, size_t max_bytes)
+    : memory_seconds_(memory_seconds)
+    , max_bytes_(max_bytes)
+    , base_index_(0)
+    , bytes_(0)
+    , spill_seconds_(0)
+    , spill_stop_(false) {
+    LOG("DVR", "Ring of " << memory_seconds << "s / " << (max_bytes >> 20) << " MB");
+}
+
+DvrRing::~DvrRing() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        spill_stop_ = true;
+    }
+    spill_cv_.notify_all();
+    arrived_.notify_all();
+    if (spill_thread_.joinable()) {
+        spill_thread_.join();
+    }
+
+    for (auto& packet : packets_) {
+        gst_buffer_unref(packet.buffer);
+    }
+    for (auto& entry : spilled_) {
+        releasePackets(entry.second.pending);
+        if (!entry.second.path.empty()) {
+            unlink(entry.second.path.c_str());
+        }
+    }
+}
+
+void DvrRing::setSpill(const std::string& dir, int seconds) {
+    if (dir.empty() || seconds <= 0) {
+        return;
+    }
+
+    // mkdir -p
+    for (size_t pos = dir.find('/', 1); ; pos = dir.find('/', pos + 1)) {
+        mkdir(dir.substr(0, pos).c_str(), 0755);
+        if (pos == std::string::npos) break;
+    }
+
+    // GOP files left behind by a previous run are unreadable (indices restart)
+    if (DIR* d = opendir(dir.c_str())) {
+        while (struct dirent* entry = readdir(d)) {
+            std::string name = entry->d_name;
+            if (name.compare(0, 4, "dvr_") == 0 && name.size() > 8 &&
+                name.compare(name.size() - 4, 4, ".gop") == 0) {
+                unlink((dir + "/" + name).c_str());
+            }
+        }
+        closedir(d);
+    }
+
+    spill_dir_ = dir;
+    spill_seconds_ = seconds;
+    spill_thread_ = std::thread(&DvrRing::spillLoop, this);
+    LOG("DVR", "Spilling " << seconds << "s more to " << dir);
+}
+
+void DvrRing::push(GstBuffer* buffer, bool video, bool keyframe) {
+    Packet packet;
+    packet.buffer = gst_buffer_ref(buffer);
+    packet.arrival_us = g_get_monotonic_time();
+    packet.video = video;
+    packet.keyframe = keyframe;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (keyframe) {
+        keyframes_[base_index_ + (int64_t)packets_.size()] = packet.arrival_us;
+    }
+    bytes_ += gst_buffer_get_size(buffer);
+    packets_.push_back(packet);
+
+    gint64 cutoff = packet.arrival_us - (gint64)memory_seconds_ * G_USEC_PER_SEC;
+    while (!packets_.empty() && (packets_.front().arrival_us < cutoff || bytes_ > max_bytes_)) {
+        evictGop();
+    }
+    arrived_.notify_all();
+}
+
+void DvrRing::evictGop() {
+    // Up to the next keyframe, so the ring always starts at a seek point.
+    // Without any keyframe in memory there's no GOP to keep whole.
+    auto next_key = keyframes_.upper_bound(base_index_);
+    int64_t end = next_key != keyframes_.end() ? next_key->first : base_index_ + 1;
+
+    SpillGop gop;
+    gop.start = base_index_;
+    gop.first_us = packets_.front().arrival_us;
+    gop.keyframe = packets_.front().keyframe;
+
+    while (base_index_ < end && !packets_.empty()) {
+        Packet& packet = packets_.front();
+        bytes_ -= gst_buffer_get_size(packet.buffer);
+        if (spill_thread_.joinable()) {
+            gop.pending.push_back(packet);
+        } else {
+            gst_buffer_unref(packet.buffer);
+        }
+        packets_.pop_front();
+        base_index_++;
+    }
+    keyframes_.erase(keyframes_.begin(), keyframes_.lower_bound(base_index_));
+
+    if (gop.pending.empty()) {
+        return;
+    }
+    if (spill_queue_.size() >= MAX_SPILL_QUEUE) {
+        // Disk can't keep up - this GOP becomes a hole readers skip over
+        StreamMetrics::instance().increment("dvr.spill.dropped");
+        releasePackets(gop.pending);
+        return;
+    }
+    gop.count = (int64_t)gop.pending.size();
+    spill_queue_.push_back(gop.start);
+    spilled_[gop.start] = std::move(gop);
+    spill_cv_.notify_one();
+}
+
+void DvrRing::spillLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!spill_stop_) {
+        spill_cv_.wait(lock, [this] { return spill_stop_ || !spill_queue_.empty(); });
+        if (spill_stop_) break;
+
+        int64_t start = spill_queue_.front();
+        SpillGop gop;
+        gop.start = start;
+        gop.path = spill_dir_ + "/dvr_" + std::to_string(start) + ".gop";
+        // Readers keep using pending while the file is written
+        for (auto& packet : spilled_[start].pending) {
+            gop.pending.push_back(packet);
+            gst_buffer_ref(packet.buffer);
+        }
+        lock.unlock();
+
+        bool written = writeGop(gop);
+        releasePackets(gop.pending);
+
+        lock.lock();
+        spill_queue_.pop_front();
+        auto it = spilled_.find(start);
+        if (written) {
+            it->second.path = gop.path;
+            releasePackets(it->second.pending);
+            StreamMetrics::instance().increment("dvr.spill.gops");
+        } else {
+            releasePackets(it->second.pending);
+            spilled_.erase(it);
+            StreamMetrics::instance().increment("dvr.spill.errors");
+        }
+
+        // Drop GOPs that aged out of the spill window
+        gint64 cutoff = g_get_monotonic_time() - (gint64)(memory_seconds_ + spill_seconds_) * G_USEC_PER_SEC;
+        while (!spilled_.empty() && spilled_.begin()->second.first_us < cutoff &&
+               spilled_.begin()->second.pending.empty()) {
+            unlink(spilled_.begin()->second.path.c_str());
+            spilled_.erase(spilled_.begin());
+        }
+    }
+}
+
+bool DvrRing::writeGop(const SpillGop& gop) {
+    FILE* file = fopen(gop.path.c_str(), "wb");
+    if (!file) {
+        LOG("DVR-ERROR", "Cannot write " << gop.path << ": " << strerror(errno));
+        return false;
+    }
+
+    // Per packet: flags (1 = video, 2 = keyframe), arrival_us, size, RTP packet
+    bool ok = true;
+    for (const auto& packet : gop.pending) {
+        GstMapInfo map;
+        if (!gst_buffer_map(packet.buffer, &map, GST_MAP_READ)) {
+            ok = false;
+            break;
+        }
+        uint8_t flags = (packet.video ? 1 : 0) | (packet.keyframe ? 2 : 0);
+        int64_t arrival = packet.arrival_us;
+        uint32_t size = (uint32_t)map.size;
+        ok = fwrite(&flags, 1, 1, file) == 1 &&
+             fwrite(&arrival, sizeof(arrival), 1, file) == 1 &&
+             fwrite(&size, sizeof(size), 1, file) == 1 &&
+             fwrite(map.data, 1, map.size, file) == map.size;
+        gst_buffer_unmap(packet.buffer, &map);
+        if (!ok) break;
+    }
+
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        LOG("DVR-ERROR", "Failed writing " << gop.path);
+        unlink(gop.path.c_str());
+    }
+    return ok;
+}
+
+bool DvrRing::loadGop(const std::string& path, std::vector<Packet>& packets) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+
+    bool ok = true;
+    uint8_t flags;
+    while (fread(&flags, 1, 1, file) == 1) {
+        int64_t arrival;
+        uint32_t size;
+        if (fread(&arrival, sizeof(arrival), 1, file) != 1 || fread(&size, sizeof(size), 1, file) != 1) {
+            ok = false;
+            break;
+        }
+        GstBuffer* buffer = gst_buffer_new_allocate(nullptr, size, nullptr);
+        GstMapInfo map;
+        gst_buffer_map(buffer, &map, GST_MAP_WRITE);
+        bool complete = fread(map.data, 1, size, file) == size;
+        gst_buffer_unmap(buffer, &map);
+        if (!complete) {
+            gst_buffer_unref(buffer);
+            ok = false;
+            break;
+        }
+
+        Packet packet;
+        packet.buffer = buffer;
+        packet.arrival_us = arrival;
+        packet.video = flags & 1;
+        packet.keyframe = flags & 2;
+        packets.push_back(packet);
+    }
+    fclose(file);
+
+    if (!ok) {
+        releasePackets(packets);
+    }
+    return ok;
+}
+
+void DvrRing::releasePackets(std::vector<Packet>& packets) {
+    for (auto& packet : packets) {
+        gst_buffer_unref(packet.buffer);
+    }
+    packets.clear();
+}
+
+bool DvrRing::seek(Reader& reader, gint64 at_us) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    int64_t best = -1;
+    int64_t oldest = -1;
+    for (const auto& entry : spilled_) {
+        if (!entry.second.keyframe) continue;
+        if (oldest < 0) oldest = entry.first;
+        if (entry.second.first_us <= at_us) best = entry.first;
+    }
+    for (const auto& entry : keyframes_) {
+        if (oldest < 0) oldest = entry.first;
+        if (entry.second <= at_us) best = entry.first;
+    }
+
+    if (best < 0) best = oldest;
+    if (best < 0) {
+        return false;
+    }
+    reader.next = best;
+    return true;
+}
+
+DvrRing::ReadResult DvrRing::read(Reader& reader, Packet& packet, int timeout_ms) {
+    // Still inside the spilled GOP loaded last time
+    if (reader.spill_start >= 0 && reader.next >= reader.spill_start &&
+        reader.next < reader.spill_start + (int64_t)reader.spill.size()) {
+        packet = reader.spill[reader.next - reader.spill_start];
+        gst_buffer_ref(packet.buffer);
+        reader.next++;
+        return ReadResult::Ok;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    int64_t head = base_index_ + (int64_t)packets_.size();
+
+    if (reader.next >= head) {
+        if (!arrived_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                               [&] { return base_index_ + (int64_t)packets_.size() > reader.next; })) {
+            return ReadResult::Timeout;
+        }
+    }
+
+    if (reader.next >= base_index_) {
+        packet = packets_[reader.next - base_index_];
+        gst_buffer_ref(packet.buffer);
+        reader.next++;
+        return ReadResult::Ok;
+    }
+
+    // Evicted - look for it among the spilled GOPs
+    auto it = spilled_.upper_bound(reader.next);
+    if (it != spilled_.begin()) {
+        --it;
+        SpillGop& gop = it->second;
+        if (reader.next < gop.start + gop.count) {
+            if (!gop.pending.empty()) {
+                packet = gop.pending[reader.next - gop.start];
+                gst_buffer_ref(packet.buffer);
+                reader.next++;
+                return ReadResult::Ok;
+            }
+
+            std::string path = gop.path;
+            int64_t start = gop.start;
+            lock.unlock();
+            releasePackets(reader.spill);
+            reader.spill_start = -1;
+            if (loadGop(path, reader.spill) && reader.next - start < (int64_t)reader.spill.size()) {
+                reader.spill_start = start;
+                packet = reader.spill[reader.next - start];
+                gst_buffer_ref(packet.buffer);
+                reader.next++;
+                return ReadResult::Ok;
+            }
+            lock.lock();
+        }
+    }
+
+    // Gone: continue from the next seek point still held
+    int64_t resume = base_index_ + (int64_t)packets_.size();
+    for (const auto& entry : spilled_) {
+        if (entry.first > reader.next && entry.second.keyframe) {
+            resume = entry.first;
+            break;
+        }
+    }
+    if (resume >= base_index_ && !keyframes_.empty()) {
+        resume = std::min(resume, keyframes_.begin()->first);
+    }
+    reader.next = resume;
+    return ReadResult::Gone;
+}
+
+gint64 DvrRing::oldestUs() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!spilled_.empty()) {
+        return spilled_.begin()->second.first_us;
+    }
+    return packets_.empty() ? 0 : packets_.front().arrival_us;
+}
+
+void DvrRing::wake() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    arrived_.notify_all();
+}
+
+// ============================================================================
+// DvrPlayback
+// ============================================================================
+
+DvrPlayback::DvrPlayback(DvrRing& ring, Deliver deliver)
+    : ring_(ring)
+    , deliver_(std::move(deliver))
+    , speed_(1.0)
+    , stop_(false)
+    , caught_up_(false)
+    , behind_us_(0) {
+}
+
+DvrPlayback::~DvrPlayback() {
+    stop();
+}
+
+bool DvrPlayback::start(gint64 from_us, double speed) {
+    if (!ring_.seek(reader_, from_us)) {
+        return false;
+    }
+    speed_ = speed < 1.0 ? 1.0 : speed;
+    behind_us_ = g_get_monotonic_time() - from_us;
+    thread_ = std::thread(&DvrPlayback::run, this);
+    return true;
+}
+
+void DvrPlayback::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    ring_.wake();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void DvrPlayback::run() {
+    gint64 wall_origin = 0;
+    gint64 media_origin = -1;
+    bool rebase = true;
+
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stop_) break;
+        }
+
+        DvrRing::Packet packet;
+        DvrRing::ReadResult result = ring_.read(reader_, packet, caught_up_ ? FOLLOW_WAIT_MS : 0);
+
+        if (result == DvrRing::ReadResult::Gone) {
+            StreamMetrics::instance().increment("dvr.playback.skips");
+            media_origin = -1;
+            rebase = true;
+            continue;
+        }
+        if (result == DvrRing::ReadResult::Timeout) {
+            if (!caught_up_) {
+                // Live from here on: real time, with audio
+                caught_up_ = true;
+                speed_ = 1.0;
+                rebase = true;
+            }
+            continue;
+        }
+
+        if (!caught_up_) {
+            if (media_origin < 0) {
+                media_origin = packet.arrival_us;
+                wall_origin = g_get_monotonic_time();
+            }
+            gint64 due = wall_origin + (gint64)((packet.arrival_us - media_origin) / speed_);
+            gint64 delay = due - g_get_monotonic_time();
+            if (delay > 0) {
+                std::unique_lock<std::mutex> lock(mutex_);
+                if (cv_.wait_for(lock, std::chrono::microseconds(delay), [this] { return stop_; })) {
+                    gst_buffer_unref(packet.buffer);
+                    break;
+                }
+            }
+        }
+
+        behind_us_ = g_get_monotonic_time() - packet.arrival_us;
+        if (!packet.video && speed_ > 1.0) {
+            gst_buffer_unref(packet.buffer);
+            continue;
+        }
+        deliver_(packet.buffer, packet.video, speed_, rebase);
+        rebase = false;
+    }
+}
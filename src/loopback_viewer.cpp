@@ -0,0 +1,342 @@
+#include "loopback_viewer.h"
+#include "stream_metrics.h"
+#include "rtp_header_extensions.h"
+#include <gst/sdp/sdp.h>
+#include <gst/webrtc/webrtc.h>
+#include <gst/rtp/rtp.h>
+#include <iostream>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+
+// ==================== DEBUG LOGGING ====================
+#define DEBUG_LOGGING 1
+
+static std::string getTimestamp() {
+    auto now = std::chrono::system_clock::now();
+    auto time = std::chrono::system_clock::to_time_t(now);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        now.time_since_epoch()) % 1000;
+    std::stringstream ss;
+    ss << std::put_time(std::localtime(&time), "%H:%M:%S")
+       << "." << std::setfill('0') << std::setw(3) << ms.count();
+    return ss.str();
+}
+
+#if DEBUG_LOGGING
+#define LOG(category, msg) \
+    std::cout << "[" << getTimestamp() << "] [" << category << "] " << msg << std::endl
+#define LOG_VAR(category, msg, var) \
+    std::cout << "[" << getTimestamp() << "] [" << category << "] " << msg << var << std::endl
+#else
+#define LOG(category, msg)
+#define LOG_VAR(category, msg, var)
+#endif
+
+// Seconds between the NTP epoch (1900) and the Unix epoch (1970)
+static const guint64 NTP_UNIX_OFFSET_SECONDS = 2208988800ULL;
+
+static double percentile(std::vector<double> samples, double p) {
+    if (samples.empty()) {
+        return 0;
+    }
+    size_t index = std::min(samples.size() - 1, (size_t)(p * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+LoopbackViewer::LoopbackViewer(SharedMediaPipeline& pipeline, const std::string& viewer_id,
+                               const std::vector<NetImpairment::Step>& impairment, guint32 seed)
+    : shared_pipeline_(pipeline)
+    , viewer_id_(viewer_id)
+    , impairment_(impairment)
+    , seed_(seed)
+    , peer_(nullptr)
+    , pipeline_(nullptr)
+    , webrtcbin_(nullptr)
+    , first_frame_us_(0)
+    , last_frame_us_(0) {
+}
+
+LoopbackViewer::~LoopbackViewer() {
+    stop();
+}
+
+bool LoopbackViewer::start() {
+    pipeline_ = gst_pipeline_new(("loopback_" + viewer_id_).c_str());
+    webrtcbin_ = gst_element_factory_make("webrtcbin", nullptr);
+    if (!webrtcbin_) {
+        LOG("LOOPBACK-ERROR", "Cannot create webrtcbin for " << viewer_id_);
+        gst_object_unref(pipeline_);
+        pipeline_ = nullptr;
+        return false;
+    }
+    g_object_set(webrtcbin_, "bundle-policy", 3, nullptr);  // max-bundle, like browsers
+    gst_bin_add(GST_BIN(pipeline_), webrtcbin_);
+    g_signal_connect(webrtcbin_, "on-ice-candidate", G_CALLBACK(onIceCandidate), this);
+    g_signal_connect(webrtcbin_, "pad-added", G_CALLBACK(onPadAdded), this);
+    gst_element_set_state(pipeline_, GST_STATE_PLAYING);
+
+    gint64 now_us = g_get_monotonic_time();
+    window_.started_us = now_us;
+    total_.started_us = now_us;
+
+    WebRTCPeer* peer = shared_pipeline_.addViewer(viewer_id_);
+    if (!peer) {
+        LOG("LOOPBACK-WARN", "Pipeline refused viewer " << viewer_id_);
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        peer_ = peer;
+    }
+
+    if (!impairment_.empty()) {
+        peer->setImpairment(std::unique_ptr<NetImpairment>(new NetImpairment(impairment_, seed_)));
+    }
+    peer->setIceCandidateCallback([this](const std::string& candidate, int mline_index) {
+        g_signal_emit_by_name(webrtcbin_, "add-ice-candidate", (guint)mline_index, candidate.c_str());
+    });
+    peer->createOffer([this](const std::string& sdp) {
+        onOffer(sdp);
+    });
+
+    LOG("LOOPBACK", viewer_id_ << " joined");
+    return true;
+}
+
+void LoopbackViewer::stop() {
+    if (!pipeline_) {
+        return;
+    }
+
+    WebRTCPeer* peer;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        peer = peer_;
+        peer_ = nullptr;
+    }
+    if (peer) {
+        shared_pipeline_.removeViewer(viewer_id_);
+    }
+
+    gst_element_set_state(pipeline_, GST_STATE_NULL);
+    gst_object_unref(pipeline_);
+    pipeline_ = nullptr;
+    webrtcbin_ = nullptr;
+
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    double seconds = (g_get_monotonic_time() - total_.started_us) / 1e6;
+    logStats("total", total_, seconds);
+    if (first_frame_us_ != 0) {
+        LOG("LOOPBACK", viewer_id_ << " first frame "
+            << (first_frame_us_ - total_.started_us) / 1000 << "ms after joining");
+    }
+}
+
+void LoopbackViewer::peerGone() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (peer_) {
+        LOG("LOOPBACK", viewer_id_ << " was reclaimed by the pipeline");
+        peer_ = nullptr;
+    }
+}
+
+void LoopbackViewer::report() {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    gint64 now_us = g_get_monotonic_time();
+    logStats("last", window_, (now_us - window_.started_us) / 1e6);
+    window_ = Stats();
+    window_.started_us = now_us;
+}
+
+void LoopbackViewer::logStats(const char* label, Stats& stats, double seconds) {
+    if (seconds <= 0) {
+        return;
+    }
+    LOG("LOOPBACK", viewer_id_ << " " << label << " " << (int)seconds << "s: "
+        << stats.frames / seconds << " fps, "
+        << stats.freezes << " freezes (" << (int)stats.freeze_ms << "ms, "
+        << stats.freeze_ms / 10.0 / seconds << "%), "
+        << "latency p50 " << percentile(stats.latency_ms, 0.5) << "ms"
+        << " p95 " << percentile(stats.latency_ms, 0.95) << "ms, "
+        << stats.packets << " packets");
+}
+
+void LoopbackViewer::onOffer(const std::string& sdp) {
+    GstSDPMessage* sdp_msg;
+    gst_sdp_message_new(&sdp_msg);
+    gst_sdp_message_parse_buffer((const guint8*)sdp.c_str(), sdp.length(), sdp_msg);
+    GstWebRTCSessionDescription* offer =
+        gst_webrtc_session_description_new(GST_WEBRTC_SDP_TYPE_OFFER, sdp_msg);
+
+    GstPromise* promise = gst_promise_new();
+    g_signal_emit_by_name(webrtcbin_, "set-remote-description", offer, promise);
+    gst_promise_wait(promise);
+    gst_promise_unref(promise);
+    gst_webrtc_session_description_free(offer);
+
+    promise = gst_promise_new_with_change_func(onAnswerCreated, this, nullptr);
+    g_signal_emit_by_name(webrtcbin_, "create-answer", nullptr, promise);
+}
+
+void LoopbackViewer::onAnswerCreated(GstPromise* promise, gpointer user_data) {
+    LoopbackViewer* self = static_cast<LoopbackViewer*>(user_data);
+
+    GstWebRTCSessionDescription* answer = nullptr;
+    const GstStructure* reply = gst_promise_get_reply(promise);
+    gst_structure_get(reply, "answer", GST_TYPE_WEBRTC_SESSION_DESCRIPTION, &answer, nullptr);
+    gst_promise_unref(promise);
+    if (!answer) {
+        LOG("LOOPBACK-ERROR", self->viewer_id_ << " could not answer the offer");
+        return;
+    }
+
+    GstPromise* local_promise = gst_promise_new();
+    g_signal_emit_by_name(self->webrtcbin_, "set-local-description", answer, local_promise);
+    gst_promise_interrupt(local_promise);
+    gst_promise_unref(local_promise);
+
+    gchar* text = gst_sdp_message_as_text(answer->sdp);
+    std::string sdp(text);
+    g_free(text);
+    gst_webrtc_session_description_free(answer);
+
+    std::lock_guard<std::mutex> lock(self->mutex_);
+    if (self->peer_) {
+        self->peer_->setRemoteAnswer(sdp);
+        self->shared_pipeline_.forceKeyframe("join");
+    }
+}
+
+void LoopbackViewer::onIceCandidate(GstElement* webrtcbin, guint mline_index, gchar* candidate,
+                                    gpointer user_data) {
+    LoopbackViewer* self = static_cast<LoopbackViewer*>(user_data);
+    std::lock_guard<std::mutex> lock(self->mutex_);
+    if (self->peer_) {
+        self->peer_->addIceCandidate(candidate, (int)mline_index);
+    }
+}
+
+GstElement* LoopbackViewer::addSink(GstPad* pad) {
+    GstElement* sink = gst_element_factory_make("fakesink", nullptr);
+    g_object_set(sink, "sync", FALSE, "async", FALSE, nullptr);
+    gst_bin_add(GST_BIN(pipeline_), sink);
+    gst_element_sync_state_with_parent(sink);
+
+    GstPad* sink_pad = gst_element_get_static_pad(sink, "sink");
+    gst_pad_link(pad, sink_pad);
+    gst_object_unref(sink_pad);
+    return sink;
+}
+
+// Received RTP out of webrtcbin: decode video, discard audio
+void LoopbackViewer::onPadAdded(GstElement* element, GstPad* pad, gpointer user_data) {
+    LoopbackViewer* self = static_cast<LoopbackViewer*>(user_data);
+    if (GST_PAD_DIRECTION(pad) != GST_PAD_SRC) {
+        return;
+    }
+
+    GstCaps* caps = gst_pad_query_caps(pad, nullptr);
+    const gchar* media = gst_structure_get_string(gst_caps_get_structure(caps, 0), "media");
+    bool video = media && strcmp(media, "video") == 0;
+    gst_caps_unref(caps);
+
+    if (!video) {
+        self->addSink(pad);
+        return;
+    }
+
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, packetProbe, self, nullptr);
+    GstElement* decodebin = gst_element_factory_make("decodebin", nullptr);
+    g_signal_connect(decodebin, "pad-added", G_CALLBACK(onDecodedPadAdded), self);
+    gst_bin_add(GST_BIN(self->pipeline_), decodebin);
+    gst_element_sync_state_with_parent(decodebin);
+
+    GstPad* decode_sink = gst_element_get_static_pad(decodebin, "sink");
+    gst_pad_link(pad, decode_sink);
+    gst_object_unref(decode_sink);
+}
+
+void LoopbackViewer::onDecodedPadAdded(GstElement* decodebin, GstPad* pad, gpointer user_data) {
+    LoopbackViewer* self = static_cast<LoopbackViewer*>(user_data);
+    GstElement* sink = self->addSink(pad);
+    GstPad* sink_pad = gst_element_get_static_pad(sink, "sink");
+    gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_BUFFER, frameProbe, self, nullptr);
+    gst_object_unref(sink_pad);
+}
+
+GstPadProbeReturn LoopbackViewer::packetProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data) {
+    LoopbackViewer* self = static_cast<LoopbackViewer*>(user_data);
+    GstBuffer* buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+
+    // abs-capture-time rides on the first packet of each frame
+    double latency_ms = -1;
+    GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+    if (gst_rtp_buffer_map(buffer, GST_MAP_READ, &rtp)) {
+        gpointer data = nullptr;
+        guint size = 0;
+        if (gst_rtp_buffer_get_extension_onebyte_header(&rtp, ABS_CAPTURE_TIME_EXT_ID, 0, &data, &size) &&
+            size >= 8) {
+            guint64 ntp = GST_READ_UINT64_BE(data);
+            gint64 capture_us = (gint64)((ntp >> 32) - NTP_UNIX_OFFSET_SECONDS) * G_USEC_PER_SEC +
+                                (gint64)(((ntp & 0xFFFFFFFFULL) * G_USEC_PER_SEC) >> 32);
+            latency_ms = (g_get_real_time() - capture_us) / 1000.0;
+        }
+        gst_rtp_buffer_unmap(&rtp);
+    }
+
+    std::lock_guard<std::mutex> lock(self->stats_mutex_);
+    self->window_.packets++;
+    self->total_.packets++;
+    if (latency_ms >= 0) {
+        self->window_.latency_ms.push_back(latency_ms);
+        if (self->total_.latency_ms.size() < MAX_LATENCY_SAMPLES) {
+            self->total_.latency_ms.push_back(latency_ms);
+        }
+        StreamMetrics::instance().recordLatency("loopback.latency_ms", latency_ms);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+GstPadProbeReturn LoopbackViewer::frameProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data) {
+    LoopbackViewer* self = static_cast<LoopbackViewer*>(user_data);
+    gint64 now_us = g_get_monotonic_time();
+
+    std::lock_guard<std::mutex> lock(self->stats_mutex_);
+    self->window_.frames++;
+    self->total_.frames++;
+    StreamMetrics::instance().increment("loopback.frames");
+
+    if (self->first_frame_us_ == 0) {
+        self->first_frame_us_ = now_us;
+        self->last_frame_us_ = now_us;
+        return GST_PAD_PROBE_OK;
+    }
+
+    gint64 interval_us = now_us - self->last_frame_us_;
+    self->last_frame_us_ = now_us;
+
+    std::deque<gint64>& intervals = self->frame_intervals_us_;
+    if (intervals.size() == FREEZE_AVERAGE_FRAMES) {
+        gint64 sum_us = 0;
+        for (gint64 recent : intervals) {
+            sum_us += recent;
+        }
+        gint64 average_us = sum_us / (gint64)intervals.size();
+        if (interval_us > std::max(3 * average_us, average_us + 150000)) {
+            double freeze_ms = interval_us / 1000.0;
+            self->window_.freezes++;
+            self->window_.freeze_ms += freeze_ms;
+            self->total_.freezes++;
+            self->total_.freeze_ms += freeze_ms;
+            StreamMetrics::instance().increment("loopback.freezes");
+            StreamMetrics::instance().recordLatency("loopback.freeze_ms", freeze_ms);
+        }
+        intervals.pop_front();
+    }
+    intervals.push_back(interval_us);
+    return GST_PAD_PROBE_OK;
+}
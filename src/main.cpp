@@ -1,14 +1,25 @@
 #include "shared_media_pipeline.h"
 #include "signaling_client.h"
 #include "cloudflare_turn.h"
+#include "stream_metrics.h"
+#include "camera_probe.h"
+#include "loopback_viewer.h"
 #include <iostream>
 #include <signal.h>
 #include <map>
 #include <memory>
 #include <cstdlib>
+#include <cstdio>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <atomic>
 #include <gst/gst.h>
 
-static bool running = true;
+// Cleared by the signal handler and by handoff callbacks on other threads
+static std::atomic<bool> running{true};
 
 void signalHandler(int signum) {
     std::cout << "\nShutting down..." << std::endl;
@@ -18,14 +29,19 @@ void signalHandler(int signum) {
 class StreamManager {
 public:
     StreamManager(const std::string& signaling_url, const std::string& stream_id,
-                  SharedMediaPipeline::CameraType camera_type = SharedMediaPipeline::CameraType::CSI)
+                  SharedMediaPipeline::CameraType camera_type = SharedMediaPipeline::CameraType::CSI,
+                  bool handoff_mode = false)
         : stream_id_(stream_id)
+        , camera_type_(camera_type)
         , signaling_(signaling_url)
-        , camera_type_(camera_type) {
+        , handoff_mode_(handoff_mode) {
 
         // Setup signaling callbacks
-        signaling_.setOnViewerJoined([this](const std::string& viewer_id) {
-            onViewerJoined(viewer_id);
+        signaling_.setOnViewerJoined([this](const std::string& viewer_id,
+                                            const std::string& client_id,
+                                            const std::string& network,
+                                            bool resume) {
+            onViewerJoined(viewer_id, client_id, network, resume);
         });
 
         signaling_.setOnAnswer([this](const std::string& viewer_id, const std::string& sdp) {
@@ -41,6 +57,90 @@ public:
         signaling_.setOnViewerLeft([this](const std::string& viewer_id) {
             onViewerLeft(viewer_id);
         });
+
+        signaling_.setOnHandoffRequest([this]() {
+            onHandoffRequest();
+        });
+
+        signaling_.setOnHandoffGo([this]() {
+            onHandoffGo();
+        });
+
+        signaling_.setOnHandoffComplete([]() {
+            // Peers are cleaned up by stop() once the main loop exits
+            std::cout << "[HANDOFF] New process has video - exiting" << std::endl;
+            running = false;
+        });
+
+        signaling_.setOnHandoffAbort([this](const std::string& reason) {
+            std::cout << "[HANDOFF] Aborted (" << reason << ") - taking the camera back" << std::endl;
+            shared_pipeline_.resumeCapture();
+        });
+
+        signaling_.setOnIceRestartRequest([this](const std::string& viewer_id) {
+            std::cout << "[<] ICE restart requested by: " << viewer_id << std::endl;
+            if (restartIce(viewer_id)) {
+                StreamMetrics::instance().increment("ice.restarts.viewer");
+            }
+        });
+
+        // Viewer-measured latency, split by whether a minimal playout delay was in effect
+        signaling_.setOnViewerStats([](const std::string& viewer_id, double e2e_ms,
+                                       double jitter_buffer_ms, bool playout_delay) {
+            std::string mode = playout_delay ? "playout_delay" : "default";
+            if (e2e_ms >= 0) {
+                StreamMetrics::instance().recordLatency("viewer.e2e_ms." + mode, e2e_ms);
+            }
+            if (jitter_buffer_ms >= 0) {
+                StreamMetrics::instance().recordLatency("viewer.jitter_buffer_ms." + mode, jitter_buffer_ms);
+            }
+        });
+
+        // DVR time-shift: the viewer asks, the pipeline reports where it ended up
+        signaling_.setOnTimeshift([this](const std::string& viewer_id, double offset_s, double speed) {
+            std::cout << "[<] Time-shift " << offset_s << "s at " << speed << "x requested by: "
+                      << viewer_id << std::endl;
+            if (!shared_pipeline_.timeshiftViewer(viewer_id, offset_s, speed)) {
+                signaling_.sendTimeshiftState(viewer_id, 0);
+            }
+        });
+
+        shared_pipeline_.setOnTimeshiftChanged([this](const std::string& viewer_id, double behind_seconds) {
+            signaling_.sendTimeshiftState(viewer_id, behind_seconds);
+        });
+
+        // Motion/alarm events: export a clip around them, reporting back to
+        // the viewer that raised it (sensor sources get no reply)
+        signaling_.setOnEvent([this](const std::string& from, const std::string& event) {
+            std::cout << "[<] Event '" << event << "'" << (from.empty() ? "" : " from: " + from) << std::endl;
+            std::string clip = shared_pipeline_.triggerClip(event,
+                [this, from](const std::string& name, const std::string& path) {
+                    if (!from.empty()) {
+                        signaling_.sendClipStatus(from, name, path.empty() ? "failed" : "written");
+                    }
+                });
+            if (!from.empty()) {
+                signaling_.sendClipStatus(from, clip, clip.empty() ? "failed" : "started");
+            }
+        });
+
+        // Snapshots for the server's /snapshot endpoint; cached until the
+        // next keyframe, so a wall of thumbnails costs one decode per GOP
+        signaling_.setOnSnapshotRequest([this](const std::string& request_id, int width) {
+            shared_pipeline_.requestSnapshot(width,
+                [this, request_id, width](bool ok, const std::string& jpeg, int age_ms) {
+                    signaling_.sendSnapshot(request_id, width, ok ? jpeg : "", age_ms);
+                });
+        });
+
+        shared_pipeline_.setOnViewerReclaimed([this](const std::string& viewer_id,
+                                                     const std::string& reason) {
+            onViewerReclaimed(viewer_id, reason);
+        });
+
+        shared_pipeline_.setOnIceRestartNeeded([this](const std::string& viewer_id) {
+            restartIce(viewer_id);
+        });
     }
 
     bool start(const std::string& video_device = "/dev/video0",
@@ -56,11 +156,14 @@ public:
             return false;
         }
 
-        // Start the shared pipeline
-        std::cout << "Starting shared media pipeline..." << std::endl;
-        if (!shared_pipeline_.start()) {
-            std::cerr << "Failed to start shared media pipeline" << std::endl;
-            return false;
+        // In handoff mode the previous process still owns the camera, so the
+        // pipeline stays prewarmed (parsed, elements loaded) until handoff-go
+        if (!handoff_mode_) {
+            std::cout << "Starting shared media pipeline..." << std::endl;
+            if (!shared_pipeline_.start()) {
+                std::cerr << "Failed to start shared media pipeline" << std::endl;
+                return false;
+            }
         }
 
         // Connect to signaling server
@@ -73,8 +176,9 @@ public:
         std::cout << "Connected to signaling server" << std::endl;
 
         // Register as broadcaster
-        std::cout << "Registering as broadcaster: " << stream_id_ << std::endl;
-        signaling_.registerBroadcaster(stream_id_);
+        std::cout << "Registering as broadcaster: " << stream_id_
+                  << (handoff_mode_ ? " (handoff)" : "") << std::endl;
+        signaling_.registerBroadcaster(stream_id_, handoff_mode_);
 
         std::cout << "\n========================================" << std::endl;
         std::cout << "   STREAMING READY - Waiting for viewers" << std::endl;
@@ -85,9 +189,21 @@ public:
         std::cout << "Multi-viewer: ENABLED (shared pipeline)" << std::endl;
         std::cout << "========================================\n" << std::endl;
 
+        if (!handoff_mode_) {
+            startLoopbackViewers();
+        }
+
         return true;
     }
 
+    // Test only: synthetic viewers inside this process, each behind the
+    // impairment script (call before start())
+    void setLoopbackViewers(int count, const std::vector<NetImpairment::Step>& impairment, guint32 seed) {
+        loopback_count_ = count;
+        loopback_impairment_ = impairment;
+        loopback_seed_ = seed;
+    }
+
     void run() {
         // Start GStreamer main loop
         GMainLoop* loop = g_main_loop_new(nullptr, FALSE);
@@ -97,9 +213,16 @@ public:
             g_main_loop_run(loop);
         });
 
-        // Wait for shutdown signal
+        // Wait for shutdown signal, publishing metrics periodically
+        auto last_metrics = std::chrono::steady_clock::now();
         while (running) {
             std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+            auto now = std::chrono::steady_clock::now();
+            if (now - last_metrics >= std::chrono::seconds(METRICS_INTERVAL_SECONDS)) {
+                last_metrics = now;
+                publishMetrics();
+            }
         }
 
         // Stop loop
@@ -111,11 +234,23 @@ public:
     void stop() {
         std::cout << "Stopping all streams..." << std::endl;
 
+        // Loopback viewers log their totals on the way out
+        {
+            TimedLockGuard lock(peers_mutex_, "peers");
+            for (auto& loopback : loopback_viewers_) {
+                loopback->stop();
+            }
+            loopback_viewers_.clear();
+        }
+
         // Stop shared pipeline (this will cleanup all viewers)
         shared_pipeline_.stop();
 
         // Clear peer map
-        viewer_peers_.clear();
+        {
+            TimedLockGuard lock(peers_mutex_, "peers");
+            viewer_peers_.clear();
+        }
 
         // Disconnect signaling
         signaling_.disconnect();
@@ -131,13 +266,145 @@ private:
     SignalingClient signaling_;
     SharedMediaPipeline shared_pipeline_;
     std::map<std::string, WebRTCPeer*> viewer_peers_;
+    // Guards viewer_peers_ and the peers it points to: signaling callbacks and
+    // the pipeline's reclaim thread both remove viewers
+    std::mutex peers_mutex_;
+    bool handoff_mode_;
+
+    int loopback_count_ = 0;
+    std::vector<NetImpairment::Step> loopback_impairment_;
+    guint32 loopback_seed_ = 1;
+    std::vector<std::unique_ptr<LoopbackViewer>> loopback_viewers_;
+
+    static constexpr int METRICS_INTERVAL_SECONDS = 10;
+    // Max time to wait for caps on the tee before loopback viewers join
+    static constexpr int LOOPBACK_FIRST_BUFFER_TIMEOUT_MS = 5000;
+
+    void startLoopbackViewers() {
+        if (loopback_count_ <= 0) {
+            return;
+        }
+        // Offers created before caps reach the tee are incomplete
+        shared_pipeline_.waitForVideoFlow(LOOPBACK_FIRST_BUFFER_TIMEOUT_MS);
+
+        TimedLockGuard lock(peers_mutex_, "peers");
+        for (int i = 0; i < loopback_count_; i++) {
+            // Each viewer gets its own loss pattern, the same one every run
+            std::unique_ptr<LoopbackViewer> loopback(new LoopbackViewer(
+                shared_pipeline_, "loopback-" + std::to_string(i), loopback_impairment_, loopback_seed_ + i));
+            if (loopback->start()) {
+                loopback_viewers_.push_back(std::move(loopback));
+            }
+        }
+    }
+
+    void publishMetrics() {
+        StreamMetrics& metrics = StreamMetrics::instance();
+        {
+            TimedLockGuard lock(peers_mutex_, "peers");
+            metrics.setGauge("viewers.active", viewer_peers_.size());
+            for (auto& loopback : loopback_viewers_) {
+                loopback->report();
+            }
+        }
+        metrics.recordMemory();
+        metrics.logSummary();
+        signaling_.sendMetrics(metrics.toJson());
+    }
+
+    // Pipeline detected a dead peer (failed, disconnected too long, or silent)
+    void onViewerReclaimed(const std::string& viewer_id, const std::string& reason) {
+        std::cout << "[-] Reclaiming dead viewer: " << viewer_id << " (" << reason << ")" << std::endl;
+
+        ScopedLatency latency("control.reclaim_ms");
+        TimedLockGuard lock(peers_mutex_, "peers");
+        for (auto& loopback : loopback_viewers_) {
+            if (loopback->viewerId() == viewer_id) {
+                loopback->peerGone();
+            }
+        }
+        shared_pipeline_.removeViewer(viewer_id);
+        viewer_peers_.erase(viewer_id);
+        signaling_.sendViewerReclaimed(viewer_id, reason);
 
-    void onViewerJoined(const std::string& viewer_id) {
-        std::cout << "\n[+] Viewer joined: " << viewer_id << std::endl;
+        std::cout << "    Active viewers: " << viewer_peers_.size() << "\n" << std::endl;
+    }
+
+    // Renegotiate ICE on the viewer's existing peer connection (network change).
+    // The webrtcbin branch and DTLS session stay up; only candidates change.
+    bool restartIce(const std::string& viewer_id) {
+        ScopedLatency latency("control.ice_restart_ms");
+        TimedLockGuard lock(peers_mutex_, "peers");
+        auto it = viewer_peers_.find(viewer_id);
+        if (it == viewer_peers_.end()) {
+            return false;
+        }
+
+        return it->second->restartIce([this, viewer_id](const std::string& sdp) {
+            std::cout << "    Sending ICE restart offer to " << viewer_id << std::endl;
+            signaling_.sendOffer(viewer_id, sdp, true);
+        });
+    }
+
+    // Max time to wait for the first video buffer after taking over the camera
+    static constexpr int HANDOFF_FIRST_BUFFER_TIMEOUT_MS = 3000;
+
+    // Outgoing side of a handoff: free the camera as fast as possible, but
+    // keep our viewers on the slate until the new process has video and has
+    // offered each of them (the server migrates them in batches). Then the
+    // server sends handoff-complete (we exit) or handoff-abort (we take the
+    // camera back).
+    void onHandoffRequest() {
+        std::cout << "\n[HANDOFF] New process taking over - releasing camera" << std::endl;
+        shared_pipeline_.releaseCapture();
+        signaling_.sendHandoffRelease();
+    }
+
+    // Incoming side of a handoff: the camera is ours now
+    void onHandoffGo() {
+        auto start = std::chrono::steady_clock::now();
+        std::cout << "\n[HANDOFF] Camera released by previous process - starting pipeline" << std::endl;
+
+        if (!shared_pipeline_.start()) {
+            std::cerr << "[HANDOFF] Failed to start shared media pipeline" << std::endl;
+            signaling_.sendHandoffFailed("pipeline failed to start");
+            running = false;
+            return;
+        }
 
-        // Add viewer to shared pipeline (creates webrtcbin for this viewer)
+        // Offers created before caps reach the tee are incomplete, so only
+        // ask for viewers once media is actually flowing. Waited for on the
+        // main loop - this is the signaling thread.
+        shared_pipeline_.whenVideoFlows(HANDOFF_FIRST_BUFFER_TIMEOUT_MS, [this, start](bool flowing) {
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start).count();
+            if (!flowing) {
+                std::cerr << "[HANDOFF] No video " << elapsed << "ms after handoff-go - giving the camera back"
+                          << std::endl;
+                shared_pipeline_.releaseCapture();
+                signaling_.sendHandoffFailed("no video");
+                running = false;
+                return;
+            }
+            signaling_.sendHandoffReady();
+            std::cout << "[HANDOFF] Ready for viewers " << elapsed << "ms after handoff-go" << std::endl;
+        });
+    }
+
+    void onViewerJoined(const std::string& viewer_id, const std::string& client_id,
+                        const std::string& network, bool resume) {
+        std::cout << "\n[+] Viewer joined: " << viewer_id
+                  << (resume ? " (resuming)" : "") << std::endl;
+
+        // Join handling, lock wait included - the offer goes out at the end
+        ScopedLatency latency("control.join_ms");
+        TimedLockGuard lock(peers_mutex_, "peers");
+
+        // Add viewer to shared pipeline (creates webrtcbin for this viewer,
+        // or reuses the one this client left behind moments ago)
         std::cout << "    Creating WebRTC peer connection..." << std::endl;
-        WebRTCPeer* peer = shared_pipeline_.addViewer(viewer_id);
+        bool reused = false;
+        WebRTCPeer* peer = shared_pipeline_.addViewer(viewer_id, client_id, network, resume, &reused);
 
         if (!peer) {
             std::cerr << "    [ERROR] Failed to create peer for viewer" << std::endl;
@@ -149,6 +416,20 @@ private:
             signaling_.sendIceCandidate(viewer_id, candidate, sdp_mline_index);
         });
 
+        if (reused) {
+            // Same DTLS session as before - new ICE credentials are all it needs
+            std::cout << "    Reusing warm peer, restarting ICE..." << std::endl;
+            peer->restartIce([this, viewer_id](const std::string& sdp) {
+                std::cout << "    Sending ICE restart offer to resumed viewer..." << std::endl;
+                signaling_.sendOffer(viewer_id, sdp, true);
+            });
+
+            viewer_peers_[viewer_id] = peer;
+            std::cout << "[OK] Peer resumed for: " << viewer_id << std::endl;
+            std::cout << "    Active viewers: " << viewer_peers_.size() << "\n" << std::endl;
+            return;
+        }
+
         // Create and send offer
         std::cout << "    Creating WebRTC offer..." << std::endl;
         peer->createOffer([this, viewer_id](const std::string& sdp) {
@@ -165,19 +446,26 @@ private:
     void onAnswer(const std::string& viewer_id, const std::string& sdp) {
         std::cout << "[<] Received answer from: " << viewer_id << std::endl;
 
+        ScopedLatency latency("control.answer_ms");
+        TimedLockGuard lock(peers_mutex_, "peers");
         auto it = viewer_peers_.find(viewer_id);
         if (it != viewer_peers_.end()) {
             it->second->setRemoteAnswer(sdp);
 
             // Force a keyframe so the new viewer can start decoding
-            std::cout << "    Forcing keyframe for new viewer..." << std::endl;
-            shared_pipeline_.forceKeyframe();
+            // (viewers on a secondary codec got one when their branch was attached)
+            if (it->second->getVideoCodec() == SharedMediaPipeline::videoCodec()) {
+                std::cout << "    Forcing keyframe for new viewer..." << std::endl;
+                shared_pipeline_.forceKeyframe("join");
+            }
 
             std::cout << "[OK] Connection established with: " << viewer_id << "\n" << std::endl;
         }
     }
 
     void onIceCandidate(const std::string& viewer_id, const std::string& candidate, int sdp_mline_index) {
+        ScopedLatency latency("control.ice_ms");
+        TimedLockGuard lock(peers_mutex_, "peers");
         auto it = viewer_peers_.find(viewer_id);
         if (it != viewer_peers_.end()) {
             it->second->addIceCandidate(candidate, sdp_mline_index);
@@ -187,14 +475,33 @@ private:
     void onViewerLeft(const std::string& viewer_id) {
         std::cout << "[-] Viewer left: " << viewer_id << std::endl;
 
-        // Remove from shared pipeline
-        shared_pipeline_.removeViewer(viewer_id);
+        ScopedLatency latency("control.leave_ms");
+        TimedLockGuard lock(peers_mutex_, "peers");
+
+        // Remove from shared pipeline (parks the peer if the viewer may be back)
+        shared_pipeline_.removeViewer(viewer_id, true);
         viewer_peers_.erase(viewer_id);
 
         std::cout << "    Active viewers: " << viewer_peers_.size() << "\n" << std::endl;
     }
 };
 
+// Split a comma-separated environment value ("docker*,tun*") into items
+static std::vector<std::string> splitEnvList(const char* value) {
+    std::vector<std::string> items;
+    if (!value) {
+        return items;
+    }
+    std::stringstream ss(value);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
 int main(int argc, char* argv[]) {
     // Handle Ctrl+C
     signal(SIGINT, signalHandler);
@@ -207,6 +514,81 @@ int main(int argc, char* argv[]) {
     std::string audio_device = "default";
     std::string camera_type_str = "csi";  // Default to CSI for Pi Camera Module
 
+    // Warm cache for fast viewer rejoin (WARM_CACHE_MAX_PEERS=0 disables it)
+    const char* warm_ttl_env = std::getenv("WARM_CACHE_SECONDS");
+    const char* warm_max_env = std::getenv("WARM_CACHE_MAX_PEERS");
+    if (warm_ttl_env || warm_max_env) {
+        // Negative values would wrap the size_t cap
+        SharedMediaPipeline::setWarmCache(warm_ttl_env ? std::max(0, std::atoi(warm_ttl_env)) : 30,
+                                          warm_max_env ? std::max(0, std::atoi(warm_max_env)) : 4);
+    }
+
+    // Encoder mode: VIDEO_INTRA_REFRESH=1 replaces periodic IDRs with a rolling
+    // intra refresh; VIDEO_KEYFRAME_INTERVAL is the IDR / refresh period in frames
+    const char* intra_refresh_env = std::getenv("VIDEO_INTRA_REFRESH");
+    const char* keyframe_interval_env = std::getenv("VIDEO_KEYFRAME_INTERVAL");
+    bool intra_refresh = intra_refresh_env && std::string(intra_refresh_env) == "1";
+    int keyframe_interval = keyframe_interval_env ? std::atoi(keyframe_interval_env) : 30;
+    SharedMediaPipeline::setVideoEncoding(intra_refresh, keyframe_interval);
+    std::string encoder_display = std::string(intra_refresh ? "Intra refresh" : "IDR") +
+                                  " every " + std::to_string(keyframe_interval) + " frames";
+
+    // VIDEO_CODEC: codecs offered to viewers, most preferred first, e.g.
+    // "h264" (default), "vp8" or "h264,vp8,h265". The first is encoded from
+    // startup; the others only while a viewer that picked them is watching.
+    // VP8 has three temporal layers, thinned per viewer (30/15/7.5 fps).
+    const char* codec_env = std::getenv("VIDEO_CODEC");
+    if (codec_env && codec_env[0]) {
+        std::vector<SharedMediaPipeline::VideoCodec> codecs;
+        std::string codec_names;
+        for (const auto& name : splitEnvList(codec_env)) {
+            if (name == "h264") {
+                codecs.push_back(SharedMediaPipeline::VideoCodec::H264);
+            } else if (name == "vp8") {
+                codecs.push_back(SharedMediaPipeline::VideoCodec::VP8);
+            } else if (name == "h265") {
+                codecs.push_back(SharedMediaPipeline::VideoCodec::H265);
+            } else {
+                std::cerr << "Unknown VIDEO_CODEC entry '" << name << "' - ignored" << std::endl;
+                continue;
+            }
+            codec_names += (codec_names.empty() ? "" : "/") + name;
+        }
+        SharedMediaPipeline::setVideoCodecs(codecs);
+        if (!codec_names.empty()) {
+            encoder_display = codec_names + ", " + encoder_display;
+        }
+    }
+    const auto& video_codecs = SharedMediaPipeline::videoCodecs();
+    bool offers_h264 = std::find(video_codecs.begin(), video_codecs.end(),
+                                 SharedMediaPipeline::VideoCodec::H264) != video_codecs.end();
+
+    // VIDEO_SLICES=1: one packet-sized slice per RTP packet for the path MTU
+    // (VIDEO_PATH_MTU, default 1280 - the IPv6 minimum, safe on any path)
+    const char* slices_env = std::getenv("VIDEO_SLICES");
+    const char* path_mtu_env = std::getenv("VIDEO_PATH_MTU");
+    if (slices_env && std::string(slices_env) == "1" && offers_h264) {
+        int path_mtu = path_mtu_env ? std::atoi(path_mtu_env) : 1280;
+        SharedMediaPipeline::setSliceEncoding(true, path_mtu);
+        encoder_display += ", MTU slices (path MTU " + std::to_string(path_mtu) + ")";
+    }
+
+    // Playout delay hint for viewers' video jitter buffers: "min" or "min,max" in ms
+    // (e.g. PLAYOUT_DELAY_MS=0 for low-latency consoles). Unset = not offered.
+    const char* playout_env = std::getenv("PLAYOUT_DELAY_MS");
+    std::string playout_display = "Browser default";
+    if (playout_env && playout_env[0]) {
+        std::vector<std::string> bounds = splitEnvList(playout_env);
+        int min_ms = bounds.size() > 0 ? std::atoi(bounds[0].c_str()) : 0;
+        int max_ms = bounds.size() > 1 ? std::atoi(bounds[1].c_str()) : min_ms;
+        SharedMediaPipeline::setPlayoutDelay(min_ms, max_ms);
+        playout_display = std::to_string(min_ms) + "-" + std::to_string(std::max(min_ms, max_ms)) + "ms";
+    }
+
+    // WEBRTC_HANDOFF=1 starts this process as the successor of a running one
+    const char* handoff_env = std::getenv("WEBRTC_HANDOFF");
+    bool handoff_mode = handoff_env && std::string(handoff_env) == "1";
+
     if (argc > 1) signaling_url = argv[1];
     if (argc > 2) stream_id = argv[2];
     if (argc > 3) video_device = argv[3];
@@ -219,41 +601,301 @@ int main(int argc, char* argv[]) {
         camera_type = SharedMediaPipeline::CameraType::USB;
     }
 
+    // USB_CAMERA_FORMAT: auto (default - camera H.264 if usable, else MJPEG,
+    // else raw), h264, mjpeg or raw
+    std::string usb_format = "auto";
+    const char* usb_format_env = std::getenv("USB_CAMERA_FORMAT");
+    if (usb_format_env && usb_format_env[0]) {
+        usb_format = usb_format_env;
+        if (usb_format == "h264") {
+            SharedMediaPipeline::setUsbCaptureFormat(SharedMediaPipeline::UsbFormat::H264);
+        } else if (usb_format == "mjpeg") {
+            SharedMediaPipeline::setUsbCaptureFormat(SharedMediaPipeline::UsbFormat::MJPEG);
+        } else if (usb_format == "raw") {
+            SharedMediaPipeline::setUsbCaptureFormat(SharedMediaPipeline::UsbFormat::Raw);
+        } else {
+            std::cerr << "Unknown USB_CAMERA_FORMAT '" << usb_format << "' - using auto" << std::endl;
+            usb_format = "auto";
+        }
+    }
+
+    // VIDEO_PROFILE: output size and rate, WIDTHxHEIGHT@FPS (default 1280x720@30).
+    // The camera mode is picked to fit it with the least conversion/scaling.
+    std::string profile_display = "1280x720@30";
+    const char* profile_env = std::getenv("VIDEO_PROFILE");
+    if (profile_env && profile_env[0]) {
+        int width = 0, height = 0, fps = 30;
+        if (sscanf(profile_env, "%dx%d@%d", &width, &height, &fps) >= 2 && width > 0 && height > 0) {
+            SharedMediaPipeline::setOutputProfile(width, height, fps);
+            profile_display = std::to_string(width) + "x" + std::to_string(height) + "@" + std::to_string(fps);
+        } else {
+            std::cerr << "Invalid VIDEO_PROFILE '" << profile_env << "' - using " << profile_display << std::endl;
+        }
+    }
+
+    // CAMERA_MODE_CACHE: where enumerated camera modes are kept between runs
+    // ("off" = probe every start)
+    const char* mode_cache_env = std::getenv("CAMERA_MODE_CACHE");
+    if (mode_cache_env && mode_cache_env[0]) {
+        CameraProbe::setCacheFile(std::string(mode_cache_env) == "off" ? "" : mode_cache_env);
+    }
+
+    // CAPTURE_STALL_MS: restart the camera source after this long without
+    // video, keeping viewers connected (default 2000, 0 = never)
+    const char* stall_env = std::getenv("CAPTURE_STALL_MS");
+    int stall_ms = stall_env && stall_env[0] ? std::atoi(stall_env) : 2000;
+    SharedMediaPipeline::setStallWatchdog(stall_ms);
+    std::string watchdog_display = stall_ms > 0 ? "restart after " + std::to_string(stall_ms) + "ms stall" : "off";
+
+    // DVR_SECONDS: keep this much encoded media in memory for time-shifted
+    // viewing (default 0 = off), bounded by DVR_MAX_MB (default 64).
+    // DVR_SPILL_DIR + DVR_SPILL_SECONDS keep older GOPs on disk for longer.
+    const char* dvr_env = std::getenv("DVR_SECONDS");
+    const char* dvr_max_env = std::getenv("DVR_MAX_MB");
+    const char* dvr_spill_dir_env = std::getenv("DVR_SPILL_DIR");
+    const char* dvr_spill_env = std::getenv("DVR_SPILL_SECONDS");
+    std::string dvr_display = "off";
+    int dvr_seconds = dvr_env && dvr_env[0] ? std::atoi(dvr_env) : 0;
+    if (dvr_seconds > 0) {
+        int dvr_max_mb = dvr_max_env && dvr_max_env[0] ? std::atoi(dvr_max_env) : 64;
+        std::string spill_dir = dvr_spill_dir_env ? dvr_spill_dir_env : "";
+        int spill_seconds = dvr_spill_env && dvr_spill_env[0] ? std::atoi(dvr_spill_env) : 600;
+        SharedMediaPipeline::setDvr(dvr_seconds, dvr_max_mb, spill_dir, spill_seconds);
+        dvr_display = std::to_string(dvr_seconds) + "s in memory (max " + std::to_string(dvr_max_mb) + " MB)";
+        if (!spill_dir.empty() && spill_seconds > 0) {
+            dvr_display += " + " + std::to_string(spill_seconds) + "s in " + spill_dir;
+        }
+    }
+
+    // CLIP_DIR: write an event clip there on every motion/alarm event (default
+    // off), CLIP_PRE_SECONDS before to CLIP_POST_SECONDS after it, at most
+    // CLIP_MAX_CONCURRENT at a time. Uses the DVR ring (kept small without DVR_SECONDS).
+    const char* clip_dir_env = std::getenv("CLIP_DIR");
+    const char* clip_pre_env = std::getenv("CLIP_PRE_SECONDS");
+    const char* clip_post_env = std::getenv("CLIP_POST_SECONDS");
+    const char* clip_max_env = std::getenv("CLIP_MAX_CONCURRENT");
+    std::string clip_display = "off";
+    if (clip_dir_env && clip_dir_env[0]) {
+        int clip_pre = clip_pre_env && clip_pre_env[0] ? std::atoi(clip_pre_env) : 10;
+        int clip_post = clip_post_env && clip_post_env[0] ? std::atoi(clip_post_env) : 20;
+        int clip_max = clip_max_env && clip_max_env[0] ? std::atoi(clip_max_env) : 3;
+        SharedMediaPipeline::setClipExport(clip_dir_env, clip_pre, clip_post, clip_max);
+        clip_display = std::to_string(clip_pre) + "s + " + std::to_string(clip_post) + "s to " +
+                       clip_dir_env + " (" + std::to_string(clip_max) + " at a time)";
+    }
+
+    // RTSP_PORT: serve the stream to RTSP clients (NVRs) on this port, e.g.
+    // 8554 (default 0 = off), at RTSP_PATH (default /stream). RTSP_PROTOCOLS
+    // is "tcp", "udp" or "tcp,udp" (default). A client more than
+    // RTSP_CLIENT_QUEUE_KB (512) behind loses packets until it catches up;
+    // at most RTSP_MAX_CLIENTS (8) are served.
+    const char* rtsp_port_env = std::getenv("RTSP_PORT");
+    const char* rtsp_path_env = std::getenv("RTSP_PATH");
+    const char* rtsp_protocols_env = std::getenv("RTSP_PROTOCOLS");
+    const char* rtsp_queue_env = std::getenv("RTSP_CLIENT_QUEUE_KB");
+    const char* rtsp_max_env = std::getenv("RTSP_MAX_CLIENTS");
+    std::string rtsp_display = "off";
+    int rtsp_port = rtsp_port_env && rtsp_port_env[0] ? std::atoi(rtsp_port_env) : 0;
+    if (rtsp_port > 0) {
+        std::string path = rtsp_path_env && rtsp_path_env[0] ? rtsp_path_env : "/stream";
+        std::string protocols = rtsp_protocols_env && rtsp_protocols_env[0] ? rtsp_protocols_env : "tcp,udp";
+        bool tcp = protocols.find("tcp") != std::string::npos;
+        bool udp = protocols.find("udp") != std::string::npos;
+        int queue_kb = rtsp_queue_env && rtsp_queue_env[0] ? std::atoi(rtsp_queue_env) : 512;
+        int max_clients = rtsp_max_env && rtsp_max_env[0] ? std::atoi(rtsp_max_env) : 8;
+        SharedMediaPipeline::setRtspServer(rtsp_port, path, tcp, udp, queue_kb, max_clients);
+        rtsp_display = "port " + std::to_string(rtsp_port) + " " + path + " (" + protocols + ", " +
+                       std::to_string(queue_kb) + " KB/client, max " + std::to_string(max_clients) + ")";
+    }
+
+    // SRT_URL: send an MPEG-TS contribution feed over SRT, e.g.
+    // srt://studio.example.com:9000?mode=caller (default off). SRT_LATENCY_MS
+    // (500) is the retransmission window - about 4x the link RTT.
+    // SRT_PASSPHRASE encrypts; SRT_BUFFER_KB (2048) bounds what waits for the link.
+    const char* srt_url_env = std::getenv("SRT_URL");
+    const char* srt_latency_env = std::getenv("SRT_LATENCY_MS");
+    const char* srt_passphrase_env = std::getenv("SRT_PASSPHRASE");
+    const char* srt_buffer_env = std::getenv("SRT_BUFFER_KB");
+    std::string srt_display = "off";
+    if (srt_url_env && srt_url_env[0]) {
+        int srt_latency = srt_latency_env && srt_latency_env[0] ? std::atoi(srt_latency_env) : 500;
+        int srt_buffer_kb = srt_buffer_env && srt_buffer_env[0] ? std::atoi(srt_buffer_env) : 2048;
+        std::string passphrase = srt_passphrase_env ? srt_passphrase_env : "";
+        SharedMediaPipeline::setSrtOutput(srt_url_env, srt_latency, passphrase, srt_buffer_kb);
+        srt_display = std::string(srt_url_env) + " (latency " + std::to_string(srt_latency) + "ms, " +
+                      std::to_string(srt_buffer_kb) + " KB buffer" + (passphrase.empty() ? "" : ", encrypted") + ")";
+    }
+
+    // SHM_STREAM_NAME: publish the encoded stream to local processes through
+    // a shared-memory ring (/dev/shm/<name>, default off) of SHM_STREAM_MB
+    // (16). Readers use libshm_stream_client - see include/shm_stream.h.
+    const char* shm_name_env = std::getenv("SHM_STREAM_NAME");
+    const char* shm_size_env = std::getenv("SHM_STREAM_MB");
+    std::string shm_display = "off";
+    if (shm_name_env && shm_name_env[0]) {
+        int shm_mb = shm_size_env && shm_size_env[0] ? std::atoi(shm_size_env) : 16;
+        SharedMediaPipeline::setShmOutput(shm_name_env, shm_mb);
+        shm_display = std::string(shm_name_env) + " (" + std::to_string(shm_mb) + " MB)";
+    }
+
+    // RTX_HISTORY_MS: how long sent video packets are kept to answer viewers'
+    // NACKs (1000; 0 = no retransmission). One history serves every viewer.
+    const char* rtx_history_env = std::getenv("RTX_HISTORY_MS");
+    int rtx_history_ms = rtx_history_env && rtx_history_env[0] ? std::atoi(rtx_history_env) : 1000;
+    SharedMediaPipeline::setRetransmission(rtx_history_ms);
+    std::string rtx_display = rtx_history_ms > 0
+        ? "shared history, " + std::to_string(rtx_history_ms) + "ms"
+        : "off";
+
+    // FEC_MODE=ulpfec offers ULPFEC/RED to viewers; each one's overhead then
+    // follows its reported loss, up to FEC_MAX_PERCENT (50) extra packets.
+    // Viewers with FEC switched on stop getting NACK retransmissions.
+    const char* fec_mode_env = std::getenv("FEC_MODE");
+    const char* fec_max_env = std::getenv("FEC_MAX_PERCENT");
+    bool fec_enabled = fec_mode_env && std::string(fec_mode_env) == "ulpfec";
+    int fec_max_percent = fec_max_env && fec_max_env[0] ? std::atoi(fec_max_env) : 50;
+    WebRTCPeer::setFec(fec_enabled, fec_max_percent);
+    std::string fec_display = fec_enabled
+        ? "ULPFEC/RED, loss-adaptive up to " + std::to_string(fec_max_percent) + "%"
+        : "off";
+
+    // PACING_MULTIPLIER: send each viewer's video at no more than this multiple
+    // of the encoder bitrate (default 0 = unpaced; 2.5 is a good start), so
+    // keyframes don't burst into shaped cellular links. PACING_MAX_DELAY_MS
+    // (100) caps what the pacer may add; PACING_QUEUE_KB (1024) bounds the
+    // per-viewer queue holding the burst.
+    const char* pacing_env = std::getenv("PACING_MULTIPLIER");
+    const char* pacing_delay_env = std::getenv("PACING_MAX_DELAY_MS");
+    const char* pacing_queue_env = std::getenv("PACING_QUEUE_KB");
+    double pacing_multiplier = pacing_env && pacing_env[0] ? std::atof(pacing_env) : 0;
+    int pacing_max_delay = pacing_delay_env && pacing_delay_env[0] ? std::atoi(pacing_delay_env) : 100;
+    int pacing_queue_kb = pacing_queue_env && pacing_queue_env[0] ? std::atoi(pacing_queue_env) : 1024;
+    WebRTCPeer::setPacing(pacing_multiplier, pacing_max_delay, pacing_queue_kb);
+    std::string pacing_display = "off";
+    if (pacing_multiplier > 0) {
+        std::ostringstream pacing_stream;
+        pacing_stream << pacing_multiplier << "x bitrate, max " << pacing_max_delay << "ms, "
+                      << pacing_queue_kb << " KB queue";
+        pacing_display = pacing_stream.str();
+    }
+
+    // SNAPSHOT_QUALITY: JPEG quality (80) of /snapshot/<stream>.jpg on the
+    // signaling server. A snapshot of a keyframe older than SNAPSHOT_MAX_AGE_MS
+    // (5000) also forces a new one, for long GOPs and intra refresh.
+    const char* snapshot_quality_env = std::getenv("SNAPSHOT_QUALITY");
+    const char* snapshot_age_env = std::getenv("SNAPSHOT_MAX_AGE_MS");
+    int snapshot_quality = snapshot_quality_env && snapshot_quality_env[0] ? std::atoi(snapshot_quality_env) : 80;
+    int snapshot_max_age = snapshot_age_env && snapshot_age_env[0] ? std::atoi(snapshot_age_env) : 5000;
+    SharedMediaPipeline::setSnapshots(snapshot_quality, snapshot_max_age);
+    std::string snapshot_display = "JPEG quality " + std::to_string(snapshot_quality) +
+                                   ", keyframe max age " + std::to_string(snapshot_max_age) + "ms";
+
+    // LOOPBACK_VIEWERS (test only, default 0): this many synthetic viewers
+    // join from inside the process and log their frame rate, freezes and
+    // latency every metrics interval and at exit. NETSIM_SCRIPT puts their
+    // video behind a simulated network - a script file, or the script itself
+    // ("0 loss=2 burst=3 delay=40; 30 rate=1500"); see net_impairment.h.
+    // NETSIM_SEED (1) fixes the random loss pattern.
+    const char* loopback_env = std::getenv("LOOPBACK_VIEWERS");
+    const char* netsim_env = std::getenv("NETSIM_SCRIPT");
+    const char* netsim_seed_env = std::getenv("NETSIM_SEED");
+    int loopback_viewers = loopback_env && loopback_env[0] ? std::atoi(loopback_env) : 0;
+    guint32 netsim_seed = netsim_seed_env && netsim_seed_env[0] ? (guint32)std::atoi(netsim_seed_env) : 1;
+    std::vector<NetImpairment::Step> netsim_steps;
+    std::string loopback_display = std::to_string(loopback_viewers) + " viewers, unimpaired";
+    if (netsim_env && netsim_env[0]) {
+        std::string script = netsim_env;
+        std::ifstream script_file(netsim_env);
+        if (script_file) {
+            std::stringstream contents;
+            contents << script_file.rdbuf();
+            script = contents.str();
+        }
+        std::string error;
+        if (!NetImpairment::parseScript(script, netsim_steps, error)) {
+            std::cerr << "NETSIM_SCRIPT: " << error << std::endl;
+            return 1;
+        }
+        loopback_display = std::to_string(loopback_viewers) + " viewers, " +
+                           NetImpairment::describe(netsim_steps) + ", seed " + std::to_string(netsim_seed);
+    }
+
     std::string camera_display = (camera_type == SharedMediaPipeline::CameraType::CSI)
-        ? "CSI (Pi Camera Module)"
-        : "USB (" + video_device + ")";
+        ? "CSI (Pi Camera Module), " + profile_display
+        : "USB (" + video_device + ", format " + usb_format + "), " + profile_display;
 
     // Check for TURN server configuration
-    // Priority: 1. Cloudflare TURN (dynamic credentials)
-    //           2. Static TURN server from environment
+    // Cloudflare TURN (dynamic credentials) and static TURN servers from the
+    // environment are combined - peers race all of their relays until one has
+    // won on the viewer's network, then get only that winner and a fallback
     std::string turn_display = "Not configured";
+    std::vector<std::string> turn_providers;
 
-    // Try Cloudflare TURN first (from .env file or environment)
+    // Cloudflare TURN (from .env file or environment)
     if (CloudflareTurn::instance().loadConfigFromEnv()) {
         // Test fetching credentials to validate configuration
         auto creds = CloudflareTurn::instance().getCredentials();
         if (creds.valid) {
             WebRTCPeer::enableCloudflareTurn();
-            turn_display = "Cloudflare TURN (dynamic credentials)";
+            turn_providers.push_back("Cloudflare (dynamic credentials)");
         } else {
             std::cerr << "Warning: Cloudflare TURN configured but failed to fetch credentials" << std::endl;
         }
     }
 
-    // Fallback to static TURN server from environment if Cloudflare not configured
-    if (!WebRTCPeer::isUsingCloudflareTurn()) {
-        const char* turn_uri_env = std::getenv("TURN_SERVER");
-        const char* turn_user_env = std::getenv("TURN_USERNAME");
-        const char* turn_pass_env = std::getenv("TURN_PASSWORD");
+    // Static TURN servers - comma-separated, sharing one username/password
+    // e.g. TURN_SERVER=turn:turn.example.com:3478,turns:turn.example.com:5349
+    const char* turn_uri_env = std::getenv("TURN_SERVER");
+    const char* turn_user_env = std::getenv("TURN_USERNAME");
+    const char* turn_pass_env = std::getenv("TURN_PASSWORD");
+
+    for (const auto& uri : splitEnvList(turn_uri_env)) {
+        WebRTCPeer::TurnConfig turn_config;
+        turn_config.uri = uri;
+        if (turn_user_env) turn_config.username = turn_user_env;
+        if (turn_pass_env) turn_config.password = turn_pass_env;
+        WebRTCPeer::addTurnServer(turn_config);
+        turn_providers.push_back(uri);
+    }
 
-        if (turn_uri_env && turn_uri_env[0]) {
-            WebRTCPeer::TurnConfig turn_config;
-            turn_config.uri = turn_uri_env;
-            if (turn_user_env) turn_config.username = turn_user_env;
-            if (turn_pass_env) turn_config.password = turn_pass_env;
-            WebRTCPeer::setTurnServer(turn_config);
-            turn_display = turn_config.uri;
+    for (size_t i = 0; i < turn_providers.size(); i++) {
+        turn_display = (i == 0 ? "" : turn_display + ", ") + turn_providers[i];
+    }
+
+    // ICE gathering policy - only applied if any ICE_* variable is set
+    const char* ice_allow_env = std::getenv("ICE_INTERFACE_ALLOW");
+    const char* ice_deny_env = std::getenv("ICE_INTERFACE_DENY");
+    const char* ice_family_env = std::getenv("ICE_IP_FAMILY");            // any | ipv4 | ipv6
+    const char* ice_transport_env = std::getenv("ICE_TRANSPORT_POLICY");  // all | relay
+    const char* ice_tcp_env = std::getenv("ICE_TCP");                     // 1 | 0
+    const char* ice_stun_env = std::getenv("ICE_STUN_MODE");              // always | cached | off
+    std::string ice_display = "Default (all interfaces, STUN per viewer)";
+
+    if (ice_allow_env || ice_deny_env || ice_family_env || ice_transport_env || ice_tcp_env || ice_stun_env) {
+        WebRTCPeer::IcePolicy policy;
+        policy.interface_allow = splitEnvList(ice_allow_env);
+        policy.interface_deny = splitEnvList(ice_deny_env);
+
+        std::string family = ice_family_env ? ice_family_env : "any";
+        if (family == "ipv4") {
+            policy.ip_family = WebRTCPeer::IcePolicy::IpFamily::IPv4;
+        } else if (family == "ipv6") {
+            policy.ip_family = WebRTCPeer::IcePolicy::IpFamily::IPv6;
+        }
+
+        policy.relay_only = ice_transport_env && std::string(ice_transport_env) == "relay";
+        policy.tcp_candidates = !(ice_tcp_env && std::string(ice_tcp_env) == "0");
+
+        std::string stun = ice_stun_env ? ice_stun_env : "always";
+        if (stun == "cached") {
+            policy.stun_mode = WebRTCPeer::IcePolicy::StunMode::Cached;
+        } else if (stun == "off") {
+            policy.stun_mode = WebRTCPeer::IcePolicy::StunMode::Off;
         }
+
+        WebRTCPeer::setIcePolicy(policy);
+        ice_display = "Policy (family=" + family + ", stun=" + stun +
+                      (policy.relay_only ? ", relay-only" : "") + ")";
     }
 
     std::cout << "\n=====================================" << std::endl;
@@ -263,15 +905,35 @@ int main(int argc, char* argv[]) {
     std::cout << "Signaling: " << signaling_url << std::endl;
     std::cout << "Stream ID: " << stream_id << std::endl;
     std::cout << "Camera:    " << camera_display << std::endl;
+    std::cout << "Watchdog:  " << watchdog_display << std::endl;
     std::cout << "Audio:     " << audio_device << std::endl;
+    std::cout << "Encoder:   " << encoder_display << std::endl;
     std::cout << "TURN:      " << turn_display << std::endl;
+    std::cout << "ICE:       " << ice_display << std::endl;
+    std::cout << "Playout:   " << playout_display << std::endl;
+    std::cout << "DVR:       " << dvr_display << std::endl;
+    std::cout << "Clips:     " << clip_display << std::endl;
+    std::cout << "RTSP:      " << rtsp_display << std::endl;
+    std::cout << "SRT:       " << srt_display << std::endl;
+    std::cout << "Shm:       " << shm_display << std::endl;
+    std::cout << "NACK:      " << rtx_display << std::endl;
+    std::cout << "FEC:       " << fec_display << std::endl;
+    std::cout << "Pacing:    " << pacing_display << std::endl;
+    std::cout << "Snapshots: " << snapshot_display << std::endl;
+    if (loopback_viewers > 0) {
+        std::cout << "Loopback:  " << loopback_display << std::endl;
+    }
+    if (handoff_mode) {
+        std::cout << "Handoff:   ENABLED (taking over from running broadcaster)" << std::endl;
+    }
     if (turn_display == "Not configured") {
         std::cout << "           (Set TURN_SERVER, TURN_USERNAME, TURN_PASSWORD env vars for NAT traversal)" << std::endl;
     }
     std::cout << "=====================================\n" << std::endl;
 
     // Create and start stream manager
-    StreamManager manager(signaling_url, stream_id, camera_type);
+    StreamManager manager(signaling_url, stream_id, camera_type, handoff_mode);
+    manager.setLoopbackViewers(loopback_viewers, netsim_steps, netsim_seed);
 
     if (!manager.start(video_device, audio_device)) {
         return 1;
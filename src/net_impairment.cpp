@@ -0,0 +1,375 @@
+#include "net_impairment.h"
+#include "stream_metrics.h"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
+// ==================== DEBUG LOGGING ====================
+#define DEBUG_LOGGING 1
+
+static std::string getTimestamp() {
+    auto now = std::chrono::system_clock::now();
+    auto time = std::chrono::system_clock::to_time_t(now);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        now.time_since_epoch()) % 1000;
+    std::stringstream ss;
+    ss << std::put_time(std::localtime(&time), "%H:%M:%S")
+       << "." << std::setfill('0') << std::setw(3) << ms.count();
+    return ss.str();
+}
+
+#if DEBUG_LOGGING
+#define LOG(category, msg) \
+    std::cout << "[" << getTimestamp() << "] [" << category << "] " << msg << std::endl
+#define LOG_VAR(category, msg, var) \
+    std::cout << "[" << getTimestamp() << "] [" << category << "] " << msg << var << std::endl
+#else
+#define LOG(category, msg)
+#define LOG_VAR(category, msg, var)
+#endif
+
+static std::string trim(const std::string& text) {
+    size_t start = text.find_first_not_of(" \t\r");
+    if (start == std::string::npos) {
+        return "";
+    }
+    size_t end = text.find_last_not_of(" \t\r");
+    return text.substr(start, end - start + 1);
+}
+
+// Apply one "key=value" to settings; false if the key or value is not valid
+static bool applySetting(const std::string& token, NetImpairment::Settings& settings) {
+    size_t eq = token.find('=');
+    if (eq == std::string::npos || eq == 0 || eq == token.size() - 1) {
+        return false;
+    }
+    std::string key = token.substr(0, eq);
+    std::string value = token.substr(eq + 1);
+    char* end = nullptr;
+    double number = std::strtod(value.c_str(), &end);
+    if (*end != '\0' || number < 0) {
+        return false;
+    }
+
+    if (key == "loss") {
+        settings.loss_percent = std::min(number, 100.0);
+    } else if (key == "burst") {
+        settings.burst_packets = std::max(number, 1.0);
+    } else if (key == "delay") {
+        settings.delay_ms = (int)number;
+    } else if (key == "jitter") {
+        settings.jitter_ms = (int)number;
+    } else if (key == "reorder") {
+        settings.reorder = number != 0;
+    } else if (key == "rate") {
+        settings.rate_kbps = (int)number;
+    } else if (key == "buffer") {
+        settings.buffer_ms = (int)number;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool NetImpairment::parseScript(const std::string& text, std::vector<Step>& steps, std::string& error) {
+    steps.clear();
+    std::string normalized = text;
+    std::replace(normalized.begin(), normalized.end(), ';', '\n');
+
+    std::istringstream lines(normalized);
+    std::string line;
+    Settings settings;
+    while (std::getline(lines, line)) {
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) {
+            continue;
+        }
+        if (!steps.empty() && steps.back().repeat) {
+            error = "nothing may follow 'repeat': " + line;
+            return false;
+        }
+
+        std::istringstream tokens(line);
+        std::string at;
+        tokens >> at;
+        char* end = nullptr;
+        double seconds = std::strtod(at.c_str(), &end);
+        if (*end != '\0' || seconds < 0) {
+            error = "step must start with its time in seconds: " + line;
+            return false;
+        }
+
+        Step step;
+        step.at_ms = (int)(seconds * 1000);
+        if (!steps.empty() && step.at_ms < steps.back().at_ms) {
+            error = "steps must be in time order: " + line;
+            return false;
+        }
+
+        std::string token;
+        while (tokens >> token) {
+            if (token == "repeat") {
+                step.repeat = true;
+            } else if (!applySetting(token, settings)) {
+                error = "bad setting '" + token + "' in: " + line;
+                return false;
+            }
+        }
+        if (step.repeat && step.at_ms == 0) {
+            error = "repeat needs a time after 0";
+            return false;
+        }
+        step.settings = settings;
+        steps.push_back(step);
+    }
+
+    if (steps.empty()) {
+        error = "script has no steps";
+        return false;
+    }
+    return true;
+}
+
+static std::string describeSettings(const NetImpairment::Settings& settings) {
+    std::ostringstream out;
+    out << "loss " << settings.loss_percent << "%";
+    if (settings.loss_percent > 0 && settings.burst_packets > 1) {
+        out << " (bursts of " << settings.burst_packets << ")";
+    }
+    out << ", delay " << settings.delay_ms << "ms";
+    if (settings.jitter_ms > 0) {
+        out << " +-" << settings.jitter_ms << "ms" << (settings.reorder ? " reordering" : "");
+    }
+    if (settings.rate_kbps > 0) {
+        out << ", " << settings.rate_kbps << " kbps/" << settings.buffer_ms << "ms";
+    }
+    return out.str();
+}
+
+// "element:pad" - GST_DEBUG_PAD_NAME expands to two arguments, which a
+// stream expression can't take
+static std::string padName(GstPad* pad) {
+    GstObject* parent = GST_OBJECT_PARENT(pad);
+    return std::string(parent ? GST_OBJECT_NAME(parent) : "''") + ":" + GST_PAD_NAME(pad);
+}
+
+std::string NetImpairment::describe(const std::vector<Step>& steps) {
+    if (steps.size() == 1) {
+        return describeSettings(steps.front().settings);
+    }
+    std::ostringstream out;
+    out << steps.size() << " steps over " << steps.back().at_ms / 1000.0 << "s"
+        << (steps.back().repeat ? ", repeating" : "")
+        << ", starting with " << describeSettings(steps.front().settings);
+    return out.str();
+}
+
+NetImpairment::NetImpairment(const std::vector<Step>& steps, guint32 seed)
+    : steps_(steps)
+    , loss_random_(seed)
+    , jitter_random_(seed ^ 0x9E3779B9u)
+    , pad_(nullptr)
+    , peer_pad_(nullptr)
+    , probe_id_(0)
+    , attached_us_(0)
+    , link_free_us_(0)
+    , last_release_us_(0)
+    , bad_state_(false)
+    , stop_(false)
+    , lost_(0)
+    , queue_drops_(0)
+    , delivered_(0) {
+}
+
+NetImpairment::~NetImpairment() {
+    detach();
+    // A probe call racing detach() may have left a packet behind
+    for (auto& held : held_) {
+        gst_buffer_unref(held.second);
+    }
+}
+
+void NetImpairment::attach(GstPad* src_pad) {
+    if (pad_) {
+        return;
+    }
+    peer_pad_ = gst_pad_get_peer(src_pad);
+    if (!peer_pad_) {
+        LOG("NETSIM-WARN", padName(src_pad) << " is not linked - not impaired");
+        return;
+    }
+    pad_ = GST_PAD(gst_object_ref(src_pad));
+    attached_us_ = g_get_monotonic_time();
+    stop_ = false;
+    release_thread_ = std::thread(&NetImpairment::releaseLoop, this);
+
+    probe_id_ = gst_pad_add_probe(pad_,
+                     (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+                     impairProbe, this, nullptr);
+    LOG("NETSIM", "Impairing " << padName(pad_) << ": " << describe(steps_));
+}
+
+void NetImpairment::detach() {
+    if (!pad_) {
+        return;
+    }
+    gst_pad_remove_probe(pad_, probe_id_);
+    probe_id_ = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    release_thread_.join();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& held : held_) {
+        gst_buffer_unref(held.second);
+    }
+    held_.clear();
+    flushMetrics();
+    gst_object_unref(peer_pad_);
+    peer_pad_ = nullptr;
+    gst_object_unref(pad_);
+    pad_ = nullptr;
+}
+
+GstPadProbeReturn NetImpairment::impairProbe(GstPad* pad, GstPadProbeInfo* info, gpointer user_data) {
+    NetImpairment* self = static_cast<NetImpairment*>(user_data);
+    gint64 now_us = g_get_monotonic_time();
+    std::lock_guard<std::mutex> lock(self->mutex_);
+    if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+        GstBufferList* list = GST_PAD_PROBE_INFO_BUFFER_LIST(info);
+        guint length = gst_buffer_list_length(list);
+        for (guint i = 0; i < length; i++) {
+            self->submit(gst_buffer_ref(gst_buffer_list_get(list, i)), now_us);
+        }
+    } else {
+        self->submit(gst_buffer_ref(GST_PAD_PROBE_INFO_BUFFER(info)), now_us);
+    }
+    return GST_PAD_PROBE_DROP;
+}
+
+const NetImpairment::Settings& NetImpairment::currentSettings(gint64 now_us) const {
+    static const Settings unimpaired;
+
+    gint64 elapsed_ms = (now_us - attached_us_) / 1000;
+    if (steps_.back().repeat) {
+        elapsed_ms %= steps_.back().at_ms;
+    }
+
+    const Settings* current = &unimpaired;
+    for (const Step& step : steps_) {
+        if (step.at_ms > elapsed_ms || step.repeat) {
+            break;
+        }
+        current = &step.settings;
+    }
+    return *current;
+}
+
+bool NetImpairment::isLost(const Settings& settings) {
+    double loss = settings.loss_percent / 100.0;
+    if (loss <= 0) {
+        bad_state_ = false;
+        return false;
+    }
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    if (settings.burst_packets <= 1 || loss >= 1) {
+        return uniform(loss_random_) < loss;
+    }
+
+    // Two-state (Gilbert) model: every packet in the bad state is lost, and
+    // the bad state is left with probability 1/burst, so bursts average
+    // burst packets. Entering it at loss/(1-loss) of that keeps the average.
+    double leave_bad = 1.0 / settings.burst_packets;
+    double enter_bad = std::min(1.0, loss * leave_bad / (1.0 - loss));
+    if (bad_state_) {
+        bad_state_ = uniform(loss_random_) >= leave_bad;
+    } else {
+        bad_state_ = uniform(loss_random_) < enter_bad;
+    }
+    return bad_state_;
+}
+
+void NetImpairment::submit(GstBuffer* packet, gint64 now_us) {
+    if (stop_) {
+        gst_buffer_unref(packet);
+        return;
+    }
+    const Settings& settings = currentSettings(now_us);
+
+    if (isLost(settings)) {
+        lost_++;
+        gst_buffer_unref(packet);
+        return;
+    }
+
+    // Bottleneck: packets leave one after another at the rate, waiting in a
+    // drop-tail queue of buffer_ms
+    gint64 depart_us = now_us;
+    if (settings.rate_kbps > 0) {
+        gint64 free_us = std::max(link_free_us_, now_us);
+        if (free_us - now_us > (gint64)settings.buffer_ms * 1000) {
+            queue_drops_++;
+            gst_buffer_unref(packet);
+            return;
+        }
+        free_us += (gint64)gst_buffer_get_size(packet) * 8000 / settings.rate_kbps;
+        link_free_us_ = free_us;
+        depart_us = free_us;
+    } else {
+        link_free_us_ = now_us;
+    }
+
+    gint64 release_us = depart_us + (gint64)settings.delay_ms * 1000;
+    if (settings.jitter_ms > 0) {
+        std::uniform_int_distribution<gint64> jitter(-(gint64)settings.jitter_ms * 1000,
+                                                     (gint64)settings.jitter_ms * 1000);
+        release_us = std::max(release_us + jitter(jitter_random_), depart_us);
+    }
+    if (!settings.reorder) {
+        release_us = std::max(release_us, last_release_us_);
+    }
+    last_release_us_ = std::max(last_release_us_, release_us);
+
+    held_.emplace(release_us, packet);
+    cv_.notify_one();
+}
+
+void NetImpairment::releaseLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_) {
+        if (held_.empty()) {
+            cv_.wait(lock);
+            continue;
+        }
+        gint64 wait_us = held_.begin()->first - g_get_monotonic_time();
+        if (wait_us > 0) {
+            cv_.wait_for(lock, std::chrono::microseconds(wait_us));
+            continue;
+        }
+
+        GstBuffer* packet = held_.begin()->second;
+        held_.erase(held_.begin());
+        lock.unlock();
+        gst_pad_chain(peer_pad_, packet);
+        lock.lock();
+
+        if (++delivered_ % METRICS_FLUSH_PACKETS == 0) {
+            flushMetrics();
+        }
+    }
+}
+
+void NetImpairment::flushMetrics() {
+    StreamMetrics& metrics = StreamMetrics::instance();
+    if (lost_) metrics.increment("netsim.lost", lost_);
+    if (queue_drops_) metrics.increment("netsim.queue_drops", queue_drops_);
+    if (delivered_) metrics.increment("netsim.delivered", delivered_);
+    lost_ = queue_drops_ = delivered_ = 0;
+}
@@ -0,0 +1,202 @@
+#include "rtp_header_extensions.h"
+#include <iostream>
+
+#if GST_CHECK_VERSION(1, 20, 0)
+
+#include <gst/rtp/rtp.h>
+
+// Seconds between the NTP epoch (1900) and the Unix epoch (1970)
+static const guint64 NTP_UNIX_OFFSET_SECONDS = 2208988800ULL;
+
+// ============================================================================
+// playout-delay
+// ============================================================================
+
+typedef struct {
+    GstRTPHeaderExtension parent;
+    guint min_ms;
+    guint max_ms;
+} PlayoutDelayExt;
+
+typedef struct {
+    GstRTPHeaderExtensionClass parent_class;
+} PlayoutDelayExtClass;
+
+G_DEFINE_TYPE(PlayoutDelayExt, playout_delay_ext, GST_TYPE_RTP_HEADER_EXTENSION)
+
+static GstRTPHeaderExtensionFlags playout_delay_ext_get_supported_flags(GstRTPHeaderExtension* ext) {
+    return static_cast<GstRTPHeaderExtensionFlags>(
+        GST_RTP_HEADER_EXTENSION_ONE_BYTE | GST_RTP_HEADER_EXTENSION_TWO_BYTE);
+}
+
+static gsize playout_delay_ext_get_max_size(GstRTPHeaderExtension* ext, const GstBuffer* input_meta) {
+    return 3;
+}
+
+static gssize playout_delay_ext_write(GstRTPHeaderExtension* ext, const GstBuffer* input_meta,
+                                      GstRTPHeaderExtensionFlags write_flags, GstBuffer* output,
+                                      guint8* data, gsize size) {
+    PlayoutDelayExt* self = reinterpret_cast<PlayoutDelayExt*>(ext);
+    if (size < 3) {
+        return -1;
+    }
+
+    // Two 12-bit values in 10ms units: MIN | MAX
+    guint min = MIN(self->min_ms / 10, 0xfff);
+    guint max = MIN(self->max_ms / 10, 0xfff);
+    data[0] = min >> 4;
+    data[1] = ((min & 0xf) << 4) | (max >> 8);
+    data[2] = max & 0xff;
+    return 3;
+}
+
+static gboolean playout_delay_ext_read(GstRTPHeaderExtension* ext, GstRTPHeaderExtensionFlags read_flags,
+                                       const guint8* data, gsize size, GstBuffer* buffer) {
+    // Send-only
+    return TRUE;
+}
+
+static void playout_delay_ext_class_init(PlayoutDelayExtClass* klass) {
+    GstRTPHeaderExtensionClass* ext_class = GST_RTP_HEADER_EXTENSION_CLASS(klass);
+    GstElementClass* element_class = GST_ELEMENT_CLASS(klass);
+
+    ext_class->get_supported_flags = playout_delay_ext_get_supported_flags;
+    ext_class->get_max_size = playout_delay_ext_get_max_size;
+    ext_class->write = playout_delay_ext_write;
+    ext_class->read = playout_delay_ext_read;
+
+    gst_element_class_set_static_metadata(element_class,
+        "Playout Delay RTP header extension", GST_RTP_HDREXT_ELEMENT_CLASS,
+        "Asks the receiver to bound its jitter buffer delay", "webrtc_streamer");
+    gst_rtp_header_extension_class_set_uri(ext_class, PLAYOUT_DELAY_URI);
+}
+
+static void playout_delay_ext_init(PlayoutDelayExt* self) {
+    self->min_ms = 0;
+    self->max_ms = 0;
+}
+
+GstElement* playout_delay_ext_new(guint min_ms, guint max_ms) {
+    PlayoutDelayExt* ext = static_cast<PlayoutDelayExt*>(g_object_new(playout_delay_ext_get_type(), nullptr));
+    ext->min_ms = min_ms;
+    ext->max_ms = MAX(min_ms, max_ms);
+    gst_rtp_header_extension_set_id(GST_RTP_HEADER_EXTENSION(ext), PLAYOUT_DELAY_EXT_ID);
+    return GST_ELEMENT(gst_object_ref_sink(ext));
+}
+
+// ============================================================================
+// abs-capture-time
+// ============================================================================
+
+typedef struct {
+    GstRTPHeaderExtension parent;
+    GWeakRef pipeline;              // Weak - the pipeline owns the payloader that owns us
+    GstClockTime last_pts;          // Only the first packet of a frame is stamped
+} AbsCaptureTimeExt;
+
+typedef struct {
+    GstRTPHeaderExtensionClass parent_class;
+} AbsCaptureTimeExtClass;
+
+G_DEFINE_TYPE(AbsCaptureTimeExt, abs_capture_time_ext, GST_TYPE_RTP_HEADER_EXTENSION)
+
+static GstRTPHeaderExtensionFlags abs_capture_time_ext_get_supported_flags(GstRTPHeaderExtension* ext) {
+    return static_cast<GstRTPHeaderExtensionFlags>(
+        GST_RTP_HEADER_EXTENSION_ONE_BYTE | GST_RTP_HEADER_EXTENSION_TWO_BYTE);
+}
+
+static gsize abs_capture_time_ext_get_max_size(GstRTPHeaderExtension* ext, const GstBuffer* input_meta) {
+    return 8;
+}
+
+static gssize abs_capture_time_ext_write(GstRTPHeaderExtension* ext, const GstBuffer* input_meta,
+                                         GstRTPHeaderExtensionFlags write_flags, GstBuffer* output,
+                                         guint8* data, gsize size) {
+    AbsCaptureTimeExt* self = reinterpret_cast<AbsCaptureTimeExt*>(ext);
+    GstClockTime pts = GST_BUFFER_PTS(input_meta);
+
+    if (size < 8 || !GST_CLOCK_TIME_IS_VALID(pts) || pts == self->last_pts) {
+        return 0;
+    }
+
+    GstElement* pipeline = static_cast<GstElement*>(g_weak_ref_get(&self->pipeline));
+    if (!pipeline) {
+        return 0;
+    }
+
+    GstClock* clock = gst_element_get_clock(pipeline);
+    GstClockTime base_time = gst_element_get_base_time(pipeline);
+    gst_object_unref(pipeline);
+    if (!clock) {
+        return 0;
+    }
+
+    // Live sources start their segment at 0, so PTS is the capture running time.
+    // Age of the frame on the pipeline clock, applied to the wall clock.
+    GstClockTime now = gst_clock_get_time(clock);
+    gst_object_unref(clock);
+    gint64 age_us = GST_CLOCK_DIFF(base_time + pts, now) / 1000;
+    gint64 capture_us = g_get_real_time() - MAX(age_us, 0);
+
+    // 64-bit NTP timestamp: 32.32 fixed point seconds since 1900
+    guint64 seconds = capture_us / G_USEC_PER_SEC + NTP_UNIX_OFFSET_SECONDS;
+    guint64 fraction = (static_cast<guint64>(capture_us % G_USEC_PER_SEC) << 32) / G_USEC_PER_SEC;
+    GST_WRITE_UINT64_BE(data, (seconds << 32) | fraction);
+
+    self->last_pts = pts;
+    return 8;
+}
+
+static gboolean abs_capture_time_ext_read(GstRTPHeaderExtension* ext, GstRTPHeaderExtensionFlags read_flags,
+                                          const guint8* data, gsize size, GstBuffer* buffer) {
+    // Send-only
+    return TRUE;
+}
+
+static void abs_capture_time_ext_finalize(GObject* object) {
+    AbsCaptureTimeExt* self = reinterpret_cast<AbsCaptureTimeExt*>(object);
+    g_weak_ref_clear(&self->pipeline);
+    G_OBJECT_CLASS(abs_capture_time_ext_parent_class)->finalize(object);
+}
+
+static void abs_capture_time_ext_class_init(AbsCaptureTimeExtClass* klass) {
+    GstRTPHeaderExtensionClass* ext_class = GST_RTP_HEADER_EXTENSION_CLASS(klass);
+    GstElementClass* element_class = GST_ELEMENT_CLASS(klass);
+
+    G_OBJECT_CLASS(klass)->finalize = abs_capture_time_ext_finalize;
+    ext_class->get_supported_flags = abs_capture_time_ext_get_supported_flags;
+    ext_class->get_max_size = abs_capture_time_ext_get_max_size;
+    ext_class->write = abs_capture_time_ext_write;
+    ext_class->read = abs_capture_time_ext_read;
+
+    gst_element_class_set_static_metadata(element_class,
+        "Absolute Capture Time RTP header extension", GST_RTP_HDREXT_ELEMENT_CLASS,
+        "Stamps the NTP capture time on the first packet of each frame", "webrtc_streamer");
+    gst_rtp_header_extension_class_set_uri(ext_class, ABS_CAPTURE_TIME_URI);
+}
+
+static void abs_capture_time_ext_init(AbsCaptureTimeExt* self) {
+    g_weak_ref_init(&self->pipeline, nullptr);
+    self->last_pts = GST_CLOCK_TIME_NONE;
+}
+
+GstElement* abs_capture_time_ext_new(GstElement* pipeline) {
+    AbsCaptureTimeExt* ext = static_cast<AbsCaptureTimeExt*>(g_object_new(abs_capture_time_ext_get_type(), nullptr));
+    g_weak_ref_set(&ext->pipeline, pipeline);
+    gst_rtp_header_extension_set_id(GST_RTP_HEADER_EXTENSION(ext), ABS_CAPTURE_TIME_EXT_ID);
+    return GST_ELEMENT(gst_object_ref_sink(ext));
+}
+
+#else
+
+GstElement* playout_delay_ext_new(guint min_ms, guint max_ms) {
+    std::cerr << "[RTP-EXT] playout-delay needs GStreamer 1.20 or newer" << std::endl;
+    return nullptr;
+}
+
+GstElement* abs_capture_time_ext_new(GstElement* pipeline) {
+    std::cerr << "[RTP-EXT] abs-capture-time needs GStreamer 1.20 or newer" << std::endl;
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,68 @@
+#include "rtp_history.h"
+#include "stream_metrics.h"
+
+RtpHistory::RtpHistory(int window_ms, size_t max_packets)
+    : window_ms_(window_ms)
+    , entries_(max_packets)
+    , next_index_(1)
+    , oldest_index_(1)
+    , bytes_(0) {
+}
+
+RtpHistory::~RtpHistory() {
+    for (Entry& entry : entries_) {
+        release(entry);
+    }
+}
+
+void RtpHistory::release(Entry& entry) {
+    if (entry.packet) {
+        bytes_ -= gst_buffer_get_size(entry.packet);
+        gst_buffer_unref(entry.packet);
+        entry.packet = nullptr;
+    }
+}
+
+guint64 RtpHistory::add(GstBuffer* packet) {
+    gint64 now_us = g_get_monotonic_time();
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Drop what aged out of the window, then make room in the ring
+    gint64 expired_us = now_us - (gint64)window_ms_ * 1000;
+    while (oldest_index_ < next_index_) {
+        Entry& oldest = entries_[oldest_index_ % entries_.size()];
+        if (oldest.added_us >= expired_us && next_index_ - oldest_index_ < entries_.size()) {
+            break;
+        }
+        release(oldest);
+        oldest_index_++;
+    }
+
+    guint64 index = next_index_++;
+    Entry& entry = entries_[index % entries_.size()];
+    entry.index = index;
+    entry.added_us = now_us;
+    GST_BUFFER_OFFSET(packet) = index;
+    entry.packet = gst_buffer_ref(packet);
+    bytes_ += gst_buffer_get_size(packet);
+
+    if (index % 128 == 0) {
+        StreamMetrics::instance().setGauge("rtx.history_packets", next_index_ - oldest_index_);
+        StreamMetrics::instance().setGauge("rtx.history_bytes", bytes_);
+    }
+    return index;
+}
+
+GstBuffer* RtpHistory::get(guint64 index) {
+    gint64 expired_us = g_get_monotonic_time() - (gint64)window_ms_ * 1000;
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (index < oldest_index_ || index >= next_index_) {
+        return nullptr;
+    }
+    Entry& entry = entries_[index % entries_.size()];
+    if (entry.index != index || !entry.packet || entry.added_us < expired_us) {
+        return nullptr;
+    }
+    return gst_buffer_ref(entry.packet);
+}
@@ -0,0 +1,290 @@
+#include "rtsp_egress.h"
+#include "stream_metrics.h"
+#include <iostream>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+
+// ==================== DEBUG LOGGING ====================
+#define DEBUG_LOGGING 1
+
+static std::string getTimestamp() {
+    auto now = std::chrono::system_clock::now();
+    auto time = std::chrono::system_clock::to_time_t(now);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        now.time_since_epoch()) % 1000;
+    std::stringstream ss;
+    ss << std::put_time(std::localtime(&time), "%H:%M:%S")
+       << "." << std::setfill('0') << std::setw(3) << ms.count();
+    return ss.str();
+}
+
+#if DEBUG_LOGGING
+#define LOG(category, msg) \
+    std::cout << "[" << getTimestamp() << "] [" << category << "] " << msg << std::endl
+#define LOG_VAR(category, msg, var) \
+    std::cout << "[" << getTimestamp() << "] [" << category << "] " << msg << var << std::endl
+#else
+#define LOG(category, msg)
+#define LOG_VAR(category, msg, var)
+#endif
+
+RtspEgress::RtspEgress(GstElement* pipeline, GstElement* video_tee, GstElement* audio_tee,
+                       const std::string& video_chain, std::function<void(const std::string&)> force_keyframe,
+                       const std::atomic<GstClockTime>* keyframe_pts, const Config& config)
+    : pipeline_(pipeline)
+    , video_tee_(video_tee)
+    , audio_tee_(audio_tee)
+    , force_keyframe_(force_keyframe)
+    , keyframe_pts_(keyframe_pts)
+    , config_(config)
+    , server_(gst_rtsp_server_new())
+    , factory_(gst_rtsp_media_factory_new())
+    , server_source_id_(0)
+    , retry_source_id_(0)
+    , last_video_pts_(GST_CLOCK_TIME_NONE)
+    , connections_(0) {
+    gst_rtsp_server_set_service(server_, std::to_string(config.port).c_str());
+
+    // Timestamps are cleared before the push - the tees' PTS are in the
+    // shared pipeline's running time, not the client media's
+    std::string launch =
+        "( appsrc name=vsrc is-live=true format=time do-timestamp=true ! " + video_chain +
+        " appsrc name=asrc is-live=true format=time do-timestamp=true ! rtpopusdepay ! rtpopuspay name=pay1 pt=97 )";
+    gst_rtsp_media_factory_set_launch(factory_, launch.c_str());
+    gst_rtsp_media_factory_set_shared(factory_, FALSE);
+
+    int protocols = 0;
+    if (config.tcp) protocols |= GST_RTSP_LOWER_TRANS_TCP;
+    if (config.udp) protocols |= GST_RTSP_LOWER_TRANS_UDP;
+    gst_rtsp_media_factory_set_protocols(factory_, static_cast<GstRTSPLowerTrans>(protocols));
+    g_signal_connect(factory_, "media-configure", G_CALLBACK(onMediaConfigure), this);
+
+    // Mount points take the factory's reference; keep one for ourselves
+    GstRTSPMountPoints* mounts = gst_rtsp_server_get_mount_points(server_);
+    gst_rtsp_mount_points_add_factory(mounts, config.path.c_str(),
+                                      GST_RTSP_MEDIA_FACTORY(g_object_ref(factory_)));
+    g_object_unref(mounts);
+
+    g_signal_connect(server_, "client-connected", G_CALLBACK(onClientConnected), this);
+}
+
+RtspEgress::~RtspEgress() {
+    if (retry_source_id_) {
+        g_source_remove(retry_source_id_);
+    }
+    if (server_source_id_) {
+        g_source_remove(server_source_id_);
+    }
+    gst_rtsp_server_client_filter(server_, removeClient, nullptr);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& client : clients_) {
+            g_signal_handlers_disconnect_by_data(client.media, this);
+            gst_object_unref(client.vsrc);
+            gst_object_unref(client.asrc);
+            g_object_unref(client.media);
+        }
+        clients_.clear();
+    }
+
+    video_tap_.reset();
+    audio_tap_.reset();
+
+    g_signal_handlers_disconnect_by_data(server_, this);
+    g_signal_handlers_disconnect_by_data(factory_, this);
+    g_object_unref(factory_);
+    g_object_unref(server_);
+    StreamMetrics::instance().setGauge("rtsp.clients", 0);
+}
+
+bool RtspEgress::start() {
+    video_tap_.reset(new TeeTap(pipeline_, video_tee_, "rtsp_video",
+                                [this](GstBuffer* buffer) { deliver(buffer, true); }));
+    audio_tap_.reset(new TeeTap(pipeline_, audio_tee_, "rtsp_audio",
+                                [this](GstBuffer* buffer) { deliver(buffer, false); }));
+    if (!video_tap_->attach() || !audio_tap_->attach()) {
+        LOG("RTSP-ERROR", "Cannot tap the shared pipeline");
+        return false;
+    }
+
+    if (!attach()) {
+        LOG("RTSP-WARN", "Port " << config_.port << " busy - retrying every "
+            << ATTACH_RETRY_MS << "ms");
+        retry_source_id_ = g_timeout_add(ATTACH_RETRY_MS, onRetryAttach, this);
+    }
+    return true;
+}
+
+bool RtspEgress::attach() {
+    server_source_id_ = gst_rtsp_server_attach(server_, nullptr);
+    if (server_source_id_ == 0) {
+        return false;
+    }
+    LOG("RTSP", "Serving rtsp://0.0.0.0:" << config_.port << config_.path
+        << " (" << (config_.tcp ? "tcp" : "") << (config_.tcp && config_.udp ? "+" : "")
+        << (config_.udp ? "udp" : "") << ", up to " << config_.max_clients << " clients)");
+    return true;
+}
+
+gboolean RtspEgress::onRetryAttach(gpointer user_data) {
+    RtspEgress* self = static_cast<RtspEgress*>(user_data);
+    if (!self->attach()) {
+        return TRUE;
+    }
+    self->retry_source_id_ = 0;
+    return FALSE;
+}
+
+void RtspEgress::deliver(GstBuffer* buffer, bool video) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // The payloaders keep the frame's PTS, so the first packet carrying the
+    // last keyframe's PTS starts that keyframe
+    bool keyframe_start = false;
+    if (video) {
+        GstClockTime pts = GST_BUFFER_PTS(buffer);
+        keyframe_start = GST_CLOCK_TIME_IS_VALID(pts) && pts != last_video_pts_ &&
+                         pts == keyframe_pts_->load();
+        last_video_pts_ = pts;
+    }
+
+    for (auto& client : clients_) {
+        GstElement* src = video ? client.vsrc : client.asrc;
+        guint64 level = 0;
+        g_object_get(src, "current-level-bytes", &level, nullptr);
+
+        // Slow client: drop at its appsrc rather than queue without bound.
+        // Video resumes once it has drained, at the next keyframe.
+        if (level > config_.client_queue_bytes) {
+            if (video && !client.dropping) {
+                client.dropping = true;
+                LOG("RTSP-WARN", "Client queue over " << (config_.client_queue_bytes >> 10)
+                    << " KB - dropping until it drains");
+                StreamMetrics::instance().increment("rtsp.overflows");
+            }
+            client.dropped++;
+            StreamMetrics::instance().increment("rtsp.dropped");
+            continue;
+        }
+        if (video && client.dropping) {
+            if (level > config_.client_queue_bytes / 2) {
+                client.dropped++;
+                StreamMetrics::instance().increment("rtsp.dropped");
+                continue;
+            }
+            client.dropping = false;
+            client.wait_keyframe = true;
+            force_keyframe_("rtsp");
+        }
+        if (video && client.wait_keyframe) {
+            if (!keyframe_start) {
+                continue;
+            }
+            client.wait_keyframe = false;
+        }
+
+        // Shallow copy - the payload memory is shared with the other clients
+        GstBuffer* copy = gst_buffer_copy(buffer);
+        GST_BUFFER_PTS(copy) = GST_CLOCK_TIME_NONE;
+        GST_BUFFER_DTS(copy) = GST_CLOCK_TIME_NONE;
+        GstFlowReturn ret = GST_FLOW_OK;
+        g_signal_emit_by_name(src, "push-buffer", copy, &ret);
+        gst_buffer_unref(copy);
+    }
+}
+
+void RtspEgress::onMediaConfigure(GstRTSPMediaFactory* factory, GstRTSPMedia* media, gpointer user_data) {
+    (void)factory;
+    RtspEgress* self = static_cast<RtspEgress*>(user_data);
+    GstElement* element = gst_rtsp_media_get_element(media);
+    GstElement* vsrc = gst_bin_get_by_name_recurse_up(GST_BIN(element), "vsrc");
+    GstElement* asrc = gst_bin_get_by_name_recurse_up(GST_BIN(element), "asrc");
+    gst_object_unref(element);
+    if (!vsrc || !asrc) {
+        if (vsrc) gst_object_unref(vsrc);
+        if (asrc) gst_object_unref(asrc);
+        return;
+    }
+
+    // The clients get what the tees carry
+    for (auto pair : {std::make_pair(vsrc, self->video_tap_.get()), std::make_pair(asrc, self->audio_tap_.get())}) {
+        GstCaps* caps = pair.second->caps();
+        g_object_set(pair.first,
+                     "caps", caps,
+                     "block", FALSE,
+                     "max-bytes", self->config_.client_queue_bytes,
+                     nullptr);
+        if (caps) gst_caps_unref(caps);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(self->mutex_);
+        self->clients_.push_back(Client{GST_RTSP_MEDIA(g_object_ref(media)), vsrc, asrc});
+        StreamMetrics::instance().setGauge("rtsp.clients", self->clients_.size());
+    }
+    g_signal_connect(media, "unprepared", G_CALLBACK(onMediaUnprepared), self);
+
+    // A new client can only start decoding at a keyframe - deliver() holds
+    // its video back until one arrives
+    LOG("RTSP", "Client media configured");
+    self->force_keyframe_("rtsp");
+}
+
+void RtspEgress::onMediaUnprepared(GstRTSPMedia* media, gpointer user_data) {
+    RtspEgress* self = static_cast<RtspEgress*>(user_data);
+    std::lock_guard<std::mutex> lock(self->mutex_);
+
+    for (auto it = self->clients_.begin(); it != self->clients_.end(); ++it) {
+        if (it->media != media) {
+            continue;
+        }
+        LOG("RTSP", "Client media released (" << it->dropped << " buffers dropped)");
+        g_signal_handlers_disconnect_by_data(media, self);
+        gst_object_unref(it->vsrc);
+        gst_object_unref(it->asrc);
+        g_object_unref(it->media);
+        self->clients_.erase(it);
+        break;
+    }
+    StreamMetrics::instance().setGauge("rtsp.clients", self->clients_.size());
+}
+
+void RtspEgress::onClientConnected(GstRTSPServer* server, GstRTSPClient* client, gpointer user_data) {
+    (void)server;
+    RtspEgress* self = static_cast<RtspEgress*>(user_data);
+    {
+        std::lock_guard<std::mutex> lock(self->mutex_);
+        self->connections_++;
+    }
+    g_signal_connect(client, "closed", G_CALLBACK(onClientClosed), self);
+    g_signal_connect(client, "pre-describe-request", G_CALLBACK(onPreDescribe), self);
+}
+
+void RtspEgress::onClientClosed(GstRTSPClient* client, gpointer user_data) {
+    RtspEgress* self = static_cast<RtspEgress*>(user_data);
+    g_signal_handlers_disconnect_by_data(client, self);
+    std::lock_guard<std::mutex> lock(self->mutex_);
+    self->connections_--;
+}
+
+GstRTSPStatusCode RtspEgress::onPreDescribe(GstRTSPClient* client, GstRTSPContext* ctx, gpointer user_data) {
+    (void)client;
+    (void)ctx;
+    RtspEgress* self = static_cast<RtspEgress*>(user_data);
+    std::lock_guard<std::mutex> lock(self->mutex_);
+    if (self->connections_ > self->config_.max_clients) {
+        LOG("RTSP-WARN", self->connections_ << " connections - refusing another");
+        StreamMetrics::instance().increment("rtsp.rejected");
+        return GST_RTSP_STS_SERVICE_UNAVAILABLE;
+    }
+    return GST_RTSP_STS_OK;
+}
+
+GstRTSPFilterResult RtspEgress::removeClient(GstRTSPServer* server, GstRTSPClient* client, gpointer user_data) {
+    (void)server;
+    (void)client;
+    (void)user_data;
+    return GST_RTSP_FILTER_REMOVE;
+}
@@ -0,0 +1,178 @@
+#include "shm_stream.h"
+#include <algorithm>
+#include <climits>
+#include <ctime>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace shm_stream;
+
+static int64_t monotonicUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Shared (not private) futex wait - the writer is another process
+static void futexWait(const std::atomic<uint32_t>* word, uint32_t expected, int timeout_ms) {
+    struct timespec ts;
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+    syscall(SYS_futex, reinterpret_cast<const uint32_t*>(word), FUTEX_WAIT, expected, &ts, nullptr, 0);
+}
+
+ShmStreamReader::ShmStreamReader(const std::string& name)
+    : name_(name)
+    , fd_(-1)
+    , map_(MAP_FAILED)
+    , map_size_(0)
+    , header_(nullptr)
+    , slots_(nullptr)
+    , data_(nullptr)
+    , next_(0) {
+}
+
+ShmStreamReader::~ShmStreamReader() {
+    close();
+}
+
+bool ShmStreamReader::open() {
+    close();
+
+    fd_ = shm_open(name_.c_str(), O_RDONLY, 0);
+    if (fd_ < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd_, &st) != 0 || (size_t)st.st_size < sizeof(Header)) {
+        close();
+        return false;
+    }
+
+    map_size_ = st.st_size;
+    map_ = mmap(nullptr, map_size_, PROT_READ, MAP_SHARED, fd_, 0);
+    if (map_ == MAP_FAILED) {
+        close();
+        return false;
+    }
+
+    const Header* header = static_cast<const Header*>(map_);
+    if (header->magic != MAGIC || header->version != VERSION || header->slot_count == 0 ||
+        header->data_offset + header->data_size > map_size_ ||
+        header->slots_offset + (uint64_t)header->slot_count * sizeof(Slot) > header->data_offset) {
+        close();
+        return false;
+    }
+
+    header_ = header;
+    slots_ = reinterpret_cast<const Slot*>(static_cast<const uint8_t*>(map_) + header->slots_offset);
+    data_ = static_cast<const uint8_t*>(map_) + header->data_offset;
+    next_ = newestKeyframe();
+    return true;
+}
+
+void ShmStreamReader::close() {
+    if (map_ != MAP_FAILED) {
+        munmap(map_, map_size_);
+        map_ = MAP_FAILED;
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    header_ = nullptr;
+    slots_ = nullptr;
+    data_ = nullptr;
+}
+
+uint64_t ShmStreamReader::newestKeyframe() const {
+    uint64_t head = header_->write_index.load(std::memory_order_acquire);
+    uint64_t oldest = head > header_->slot_count ? head - header_->slot_count : 0;
+
+    for (uint64_t index = head; index > oldest; index--) {
+        const Slot& slot = slots_[(index - 1) % header_->slot_count];
+        if (slot.seq.load(std::memory_order_acquire) == (index - 1) * 2 + 2 &&
+            (slot.flags & FLAG_KEYFRAME) && !(slot.flags & FLAG_AUDIO)) {
+            return index - 1;
+        }
+    }
+    return head;    // None in the ring - start with what comes next
+}
+
+ShmStreamReader::Result ShmStreamReader::next(Unit& unit, int timeout_ms) {
+    if (!header_) {
+        return Result::Closed;
+    }
+    int64_t deadline_us = monotonicUs() + (int64_t)timeout_ms * 1000;
+
+    for (;;) {
+        uint32_t seen = header_->futex.load(std::memory_order_acquire);
+        uint64_t head = header_->write_index.load(std::memory_order_acquire);
+
+        if (next_ < head) {
+            if (head - next_ > header_->slot_count) {
+                next_ = newestKeyframe();
+                return Result::Overrun;
+            }
+
+            const Slot& slot = slots_[next_ % header_->slot_count];
+            uint64_t seq = slot.seq.load(std::memory_order_acquire);
+            unit.index = next_;
+            unit.data_pos = slot.data_pos;
+            unit.size = slot.size;
+            unit.flags = slot.flags;
+            unit.pts_ns = slot.pts_ns;
+            unit.capture_us = slot.capture_us;
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            // Slot reused while we read it, or payload already overwritten
+            uint64_t offset = unit.data_pos % header_->data_size;
+            if (seq != next_ * 2 + 2 || slot.seq.load(std::memory_order_relaxed) != seq ||
+                offset + unit.size > header_->data_size || !stillValid(unit)) {
+                next_ = newestKeyframe();
+                return Result::Overrun;
+            }
+
+            unit.data = data_ + offset;
+            next_++;
+            return Result::Ok;
+        }
+
+        if (!writerAlive()) {
+            return Result::Closed;
+        }
+        int64_t remaining_ms = (deadline_us - monotonicUs()) / 1000;
+        if (remaining_ms <= 0) {
+            return Result::Timeout;
+        }
+        // Wake up now and then to notice a dead writer
+        futexWait(&header_->futex, seen, (int)std::min<int64_t>(remaining_ms, 500));
+    }
+}
+
+bool ShmStreamReader::stillValid(const Unit& unit) const {
+    if (!header_) {
+        return false;
+    }
+    // The writer claims payload space before filling it, so anything
+    // within data_size of the claimed head is intact
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t head = header_->data_head.load(std::memory_order_relaxed);
+    return head - unit.data_pos <= header_->data_size;
+}
+
+std::string ShmStreamReader::videoCodec() const {
+    if (!header_) {
+        return "";
+    }
+    return std::string(header_->video_codec, strnlen(header_->video_codec, sizeof(header_->video_codec)));
+}
+
+bool ShmStreamReader::writerAlive() const {
+    return header_ && monotonicUs() - header_->heartbeat_us.load(std::memory_order_relaxed) < WRITER_TIMEOUT_US;
+}
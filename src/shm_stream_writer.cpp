@@ -0,0 +1,143 @@
+#include "shm_stream_writer.h"
+#include "stream_metrics.h"
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <ctime>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace shm_stream;
+
+static int64_t monotonicUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Slots and payload start on cache lines
+static uint64_t alignUp(uint64_t value) {
+    return (value + 63) & ~(uint64_t)63;
+}
+
+ShmStreamWriter::ShmStreamWriter(const std::string& name, size_t data_bytes, uint32_t slot_count,
+                                 const std::string& video_codec)
+    : name_(name)
+    , data_bytes_(data_bytes)
+    , slot_count_(slot_count)
+    , video_codec_(video_codec)
+    , map_(MAP_FAILED)
+    , map_size_(0)
+    , header_(nullptr)
+    , slots_(nullptr)
+    , data_(nullptr)
+    , index_(0)
+    , data_head_(0) {
+}
+
+ShmStreamWriter::~ShmStreamWriter() {
+    if (map_ != MAP_FAILED) {
+        munmap(map_, map_size_);
+        shm_unlink(name_.c_str());
+    }
+}
+
+bool ShmStreamWriter::open() {
+    uint64_t slots_offset = alignUp(sizeof(Header));
+    uint64_t data_offset = alignUp(slots_offset + (uint64_t)slot_count_ * sizeof(Slot));
+    map_size_ = data_offset + data_bytes_;
+
+    // A fresh segment each run: readers of a previous one keep their
+    // mapping, see its heartbeat stop and reopen
+    shm_unlink(name_.c_str());
+    int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        std::cerr << "[SHM] Cannot create " << name_ << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    if (ftruncate(fd, map_size_) != 0) {
+        std::cerr << "[SHM] Cannot size " << name_ << ": " << strerror(errno) << std::endl;
+        close(fd);
+        shm_unlink(name_.c_str());
+        return false;
+    }
+    map_ = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map_ == MAP_FAILED) {
+        std::cerr << "[SHM] Cannot map " << name_ << ": " << strerror(errno) << std::endl;
+        shm_unlink(name_.c_str());
+        return false;
+    }
+
+    // ftruncate zero-fills, so the atomics and slot sequences start at 0
+    header_ = static_cast<Header*>(map_);
+    header_->version = VERSION;
+    header_->slot_count = slot_count_;
+    header_->slots_offset = slots_offset;
+    header_->data_offset = data_offset;
+    header_->data_size = data_bytes_;
+    strncpy(header_->video_codec, video_codec_.c_str(), sizeof(header_->video_codec) - 1);
+    strncpy(header_->audio_codec, "OPUS", sizeof(header_->audio_codec) - 1);
+    header_->writer_pid = getpid();
+    header_->heartbeat_us.store(monotonicUs(), std::memory_order_relaxed);
+    slots_ = reinterpret_cast<Slot*>(static_cast<uint8_t*>(map_) + slots_offset);
+    data_ = static_cast<uint8_t*>(map_) + data_offset;
+
+    // Readers check the magic last
+    std::atomic_thread_fence(std::memory_order_release);
+    header_->magic = MAGIC;
+
+    std::cout << "[SHM] Publishing " << video_codec_ << " + Opus to " << name_ << " ("
+              << (data_bytes_ >> 20) << " MB, " << slot_count_ << " units)" << std::endl;
+    return true;
+}
+
+void ShmStreamWriter::write(const uint8_t* data, size_t size, uint32_t flags, int64_t pts_ns) {
+    // A unit over a quarter of the ring would evict most of what readers hold
+    if (size > data_bytes_ / 4) {
+        StreamMetrics::instance().increment("shm.oversized");
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!header_) {
+        return;
+    }
+
+    // Units never wrap - skip the ring's tail if this one doesn't fit
+    uint64_t pos = data_head_;
+    uint64_t offset = pos % data_bytes_;
+    if (offset + size > data_bytes_) {
+        pos += data_bytes_ - offset;
+        offset = 0;
+    }
+    data_head_ = pos + size;
+
+    // Claim the slot and the payload space before touching either, so a
+    // reader racing us sees them as gone rather than half written
+    Slot& slot = slots_[index_ % slot_count_];
+    slot.seq.store(index_ * 2 + 1, std::memory_order_relaxed);
+    header_->data_head.store(data_head_, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.data_pos = pos;
+    slot.size = size;
+    slot.flags = flags;
+    slot.pts_ns = pts_ns;
+    slot.capture_us = monotonicUs();
+    memcpy(data_ + offset, data, size);
+
+    slot.seq.store(index_ * 2 + 2, std::memory_order_release);
+    header_->write_index.store(++index_, std::memory_order_release);
+    header_->heartbeat_us.store(slot.capture_us, std::memory_order_relaxed);
+
+    header_->futex.fetch_add(1, std::memory_order_release);
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&header_->futex), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+
+    StreamMetrics::instance().increment("shm.units");
+    StreamMetrics::instance().increment("shm.bytes", size);
+}
@@ -1,4 +1,5 @@
 #include "signaling_client.h"
+#include <glib.h>
 #include <iostream>
 
 SignalingClient::SignalingClient(const std::string& server_url)
@@ -119,21 +120,105 @@ void SignalingClient::disconnect() {
     }
 }
 
-bool SignalingClient::registerBroadcaster(const std::string& stream_id) {
+bool SignalingClient::registerBroadcaster(const std::string& stream_id, bool handoff) {
     Json::Value msg;
     msg["type"] = "register";
     msg["role"] = "broadcaster";
     msg["stream_id"] = stream_id;
+    if (handoff) {
+        msg["handoff"] = true;
+    }
 
     sendMessage(msg);
     return true;
 }
 
-void SignalingClient::sendOffer(const std::string& viewer_id, const std::string& sdp) {
+void SignalingClient::sendHandoffRelease() {
+    Json::Value msg;
+    msg["type"] = "handoff-release";
+
+    sendMessage(msg);
+}
+
+void SignalingClient::sendHandoffReady() {
+    Json::Value msg;
+    msg["type"] = "handoff-ready";
+
+    sendMessage(msg);
+}
+
+void SignalingClient::sendHandoffFailed(const std::string& reason) {
+    Json::Value msg;
+    msg["type"] = "handoff-failed";
+    msg["reason"] = reason;
+
+    sendMessage(msg);
+}
+
+void SignalingClient::sendOffer(const std::string& viewer_id, const std::string& sdp, bool ice_restart) {
     Json::Value msg;
     msg["type"] = "offer";
     msg["to"] = viewer_id;
     msg["sdp"] = sdp;
+    if (ice_restart) {
+        msg["ice_restart"] = true;
+    }
+
+    sendMessage(msg);
+}
+
+void SignalingClient::sendViewerReclaimed(const std::string& viewer_id, const std::string& reason) {
+    Json::Value msg;
+    msg["type"] = "viewer-reclaimed";
+    msg["viewer_id"] = viewer_id;
+    msg["reason"] = reason;
+
+    sendMessage(msg);
+}
+
+void SignalingClient::sendMetrics(const Json::Value& metrics) {
+    if (!connected_) {
+        return;
+    }
+
+    Json::Value msg;
+    msg["type"] = "metrics";
+    msg["metrics"] = metrics;
+
+    sendMessage(msg);
+}
+
+void SignalingClient::sendTimeshiftState(const std::string& viewer_id, double behind_seconds) {
+    Json::Value msg;
+    msg["type"] = "timeshift-state";
+    msg["to"] = viewer_id;
+    msg["behind_s"] = behind_seconds;
+    msg["live"] = behind_seconds <= 0;
+
+    sendMessage(msg);
+}
+
+void SignalingClient::sendClipStatus(const std::string& viewer_id, const std::string& clip,
+                                     const std::string& status) {
+    Json::Value msg;
+    msg["type"] = "clip-status";
+    msg["to"] = viewer_id;
+    msg["clip"] = clip;
+    msg["status"] = status;
+
+    sendMessage(msg);
+}
+
+void SignalingClient::sendSnapshot(const std::string& request_id, int width, const std::string& jpeg,
+                                   int age_ms) {
+    Json::Value msg;
+    msg["type"] = "snapshot";
+    msg["request_id"] = request_id;
+    msg["width"] = width;
+    msg["age_ms"] = age_ms;
+    gchar* encoded = g_base64_encode(reinterpret_cast<const guchar*>(jpeg.data()), jpeg.size());
+    msg["jpeg"] = encoded;
+    g_free(encoded);
 
     sendMessage(msg);
 }
@@ -150,7 +235,8 @@ void SignalingClient::sendIceCandidate(const std::string& peer_id,
     sendMessage(msg);
 }
 
-void SignalingClient::setOnViewerJoined(std::function<void(const std::string&)> callback) {
+void SignalingClient::setOnViewerJoined(std::function<void(const std::string&, const std::string&,
+                                                           const std::string&, bool)> callback) {
     on_viewer_joined_ = callback;
 }
 
@@ -166,6 +252,42 @@ void SignalingClient::setOnViewerLeft(std::function<void(const std::string&)> ca
     on_viewer_left_ = callback;
 }
 
+void SignalingClient::setOnHandoffRequest(std::function<void()> callback) {
+    on_handoff_request_ = callback;
+}
+
+void SignalingClient::setOnHandoffGo(std::function<void()> callback) {
+    on_handoff_go_ = callback;
+}
+
+void SignalingClient::setOnHandoffComplete(std::function<void()> callback) {
+    on_handoff_complete_ = callback;
+}
+
+void SignalingClient::setOnHandoffAbort(std::function<void(const std::string&)> callback) {
+    on_handoff_abort_ = callback;
+}
+
+void SignalingClient::setOnIceRestartRequest(std::function<void(const std::string&)> callback) {
+    on_ice_restart_request_ = callback;
+}
+
+void SignalingClient::setOnViewerStats(std::function<void(const std::string&, double, double, bool)> callback) {
+    on_viewer_stats_ = callback;
+}
+
+void SignalingClient::setOnTimeshift(std::function<void(const std::string&, double, double)> callback) {
+    on_timeshift_ = callback;
+}
+
+void SignalingClient::setOnEvent(std::function<void(const std::string&, const std::string&)> callback) {
+    on_event_ = callback;
+}
+
+void SignalingClient::setOnSnapshotRequest(std::function<void(const std::string&, int)> callback) {
+    on_snapshot_request_ = callback;
+}
+
 void SignalingClient::onOpen(ConnectionHdl hdl) {
     std::cout << "WebSocket connected" << std::endl;
     connected_ = true;
@@ -204,8 +326,11 @@ void SignalingClient::handleMessage(const std::string& message) {
 
     if (type == "viewer-joined") {
         std::string viewer_id = root["viewer_id"].asString();
+        std::string client_id = root.get("client_id", "").asString();
+        std::string network = root.get("network", "").asString();
+        bool resume = root.get("resume", false).asBool();
         if (on_viewer_joined_) {
-            on_viewer_joined_(viewer_id);
+            on_viewer_joined_(viewer_id, client_id, network, resume);
         }
     }
     else if (type == "answer") {
@@ -229,6 +354,72 @@ void SignalingClient::handleMessage(const std::string& message) {
             on_viewer_left_(viewer_id);
         }
     }
+    else if (type == "ice-restart-request") {
+        // Viewer changed networks and wants new ICE candidates on the same session
+        std::string from = root["from"].asString();
+        if (on_ice_restart_request_) {
+            on_ice_restart_request_(from);
+        }
+    }
+    else if (type == "viewer-stats") {
+        std::string from = root["from"].asString();
+        double e2e_ms = root.get("e2e_ms", -1).asDouble();
+        double jitter_buffer_ms = root.get("jitter_buffer_ms", -1).asDouble();
+        bool playout_delay = root.get("playout_delay", false).asBool();
+        if (on_viewer_stats_) {
+            on_viewer_stats_(from, e2e_ms, jitter_buffer_ms, playout_delay);
+        }
+    }
+    else if (type == "timeshift") {
+        std::string from = root["from"].asString();
+        double offset_s = root.get("offset_s", 0).asDouble();
+        double speed = root.get("speed", 1).asDouble();
+        if (on_timeshift_) {
+            on_timeshift_(from, offset_s, speed);
+        }
+    }
+    else if (type == "event") {
+        std::string from = root.get("from", "").isString() ? root["from"].asString() : "";
+        std::string event = root.get("event", "event").asString();
+        if (on_event_) {
+            on_event_(from, event);
+        }
+    }
+    else if (type == "snapshot-request") {
+        std::string request_id = root.get("request_id", "").asString();
+        int width = root.get("width", 0).asInt();
+        if (on_snapshot_request_) {
+            on_snapshot_request_(request_id, width);
+        }
+    }
+    else if (type == "handoff-request") {
+        // A new process wants to take over - we must release the camera
+        if (on_handoff_request_) {
+            on_handoff_request_();
+        }
+    }
+    else if (type == "handoff-go") {
+        // Previous process released the camera (or there was none) - start capture
+        if (on_handoff_go_) {
+            on_handoff_go_();
+        }
+    }
+    else if (type == "handoff-complete") {
+        // The new process has video and is taking our viewers - we can go
+        if (on_handoff_complete_) {
+            on_handoff_complete_();
+        }
+    }
+    else if (type == "handoff-abort") {
+        // The new process never got video - the camera is ours again
+        std::string reason = root.get("reason", "").asString();
+        if (on_handoff_abort_) {
+            on_handoff_abort_(reason);
+        }
+    }
+    else if (type == "handoff-pending") {
+        std::cout << "Handoff pending - waiting for current broadcaster to release camera" << std::endl;
+    }
 }
 
 void SignalingClient::sendMessage(const Json::Value& message) {
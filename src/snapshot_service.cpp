@@ -0,0 +1,216 @@
+#include "snapshot_service.h"
+#include "stream_metrics.h"
+#include <iostream>
+#include <chrono>
+#include <iomanip>
+#include <sstream>
+
+// ==================== DEBUG LOGGING ====================
+#define DEBUG_LOGGING 1
+
+static std::string getTimestamp() {
+    auto now = std::chrono::system_clock::now();
+    auto time = std::chrono::system_clock::to_time_t(now);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        now.time_since_epoch()) % 1000;
+    std::stringstream ss;
+    ss << std::put_time(std::localtime(&time), "%H:%M:%S")
+       << "." << std::setfill('0') << std::setw(3) << ms.count();
+    return ss.str();
+}
+
+#if DEBUG_LOGGING
+#define LOG(category, msg) \
+    std::cout << "[" << getTimestamp() << "] [" << category << "] " << msg << std::endl
+#define LOG_VAR(category, msg, var) \
+    std::cout << "[" << getTimestamp() << "] [" << category << "] " << msg << var << std::endl
+#else
+#define LOG(category, msg)
+#define LOG_VAR(category, msg, var)
+#endif
+
+SnapshotService::SnapshotService(const std::string& decode_chain, int quality, int max_age_ms,
+                                 std::function<void(const std::string&)> force_keyframe)
+    : decode_chain_(decode_chain)
+    , quality_(quality)
+    , max_age_ms_(max_age_ms)
+    , force_keyframe_(force_keyframe)
+    , keyframe_(nullptr)
+    , keyframe_caps_(nullptr)
+    , keyframe_seq_(0)
+    , keyframe_us_(0)
+    , stop_(false) {
+    worker_ = std::thread(&SnapshotService::workerLoop, this);
+}
+
+SnapshotService::~SnapshotService() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    worker_.join();
+
+    // Anyone still waiting gets an answer
+    for (auto& pair : waiting_) {
+        for (auto& done : pair.second) {
+            done(false, "", 0);
+        }
+    }
+    if (keyframe_) gst_buffer_unref(keyframe_);
+    if (keyframe_caps_) gst_caps_unref(keyframe_caps_);
+}
+
+void SnapshotService::onKeyframe(GstBuffer* buffer, GstCaps* caps) {
+    GstBuffer* old_buffer;
+    GstCaps* old_caps;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        old_buffer = keyframe_;
+        old_caps = keyframe_caps_;
+        keyframe_ = gst_buffer_ref(buffer);
+        keyframe_caps_ = caps ? gst_caps_ref(caps) : nullptr;
+        keyframe_seq_++;
+        keyframe_us_ = g_get_monotonic_time();
+    }
+    if (old_buffer) gst_buffer_unref(old_buffer);
+    if (old_caps) gst_caps_unref(old_caps);
+}
+
+void SnapshotService::request(int width, Done done) {
+    StreamMetrics::instance().increment("snapshots.requests");
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    if (!keyframe_ || !keyframe_caps_) {
+        lock.unlock();
+        done(false, "", 0);
+        return;
+    }
+
+    int age_ms = (int)((g_get_monotonic_time() - keyframe_us_) / 1000);
+    if (age_ms > max_age_ms_) {
+        force_keyframe_("snapshot");
+    }
+
+    auto cached = cache_.find(width);
+    if (cached != cache_.end() && cached->second.keyframe_seq == keyframe_seq_) {
+        std::string jpeg = cached->second.jpeg;
+        lock.unlock();
+        StreamMetrics::instance().increment("snapshots.cache_hits");
+        done(true, jpeg, age_ms);
+        return;
+    }
+
+    // Single flight: one decode per width, everyone else waits for it
+    auto waiting = waiting_.find(width);
+    if (waiting != waiting_.end()) {
+        waiting->second.push_back(done);
+        StreamMetrics::instance().increment("snapshots.coalesced");
+        return;
+    }
+    waiting_[width].push_back(done);
+    queue_.push_back(width);
+    cv_.notify_one();
+}
+
+void SnapshotService::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true) {
+        cv_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+        if (stop_) {
+            return;
+        }
+
+        int width = queue_.front();
+        queue_.pop_front();
+        GstBuffer* buffer = gst_buffer_ref(keyframe_);
+        GstCaps* caps = gst_caps_ref(keyframe_caps_);
+        guint64 seq = keyframe_seq_;
+        gint64 keyframe_us = keyframe_us_;
+        lock.unlock();
+
+        gint64 started_us = g_get_monotonic_time();
+        std::string jpeg;
+        bool ok = encode(buffer, caps, width, jpeg);
+        gst_buffer_unref(buffer);
+        gst_caps_unref(caps);
+        if (ok) {
+            StreamMetrics::instance().increment("snapshots.decodes");
+            StreamMetrics::instance().recordLatency("snapshots.decode_ms", (g_get_monotonic_time() - started_us) / 1000.0);
+        } else {
+            StreamMetrics::instance().increment("snapshots.failed");
+        }
+
+        lock.lock();
+        if (ok) {
+            if (cache_.size() >= MAX_CACHED_WIDTHS && !cache_.count(width)) {
+                cache_.erase(cache_.begin());
+            }
+            cache_[width] = Cached{seq, jpeg};
+        }
+        std::vector<Done> waiters = std::move(waiting_[width]);
+        waiting_.erase(width);
+        lock.unlock();
+
+        int age_ms = (int)((g_get_monotonic_time() - keyframe_us) / 1000);
+        for (auto& done : waiters) {
+            done(ok, jpeg, age_ms);
+        }
+        lock.lock();
+    }
+}
+
+bool SnapshotService::encode(GstBuffer* buffer, GstCaps* caps, int width, std::string& jpeg) {
+    // Only width is fixed; videoscale picks the height that keeps the aspect ratio
+    std::string scale = width > 0
+        ? "videoscale ! video/x-raw,width=" + std::to_string(width) + ",pixel-aspect-ratio=1/1 ! "
+        : "";
+    std::string description =
+        "appsrc name=src format=time ! " + decode_chain_ + " ! videoconvert ! " + scale +
+        "jpegenc quality=" + std::to_string(quality_) + " ! appsink name=sink sync=false";
+
+    GError* error = nullptr;
+    GstElement* pipeline = gst_parse_launch(description.c_str(), &error);
+    if (!pipeline) {
+        LOG("SNAPSHOT-ERROR", "Cannot build decoder: " << (error ? error->message : "unknown error"));
+        g_clear_error(&error);
+        return false;
+    }
+
+    GstElement* src = gst_bin_get_by_name(GST_BIN(pipeline), "src");
+    GstElement* sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    g_object_set(src, "caps", caps, nullptr);
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+    // One frame, then EOS so the decoder drains it
+    GstBuffer* frame = gst_buffer_copy(buffer);
+    GST_BUFFER_PTS(frame) = 0;
+    GST_BUFFER_DTS(frame) = 0;
+    GstFlowReturn ret;
+    g_signal_emit_by_name(src, "push-buffer", frame, &ret);
+    gst_buffer_unref(frame);
+    g_signal_emit_by_name(src, "end-of-stream", &ret);
+
+    GstSample* sample = nullptr;
+    g_signal_emit_by_name(sink, "try-pull-sample", (GstClockTime)DECODE_TIMEOUT_MS * GST_MSECOND, &sample);
+    bool ok = false;
+    if (sample) {
+        GstBuffer* out = gst_sample_get_buffer(sample);
+        GstMapInfo map;
+        if (out && gst_buffer_map(out, &map, GST_MAP_READ)) {
+            jpeg.assign(reinterpret_cast<const char*>(map.data), map.size);
+            gst_buffer_unmap(out, &map);
+            ok = true;
+        }
+        gst_sample_unref(sample);
+    } else {
+        LOG("SNAPSHOT-WARN", "Keyframe did not decode within " << DECODE_TIMEOUT_MS << "ms");
+    }
+
+    gst_object_unref(src);
+    gst_object_unref(sink);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+    return ok;
+}
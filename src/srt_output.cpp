@@ -0,0 +1,321 @@
+#include "srt_output.h"
+#include "stream_metrics.h"
+#include <iostream>
+#include <chrono>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+// ==================== DEBUG LOGGING ====================
+#define DEBUG_LOGGING 1
+
+static std::string getTimestamp() {
+    auto now = std::chrono::system_clock::now();
+    auto time = std::chrono::system_clock::to_time_t(now);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        now.time_since_epoch()) % 1000;
+    std::stringstream ss;
+    ss << std::put_time(std::localtime(&time), "%H:%M:%S")
+       << "." << std::setfill('0') << std::setw(3) << ms.count();
+    return ss.str();
+}
+
+#if DEBUG_LOGGING
+#define LOG(category, msg) \
+    std::cout << "[" << getTimestamp() << "] [" << category << "] " << msg << std::endl
+#define LOG_VAR(category, msg, var) \
+    std::cout << "[" << getTimestamp() << "] [" << category << "] " << msg << var << std::endl
+#else
+#define LOG(category, msg)
+#define LOG_VAR(category, msg, var)
+#endif
+
+// Numeric SRT stats field as a double, whatever integer type the plugin used
+static double statField(const GstStructure* stats, const char* field) {
+    const GValue* value = gst_structure_get_value(stats, field);
+    if (!value) {
+        return 0;
+    }
+    GValue as_double = G_VALUE_INIT;
+    g_value_init(&as_double, G_TYPE_DOUBLE);
+    double result = g_value_transform(value, &as_double) ? g_value_get_double(&as_double) : 0;
+    g_value_unset(&as_double);
+    return result;
+}
+
+SrtOutput::SrtOutput(GstElement* shared_pipeline, GstElement* video_tee, GstElement* audio_tee,
+                     const std::string& video_chain, std::function<void(const std::string&)> force_keyframe,
+                     const Config& config)
+    : shared_pipeline_(shared_pipeline)
+    , video_tee_(video_tee)
+    , audio_tee_(audio_tee)
+    , video_chain_(video_chain)
+    , force_keyframe_(force_keyframe)
+    , config_(config)
+    , pipeline_(nullptr)
+    , vsrc_(nullptr)
+    , asrc_(nullptr)
+    , sink_(nullptr)
+    , dropping_(false)
+    , bus_watch_id_(0)
+    , restart_source_id_(0)
+    , stats_source_id_(0)
+    , restart_backoff_ms_(RESTART_BACKOFF_MIN_MS)
+    , last_retransmitted_(0)
+    , last_lost_(0)
+    , last_dropped_(0) {
+}
+
+SrtOutput::~SrtOutput() {
+    if (restart_source_id_) {
+        g_source_remove(restart_source_id_);
+    }
+    if (stats_source_id_) {
+        g_source_remove(stats_source_id_);
+    }
+    video_tap_.reset();
+    audio_tap_.reset();
+    teardownPipeline();
+}
+
+bool SrtOutput::start() {
+    video_tap_.reset(new TeeTap(shared_pipeline_, video_tee_, "srt_video",
+                                [this](GstBuffer* buffer) { deliver(buffer, true); }));
+    audio_tap_.reset(new TeeTap(shared_pipeline_, audio_tee_, "srt_audio",
+                                [this](GstBuffer* buffer) { deliver(buffer, false); }));
+    if (!video_tap_->attach() || !audio_tap_->attach()) {
+        LOG("SRT-ERROR", "Cannot tap the shared pipeline");
+        return false;
+    }
+
+    if (!buildPipeline()) {
+        restart_source_id_ = g_timeout_add(restart_backoff_ms_, onRestart, this);
+    }
+    stats_source_id_ = g_timeout_add(config_.stats_interval_ms, onStatsTimer, this);
+    return true;
+}
+
+bool SrtOutput::buildPipeline() {
+    // Timestamps are cleared before the push - the tees' PTS are in the
+    // shared pipeline's running time, not this one's
+    std::string description =
+        "appsrc name=vsrc is-live=true format=time do-timestamp=true ! queue ! " + video_chain_ +
+        " ! mpegtsmux name=mux alignment=7 ! srtsink name=sink sync=false async=false wait-for-connection=false "
+        "appsrc name=asrc is-live=true format=time do-timestamp=true ! queue ! rtpopusdepay ! opusparse ! mux.";
+
+    GError* error = nullptr;
+    GstElement* pipeline = gst_parse_launch(description.c_str(), &error);
+    if (!pipeline) {
+        LOG("SRT-ERROR", "Cannot build output: " << (error ? error->message : "unknown error"));
+        g_clear_error(&error);
+        return false;
+    }
+
+    GstElement* vsrc = gst_bin_get_by_name(GST_BIN(pipeline), "vsrc");
+    GstElement* asrc = gst_bin_get_by_name(GST_BIN(pipeline), "asrc");
+    GstElement* sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    for (auto pair : {std::make_pair(vsrc, video_tap_.get()), std::make_pair(asrc, audio_tap_.get())}) {
+        GstCaps* caps = pair.second->caps();
+        g_object_set(pair.first,
+                     "caps", caps,
+                     "block", FALSE,
+                     "max-bytes", config_.buffer_bytes,
+                     nullptr);
+        if (caps) gst_caps_unref(caps);
+    }
+    // URI options (mode, streamid, ...) are parsed by srtsink itself
+    g_object_set(sink,
+                 "uri", config_.uri.c_str(),
+                 "latency", config_.latency_ms,
+                 nullptr);
+    if (!config_.passphrase.empty()) {
+        g_object_set(sink, "passphrase", config_.passphrase.c_str(), nullptr);
+    }
+
+    GstBus* bus = gst_element_get_bus(pipeline);
+    bus_watch_id_ = gst_bus_add_watch(bus, onBusMessage, this);
+    gst_object_unref(bus);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pipeline_ = pipeline;
+        vsrc_ = vsrc;
+        asrc_ = asrc;
+        sink_ = sink;
+        dropping_ = false;
+    }
+    last_retransmitted_ = last_lost_ = last_dropped_ = 0;
+
+    if (gst_element_set_state(pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+        LOG("SRT-ERROR", "Cannot start output to " << config_.uri);
+        teardownPipeline();
+        return false;
+    }
+
+    LOG("SRT", "Sending to " << config_.uri << " (latency " << config_.latency_ms << "ms, buffer "
+        << (config_.buffer_bytes >> 10) << " KB" << (config_.passphrase.empty() ? "" : ", encrypted")
+        << ")");
+    force_keyframe_("srt");
+    return true;
+}
+
+void SrtOutput::teardownPipeline() {
+    GstElement* pipeline;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pipeline = pipeline_;
+        if (vsrc_) gst_object_unref(vsrc_);
+        if (asrc_) gst_object_unref(asrc_);
+        if (sink_) gst_object_unref(sink_);
+        pipeline_ = vsrc_ = asrc_ = sink_ = nullptr;
+    }
+    if (bus_watch_id_) {
+        g_source_remove(bus_watch_id_);
+        bus_watch_id_ = 0;
+    }
+    if (pipeline) {
+        gst_element_set_state(pipeline, GST_STATE_NULL);
+        gst_object_unref(pipeline);
+    }
+}
+
+void SrtOutput::deliver(GstBuffer* buffer, bool video) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!pipeline_) {
+        return;     // Restarting
+    }
+
+    GstElement* src = video ? vsrc_ : asrc_;
+    guint64 level = 0;
+    g_object_get(src, "current-level-bytes", &level, nullptr);
+
+    // The link can't keep up: drop here rather than grow the latency.
+    // Video resumes once half the buffer has drained, from a fresh keyframe.
+    if (level > config_.buffer_bytes || (video && dropping_ && level > config_.buffer_bytes / 2)) {
+        if (video && !dropping_) {
+            dropping_ = true;
+            LOG("SRT-WARN", "Send buffer over " << (config_.buffer_bytes >> 10)
+                << " KB - dropping until the link catches up");
+            StreamMetrics::instance().increment("srt.overflows");
+        }
+        StreamMetrics::instance().increment("srt.buffers_dropped");
+        return;
+    }
+    if (video && dropping_) {
+        dropping_ = false;
+        force_keyframe_("srt");
+    }
+
+    // Shallow copy - the payload memory is shared with the tee's other branches
+    GstBuffer* copy = gst_buffer_copy(buffer);
+    GST_BUFFER_PTS(copy) = GST_CLOCK_TIME_NONE;
+    GST_BUFFER_DTS(copy) = GST_CLOCK_TIME_NONE;
+    GstFlowReturn ret = GST_FLOW_OK;
+    g_signal_emit_by_name(src, "push-buffer", copy, &ret);
+    gst_buffer_unref(copy);
+}
+
+gboolean SrtOutput::onBusMessage(GstBus* bus, GstMessage* msg, gpointer user_data) {
+    (void)bus;
+    SrtOutput* self = static_cast<SrtOutput*>(user_data);
+    if (GST_MESSAGE_TYPE(msg) != GST_MESSAGE_ERROR) {
+        return TRUE;
+    }
+
+    GError* err = nullptr;
+    gst_message_parse_error(msg, &err, nullptr);
+    LOG("SRT-ERROR", "Output error: " << (err ? err->message : "unknown") << " - restarting in "
+        << self->restart_backoff_ms_ << "ms");
+    g_clear_error(&err);
+    StreamMetrics::instance().increment("srt.errors");
+
+    // This watch is removed by returning FALSE
+    self->bus_watch_id_ = 0;
+    self->teardownPipeline();
+    self->restart_source_id_ = g_timeout_add(self->restart_backoff_ms_, onRestart, self);
+    return FALSE;
+}
+
+gboolean SrtOutput::onRestart(gpointer user_data) {
+    SrtOutput* self = static_cast<SrtOutput*>(user_data);
+    self->restart_source_id_ = 0;
+    StreamMetrics::instance().increment("srt.restarts");
+
+    self->restart_backoff_ms_ = std::min(self->restart_backoff_ms_ * 2, RESTART_BACKOFF_MAX_MS);
+    if (!self->buildPipeline()) {
+        self->restart_source_id_ = g_timeout_add(self->restart_backoff_ms_, onRestart, self);
+    }
+    return FALSE;
+}
+
+gboolean SrtOutput::onStatsTimer(gpointer user_data) {
+    static_cast<SrtOutput*>(user_data)->logStats();
+    return TRUE;
+}
+
+void SrtOutput::logStats() {
+    GstStructure* stats = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!sink_) {
+            return;
+        }
+        g_object_get(sink_, "stats", &stats, nullptr);
+    }
+    if (!stats) {
+        return;
+    }
+
+    // Listener mode reports per caller; the studio is the first one
+    const GstStructure* link = stats;
+    const GValue* callers = gst_structure_get_value(stats, "callers");
+    if (callers && G_VALUE_HOLDS(callers, G_TYPE_VALUE_ARRAY)) {
+        G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+        GValueArray* array = static_cast<GValueArray*>(g_value_get_boxed(callers));
+        link = array && array->n_values > 0 ? gst_value_get_structure(&array->values[0]) : nullptr;
+        G_GNUC_END_IGNORE_DEPRECATIONS
+    }
+
+    if (link && gst_structure_has_field(link, "rtt-ms")) {
+        double rtt_ms = statField(link, "rtt-ms");
+        double send_mbps = statField(link, "send-rate-mbps");
+        double bandwidth_mbps = statField(link, "bandwidth-mbps");
+        double latency_ms = statField(link, "negotiated-latency-ms");
+        gint64 retransmitted = (gint64)statField(link, "packets-retransmitted");
+        gint64 lost = (gint64)statField(link, "packets-sent-lost");
+        gint64 dropped = (gint64)statField(link, "packets-sent-dropped");
+
+        // Counters restart with the socket
+        if (retransmitted < last_retransmitted_ || lost < last_lost_ || dropped < last_dropped_) {
+            last_retransmitted_ = last_lost_ = last_dropped_ = 0;
+        }
+        gint64 new_retransmitted = retransmitted - last_retransmitted_;
+        gint64 new_lost = lost - last_lost_;
+        gint64 new_dropped = dropped - last_dropped_;
+        last_retransmitted_ = retransmitted;
+        last_lost_ = lost;
+        last_dropped_ = dropped;
+
+        StreamMetrics& metrics = StreamMetrics::instance();
+        metrics.recordLatency("srt.rtt_ms", rtt_ms);
+        metrics.setGauge("srt.rtt_ms", rtt_ms);
+        metrics.setGauge("srt.send_rate_mbps", send_mbps);
+        metrics.setGauge("srt.bandwidth_mbps", bandwidth_mbps);
+        metrics.setGauge("srt.latency_ms", latency_ms);
+        metrics.increment("srt.packets.retransmitted", new_retransmitted);
+        metrics.increment("srt.packets.lost", new_lost);
+        metrics.increment("srt.packets.dropped", new_dropped);
+
+        std::cout << std::fixed << std::setprecision(1)
+                  << "[SRT] rtt " << rtt_ms << "ms, sending " << send_mbps << " Mbps (link "
+                  << bandwidth_mbps << " Mbps), latency " << latency_ms << "ms, +" << new_retransmitted
+                  << " retransmitted, +" << new_lost << " lost, +" << new_dropped << " dropped"
+                  << std::defaultfloat << std::endl;
+
+        // A working link ends the backoff
+        if (rtt_ms > 0) {
+            restart_backoff_ms_ = RESTART_BACKOFF_MIN_MS;
+        }
+    }
+    gst_structure_free(stats);
+}
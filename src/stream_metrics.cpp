@@ -0,0 +1,158 @@
+#include "stream_metrics.h"
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+StreamMetrics& StreamMetrics::instance() {
+    static StreamMetrics instance;
+    return instance;
+}
+
+void StreamMetrics::increment(const std::string& name, uint64_t by) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    counters_[name] += by;
+}
+
+void StreamMetrics::setGauge(const std::string& name, double value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    gauges_[name] = value;
+}
+
+void StreamMetrics::recordLatency(const std::string& name, double ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    addSample(latencies_[name], ms);
+}
+
+void StreamMetrics::recordValue(const std::string& name, double value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    addSample(values_[name], value);
+}
+
+void StreamMetrics::addSample(LatencyStats& stats, double sample) {
+    stats.count++;
+    stats.sum += sample;
+    stats.max = std::max(stats.max, sample);
+
+    if (stats.samples.size() < LATENCY_SAMPLE_WINDOW) {
+        stats.samples.push_back(sample);
+    } else {
+        stats.samples[stats.next] = sample;
+        stats.next = (stats.next + 1) % LATENCY_SAMPLE_WINDOW;
+    }
+}
+
+void StreamMetrics::recordMemory() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        // "VmRSS:     123456 kB"
+        std::istringstream fields(line);
+        std::string key;
+        double kb = 0;
+        fields >> key >> kb;
+        if (key == "VmRSS:") {
+            setGauge("process.rss_kb", kb);
+        } else if (key == "VmHWM:") {
+            setGauge("process.peak_rss_kb", kb);
+        }
+    }
+}
+
+Json::Value StreamMetrics::summarize(const LatencyStats& stats, const std::string& suffix) {
+    Json::Value entry;
+    entry["count"] = Json::UInt64(stats.count);
+    entry["avg" + suffix] = stats.count ? stats.sum / stats.count : 0.0;
+    entry["max" + suffix] = stats.max;
+    entry["p50" + suffix] = percentile(stats.samples, 0.50);
+    entry["p95" + suffix] = percentile(stats.samples, 0.95);
+    entry["p99" + suffix] = percentile(stats.samples, 0.99);
+    return entry;
+}
+
+double StreamMetrics::percentile(std::vector<double> samples, double p) {
+    if (samples.empty()) {
+        return 0;
+    }
+    size_t index = static_cast<size_t>(p * (samples.size() - 1));
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+Json::Value StreamMetrics::toJson() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Json::Value root;
+
+    for (const auto& pair : counters_) {
+        root["counters"][pair.first] = Json::UInt64(pair.second);
+    }
+    for (const auto& pair : gauges_) {
+        root["gauges"][pair.first] = pair.second;
+    }
+    for (const auto& pair : latencies_) {
+        root["latencies"][pair.first] = summarize(pair.second, "_ms");
+    }
+    for (const auto& pair : values_) {
+        root["values"][pair.first] = summarize(pair.second, "");
+    }
+
+    return root;
+}
+
+void StreamMetrics::logSummary() {
+    Json::Value snapshot = toJson();
+
+    for (const auto& name : snapshot["counters"].getMemberNames()) {
+        std::cout << "[METRICS] " << name << " = "
+                  << snapshot["counters"][name].asUInt64() << std::endl;
+    }
+    for (const auto& name : snapshot["gauges"].getMemberNames()) {
+        std::cout << "[METRICS] " << name << " = "
+                  << snapshot["gauges"][name].asDouble() << std::endl;
+    }
+    for (const auto& name : snapshot["latencies"].getMemberNames()) {
+        const Json::Value& entry = snapshot["latencies"][name];
+        std::cout << "[METRICS] " << name
+                  << " count=" << entry["count"].asUInt64()
+                  << " p50=" << entry["p50_ms"].asDouble() << "ms"
+                  << " p95=" << entry["p95_ms"].asDouble() << "ms"
+                  << " max=" << entry["max_ms"].asDouble() << "ms" << std::endl;
+    }
+    for (const auto& name : snapshot["values"].getMemberNames()) {
+        const Json::Value& entry = snapshot["values"][name];
+        std::cout << "[METRICS] " << name
+                  << " count=" << entry["count"].asUInt64()
+                  << " p50=" << entry["p50"].asDouble()
+                  << " p99=" << entry["p99"].asDouble()
+                  << " max=" << entry["max"].asDouble() << std::endl;
+    }
+}
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+ScopedLatency::ScopedLatency(const std::string& name)
+    : name_(name)
+    , started_(std::chrono::steady_clock::now()) {
+}
+
+ScopedLatency::~ScopedLatency() {
+    StreamMetrics::instance().recordLatency(name_, millisecondsSince(started_));
+}
+
+TimedLockGuard::TimedLockGuard(std::mutex& mutex, const char* name)
+    : mutex_(mutex)
+    , name_(name) {
+    auto waiting = std::chrono::steady_clock::now();
+    mutex_.lock();
+    locked_ = std::chrono::steady_clock::now();
+    StreamMetrics::instance().recordLatency(std::string("lock.") + name_ + ".wait_ms",
+        std::chrono::duration<double, std::milli>(locked_ - waiting).count());
+}
+
+TimedLockGuard::~TimedLockGuard() {
+    double held_ms = millisecondsSince(locked_);
+    mutex_.unlock();
+    StreamMetrics::instance().recordLatency(std::string("lock.") + name_ + ".hold_ms", held_ms);
+}
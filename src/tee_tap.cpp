@@ -0,0 +1,85 @@
+#include "tee_tap.h"
+
+TeeTap::TeeTap(GstElement* pipeline, GstElement* tee, const std::string& name, Handler handler)
+    : pipeline_(pipeline)
+    , tee_(tee)
+    , name_(name)
+    , handler_(handler)
+    , tee_pad_(nullptr)
+    , queue_(nullptr)
+    , sink_(nullptr) {
+}
+
+TeeTap::~TeeTap() {
+    if (sink_) {
+        g_signal_handlers_disconnect_by_data(sink_, this);
+    }
+    if (tee_pad_) {
+        gst_element_release_request_pad(tee_, tee_pad_);
+        gst_object_unref(tee_pad_);
+    }
+}
+
+bool TeeTap::attach() {
+    queue_ = gst_element_factory_make("queue", (name_ + "_queue").c_str());
+    sink_ = gst_element_factory_make("appsink", (name_ + "_sink").c_str());
+    if (!queue_ || !sink_) {
+        if (queue_) gst_object_unref(queue_);
+        if (sink_) gst_object_unref(sink_);
+        queue_ = sink_ = nullptr;
+        return false;
+    }
+
+    g_object_set(queue_,
+                 "max-size-buffers", QUEUE_BUFFERS,
+                 "max-size-bytes", 0,
+                 "max-size-time", (guint64)0,
+                 "leaky", 2,                // downstream
+                 nullptr);
+    g_object_set(sink_,
+                 "emit-signals", TRUE,
+                 "sync", FALSE,
+                 "async", FALSE,
+                 "drop", TRUE,
+                 "max-buffers", 16,
+                 nullptr);
+    g_signal_connect(sink_, "new-sample", G_CALLBACK(onNewSample), this);
+
+    gst_bin_add_many(GST_BIN(pipeline_), queue_, sink_, nullptr);
+    gst_element_link(queue_, sink_);
+
+    tee_pad_ = gst_element_request_pad_simple(tee_, "src_%u");
+    GstPad* queue_sink = gst_element_get_static_pad(queue_, "sink");
+    GstPadLinkReturn ret = gst_pad_link(tee_pad_, queue_sink);
+    gst_object_unref(queue_sink);
+    if (ret != GST_PAD_LINK_OK) {
+        return false;
+    }
+
+    gst_element_sync_state_with_parent(queue_);
+    gst_element_sync_state_with_parent(sink_);
+    return true;
+}
+
+GstCaps* TeeTap::caps() const {
+    GstPad* tee_sink = gst_element_get_static_pad(tee_, "sink");
+    GstCaps* caps = gst_pad_get_current_caps(tee_sink);
+    gst_object_unref(tee_sink);
+    return caps;
+}
+
+GstFlowReturn TeeTap::onNewSample(GstElement* sink, gpointer user_data) {
+    TeeTap* self = static_cast<TeeTap*>(user_data);
+    GstSample* sample = nullptr;
+    g_signal_emit_by_name(sink, "pull-sample", &sample);
+    if (!sample) {
+        return GST_FLOW_OK;
+    }
+
+    GstBuffer* buffer = gst_sample_get_buffer(sample);
+    if (buffer) {
+        self->handler_(buffer);
+    }
+    gst_sample_unref(sample);
+    return GST_FLOW_OK;
+}
@@ -1,4 +1,5 @@
 #include "webrtc_stream.h"
+#include "camera_probe.h"
 #include <gst/sdp/sdp.h>
 #include <iostream>
 #include <chrono>
@@ -129,19 +130,19 @@ bool WebRTCStream::createPipeline(const std::string& video_device,
         // Raspberry Pi CSI Camera (OV5647, IMX219, etc.) using libcamera
         // Optimized for the 5MP OV5647 IR Night Vision Camera
         std::cout << "Using CSI camera (libcamerasrc) - Pi Camera Module" << std::endl;
+        CameraProbe::Selection selection = CameraProbe::selectSensorMode(1280, 720, 30);
+        std::cout << "Capture mode: " << selection.reason << std::endl;
         video_source =
             "libcamerasrc ! "
-            "video/x-raw,width=1280,height=720,framerate=30/1,format=NV12 ! "
-            "videoconvert ! "
-            "video/x-raw,format=I420 ! ";
+            "video/x-raw,width=1280,height=720,framerate=" + std::to_string(selection.found ? selection.fps : 30) +
+            "/1,format=NV12 ! "
+            "videoconvert ! ";
     } else {
         // USB Camera using v4l2
         std::cout << "Using USB camera (v4l2src) - device: " << video_device << std::endl;
-        video_source =
-            "v4l2src device=" + video_device + " ! "
-            "video/x-raw,width=1280,height=720,framerate=30/1 ! "
-            "videoconvert ! "
-            "queue max-size-buffers=1 leaky=downstream ! ";
+        CameraProbe::Selection selection = CameraProbe::selectMode(video_device, 1280, 720, 30, false);
+        std::cout << "Capture mode: " << selection.reason << std::endl;
+        video_source = CameraProbe::rawSourceChain(video_device, selection, 1280, 720);
     }
 
     // Create optimized pipeline for Raspberry Pi
@@ -0,0 +1,78 @@
+// shm_stream_dump - Attach to webrtc_streamer's shared-memory stream
+//
+// Prints per-second unit/keyframe/byte counts and reader latency. Given an
+// output file it also writes the video units there (Annex B for H.264/H.265,
+// playable with ffplay).
+//
+//   shm_stream_dump /webrtc_mystream [video.h264]
+
+#include "shm_stream.h"
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <ctime>
+#include <algorithm>
+
+static int64_t monotonicUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <shm name> [video output file]" << std::endl;
+        return 1;
+    }
+
+    std::ofstream out;
+    if (argc > 2) {
+        out.open(argv[2], std::ios::binary);
+    }
+
+    ShmStreamReader reader(argv[1]);
+    for (;;) {
+        while (!reader.open()) {
+            std::cerr << "Waiting for " << argv[1] << "..." << std::endl;
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+        }
+        std::cout << "Attached to " << argv[1] << " (" << reader.videoCodec() << " + Opus)" << std::endl;
+
+        uint64_t video = 0, audio = 0, keyframes = 0, bytes = 0, overruns = 0, torn = 0;
+        int64_t max_lag_us = 0;
+        int64_t window_start = monotonicUs();
+
+        ShmStreamReader::Unit unit;
+        ShmStreamReader::Result result;
+        while ((result = reader.next(unit, 1000)) != ShmStreamReader::Result::Closed) {
+            if (result == ShmStreamReader::Result::Overrun) {
+                overruns++;
+            } else if (result == ShmStreamReader::Result::Ok) {
+                max_lag_us = std::max(max_lag_us, monotonicUs() - unit.capture_us);
+                bytes += unit.size;
+                if (unit.audio()) {
+                    audio++;
+                } else {
+                    video++;
+                    keyframes += unit.keyframe();
+                    if (out.is_open()) {
+                        out.write(reinterpret_cast<const char*>(unit.data), unit.size);
+                    }
+                }
+                torn += !reader.stillValid(unit);
+            }
+
+            int64_t now = monotonicUs();
+            if (now - window_start >= 1000000) {
+                std::cout << "video " << video << " (" << keyframes << " key), audio " << audio << ", "
+                          << bytes * 8 / 1000 << " kbit, max lag " << max_lag_us / 1000.0 << "ms, "
+                          << overruns << " overruns, " << torn << " torn" << std::endl;
+                video = audio = keyframes = bytes = overruns = torn = 0;
+                max_lag_us = 0;
+                window_start = now;
+            }
+        }
+        std::cout << "Writer gone - reattaching" << std::endl;
+    }
+}